@@ -0,0 +1,119 @@
+#include <algorithm> // 包含std::max
+#include <atomic>    // 包含std::atomic，堆分配计数的钩子
+#include <cstdint>   // 包含std::uintptr_t
+
+#include "arena.h"   // 包含FrameArena类的声明
+
+// 构造函数：为每个线程准备一个空的分配块，并预先申请初始容量
+FrameArena::FrameArena(JobSystem &jobs, std::size_t capacity, std::size_t blockSize)
+	: jobs_(jobs), blockSize_(blockSize), threads_(jobs.cntThread())
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	addChunk(std::max(capacity, blockSize));
+}
+
+// addChunk函数：向上游申请一块内存，按std::max_align_t对齐
+void FrameArena::addChunk(std::size_t bytes)
+{
+	std::size_t count = (bytes + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t);
+	chunks_.push_back(Chunk{ std::unique_ptr<std::max_align_t[]>(new std::max_align_t[count]), count * sizeof(std::max_align_t) });
+	capacity_ += chunks_.back().bytes;
+	cntUpstream_++;
+}
+
+// carve函数：从当前chunk切出bytes字节，放不下就换到下一个chunk，都放不下时向上游申请
+// 新chunk的大小至少是已有总容量，这样超出容量的帧只会向上游申请很少几次
+char *FrameArena::carve(std::size_t bytes)
+{
+	bytes = (bytes + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+	while (chunkIndex_ < chunks_.size() && chunkOffset_ + bytes > chunks_[chunkIndex_].bytes)
+	{
+		chunkIndex_++;
+		chunkOffset_ = 0;
+	}
+	if (chunkIndex_ == chunks_.size())
+		addChunk(std::max(bytes, capacity_));
+	char *ret = reinterpret_cast<char *>(chunks_[chunkIndex_].memory.get()) + chunkOffset_;
+	chunkOffset_ += bytes;
+	used_ += bytes;
+	return ret;
+}
+
+// do_allocate函数：在当前线程的分配块中移动指针分配，块用完了再加锁切一个新块
+// 大的分配(超过块大小的1/4)直接从chunk中切，避免浪费当前块剩余的空间
+void *FrameArena::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+	if (bytes + alignment > blockSize_ / 4)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		char *p = carve(bytes + alignment);
+		return reinterpret_cast<void *>((reinterpret_cast<std::uintptr_t>(p) + alignment - 1) & ~std::uintptr_t(alignment - 1));
+	}
+
+	ThreadBlock &block = threads_[jobs_.threadIndex()];
+	std::uintptr_t p = (reinterpret_cast<std::uintptr_t>(block.cur) + alignment - 1) & ~std::uintptr_t(alignment - 1);
+	if (!block.cur || p + bytes > reinterpret_cast<std::uintptr_t>(block.end))
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		block.cur = carve(blockSize_);
+		block.end = block.cur + blockSize_;
+		p = (reinterpret_cast<std::uintptr_t>(block.cur) + alignment - 1) & ~std::uintptr_t(alignment - 1);
+	}
+	block.cur = reinterpret_cast<char *>(p + bytes);
+	return reinterpret_cast<void *>(p);
+}
+
+// reset函数：回收本帧的所有分配，只需要把各个指针拨回起点
+// 本帧向上游申请过新的chunk时，把所有chunk合并成一个，下一帧就能放进同一块连续内存
+void FrameArena::reset()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	peak_ = std::max(peak_, used_);
+	used_ = 0;
+	for (ThreadBlock &block : threads_)
+		block.cur = block.end = nullptr;
+	if (chunks_.size() > 1)
+	{
+		std::size_t total = capacity_;
+		chunks_.clear();
+		capacity_ = 0;
+		addChunk(total);
+	}
+	chunkIndex_ = 0;
+	chunkOffset_ = 0;
+}
+
+// peak函数：已结束的帧和当前帧中切出字节数的最大值
+std::size_t FrameArena::peak() const
+{
+	return std::max(peak_, used_);
+}
+
+// 堆分配计数的钩子，没有安装时为空
+static std::atomic<const HeapCounterHook *> heapCounterHook(nullptr);
+
+void setHeapCounterHook(const HeapCounterHook *hook)
+{
+	heapCounterHook.store(hook, std::memory_order_release);
+}
+
+bool heapAllocationsCounted()
+{
+	return heapCounterHook.load(std::memory_order_acquire) != nullptr;
+}
+
+std::size_t heapAllocations()
+{
+	const HeapCounterHook *hook = heapCounterHook.load(std::memory_order_acquire);
+	return hook ? hook->count() : 0;
+}
+
+UncountedHeapScope::UncountedHeapScope() : hook_(heapCounterHook.load(std::memory_order_acquire))
+{
+	if (hook_) hook_->pause(true);
+}
+
+UncountedHeapScope::~UncountedHeapScope()
+{
+	if (hook_) hook_->pause(false);
+}
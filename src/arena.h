@@ -0,0 +1,86 @@
+#pragma once // 防止头文件被重复包含
+
+#include <cstddef>         // 包含std::size_t, std::max_align_t
+#include <memory>          // 包含std::unique_ptr
+#include <memory_resource> // 包含std::pmr::memory_resource
+#include <mutex>           // 包含std::mutex
+#include <vector>          // 包含std::vector
+
+#include "jobs.h"          // 包含JobSystem类，按线程编号区分每个线程的分配块
+
+// FrameArena类：每帧的线性(bump)分配器，通过std::pmr::memory_resource接口给std::pmr容器使用
+// 每个线程从共享的大块内存中切出自己的分配块，之后在块内无锁地移动指针分配；释放单个对象什么也不做，
+// 帧结束时调用reset整体回收。某一帧用超了容量，reset时会把所有块合并成一个大块，之后的帧不再向上游申请内存
+// 线程按JobSystem::threadIndex区分，外部线程都是0号，因此同一时刻只能有一个外部线程使用它
+class FrameArena : public std::pmr::memory_resource {
+public:
+	// capacity为初始容量(字节)，blockSize为每个线程每次切出的分配块大小
+	FrameArena(JobSystem &jobs, std::size_t capacity, std::size_t blockSize = 64 * 1024);
+	FrameArena(const FrameArena &) = delete;
+	FrameArena &operator=(const FrameArena &) = delete;
+
+	// 帧结束时调用：回收本帧的所有分配，此后本帧分配的内存都不能再使用
+	// 调用时不能有其他线程正在分配
+	void reset();
+
+	std::size_t used() const { return used_; }         // 本帧已切出的字节数
+	std::size_t peak() const;                          // 历史上单帧切出字节数的最大值
+	std::size_t capacity() const { return capacity_; } // 已向上游申请的总容量
+	unsigned cntUpstream() const { return cntUpstream_; } // 向上游(堆)申请内存的次数
+
+protected:
+	void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+	void do_deallocate(void *, std::size_t, std::size_t) override {} // 单个释放不做任何事，帧结束时整体回收
+	bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+private:
+	struct alignas(64) ThreadBlock { // 按缓存行对齐，避免不同线程的指针之间伪共享
+		char *cur = nullptr; // 下一次分配的位置
+		char *end = nullptr; // 分配块的末尾
+	};
+	struct Chunk {
+		std::unique_ptr<std::max_align_t[]> memory; // 从上游申请的内存
+		std::size_t bytes;                           // 大小
+	};
+
+	JobSystem &jobs_;
+	std::size_t blockSize_;
+	std::vector<ThreadBlock> threads_; // 每个线程当前的分配块
+	std::mutex mutex_;                 // 保护下面的成员
+	std::vector<Chunk> chunks_;        // 从上游申请的内存，通常只有一个
+	std::size_t chunkIndex_ = 0;       // 正在切分的chunk
+	std::size_t chunkOffset_ = 0;      // 正在切分的chunk中已切出的字节数
+	std::size_t used_ = 0, peak_ = 0, capacity_ = 0;
+	unsigned cntUpstream_ = 0;
+
+	char *carve(std::size_t bytes);       // 从chunk中切出一段内存，需要持有mutex_
+	void addChunk(std::size_t bytes);     // 向上游申请一个chunk，需要持有mutex_
+};
+
+// HeapCounterHook结构：堆分配计数的钩子。库本身不替换全局operator new，替换和计数由可执行程序负责(见main.cpp)，
+// 它在启动时通过setHeapCounterHook安装钩子，库只通过钩子查询计数、暂停当前线程的计数
+struct HeapCounterHook {
+	std::size_t (*count)();         // 到目前为止计入的堆分配次数
+	void (*pause)(bool paused);     // 暂停(true)/恢复(false)当前线程的计数，可以嵌套
+};
+
+// 安装钩子，hook必须一直有效；应当在开始渲染之前调用，之后不再更换
+void setHeapCounterHook(const HeapCounterHook *hook);
+
+// 是否安装了钩子；没有安装时heapAllocations总是0，不能据此判断有没有堆分配
+bool heapAllocationsCounted();
+
+// 计入的堆分配次数，用于验证稳态渲染没有堆分配
+std::size_t heapAllocations();
+
+// 作用域内当前线程的堆分配不计入heapAllocations，用于不属于渲染本身的操作(例如写文件)
+class UncountedHeapScope {
+public:
+	UncountedHeapScope();
+	~UncountedHeapScope();
+	UncountedHeapScope(const UncountedHeapScope &) = delete;
+	UncountedHeapScope &operator=(const UncountedHeapScope &) = delete;
+
+private:
+	const HeapCounterHook *hook_;  // 构造时的钩子，析构时恢复同一个钩子的计数
+};
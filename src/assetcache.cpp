@@ -0,0 +1,41 @@
+#include "assetcache.h" // 包含AssetCache类的声明
+
+AssetCache::AssetCache(std::size_t budgetBytes) : budget_(budgetBytes)
+{
+}
+
+// get函数：命中时把缓存项移到头部，未命中时加载模型放到头部，再按预算淘汰尾部
+std::shared_ptr<Model> AssetCache::get(const std::string &path)
+{
+	auto found = index_.find(path);
+	if (found != index_.end())
+	{
+		++cntHit_;
+		lru_.splice(lru_.begin(), lru_, found->second); // 移动链表节点，迭代器保持有效
+		return found->second->model;
+	}
+
+	++cntMiss_;
+	std::shared_ptr<Model> model = std::make_shared<Model>(path);
+	if (model->nfaces() == 0) return nullptr; // 文件不存在或没有面片，不缓存，下次请求会重新尝试
+
+	std::size_t bytes = model->memoryBytes();
+	lru_.push_front(Entry{ path, model, bytes });
+	index_[path] = lru_.begin();
+	bytes_ += bytes;
+	evict();
+	return model;
+}
+
+// evict函数：超出预算时从尾部淘汰，头部(刚使用的)一项始终保留
+void AssetCache::evict()
+{
+	while (bytes_ > budget_ && lru_.size() > 1)
+	{
+		Entry &victim = lru_.back();
+		bytes_ -= victim.bytes;
+		index_.erase(victim.path);
+		lru_.pop_back(); // 仍在使用的模型由调用方的shared_ptr保持存活
+		++cntEvict_;
+	}
+}
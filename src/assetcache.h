@@ -0,0 +1,47 @@
+#pragma once // 防止头文件被重复包含
+
+#include <cstddef>       // 包含std::size_t
+#include <list>          // 包含std::list，按最近使用顺序排列的缓存项
+#include <memory>        // 包含std::shared_ptr
+#include <string>        // 包含std::string
+#include <unordered_map> // 包含std::unordered_map，按路径查找缓存项
+
+#include "model.h"       // 包含Model类
+
+// AssetCache类：常驻进程(渲染服务)的模型缓存，按路径缓存已加载的模型及其纹理
+// 缓存项按最近使用顺序排列，总内存超过预算时从最久未使用的一端淘汰。模型以shared_ptr交出，
+// 正在渲染的请求仍持有被淘汰的模型，它在请求结束后才真正释放；刚加载的模型即使单独超出预算也不会立即被淘汰
+class AssetCache {
+public:
+	// budgetBytes为缓存模型的内存预算(字节)
+	explicit AssetCache(std::size_t budgetBytes);
+	AssetCache(const AssetCache &) = delete;
+	AssetCache &operator=(const AssetCache &) = delete;
+
+	// 获取path对应的模型：命中时移到最近使用的一端，未命中时加载并按预算淘汰。加载失败返回空指针(不缓存)
+	std::shared_ptr<Model> get(const std::string &path);
+
+	std::size_t budget() const { return budget_; }   // 内存预算(字节)
+	std::size_t bytes() const { return bytes_; }     // 缓存中模型占用的内存(字节)
+	std::size_t size() const { return lru_.size(); } // 缓存的模型数量
+	unsigned cntHit() const { return cntHit_; }      // 命中次数
+	unsigned cntMiss() const { return cntMiss_; }    // 未命中(加载)次数
+	unsigned cntEvict() const { return cntEvict_; }  // 淘汰次数
+
+private:
+	struct Entry {
+		std::string path;
+		std::shared_ptr<Model> model;
+		std::size_t bytes;
+	};
+	typedef std::list<Entry> EntryList;
+
+	// 从最久未使用的一端淘汰，直到不超过预算(至少保留最近使用的一项)
+	void evict();
+
+	std::size_t budget_;
+	std::size_t bytes_ = 0;
+	EntryList lru_; // 头部是最近使用的，尾部是最久未使用的
+	std::unordered_map<std::string, EntryList::iterator> index_;
+	unsigned cntHit_ = 0, cntMiss_ = 0, cntEvict_ = 0;
+};
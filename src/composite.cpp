@@ -0,0 +1,312 @@
+#include <cerrno>       // 包含errno
+#include <algorithm>    // 包含std::min, std::max
+#include <chrono>       // 包含std::chrono，连接超时
+#include <cstring>      // 包含std::memset, std::strcpy
+#include <iostream>     // 包含std::cerr
+#include <thread>       // 包含std::this_thread::sleep_for
+
+#include <poll.h>       // 包含poll，等待连接
+#include <sys/socket.h> // 包含socket, bind, listen, accept, connect, send, recv
+#include <sys/un.h>     // 包含sockaddr_un
+#include <unistd.h>     // 包含close, unlink
+
+#include "composite.h"  // 包含ProcessGroup和DepthCompositor类的声明
+
+namespace {
+
+const int CONNECT_TIMEOUT_MS = 30000;  // 等待其他进程启动并建立连接的超时时间(毫秒)
+
+// 不超过n的最大的2的幂
+int floorPow2(int n)
+{
+	int p = 1;
+	while (p * 2 <= n) p *= 2;
+	return p;
+}
+
+// 二分交换结束后进程r(r < p2)拥有的像素范围：按伙伴编号相差1, 2, 4, ...的顺序，每轮把范围对半分，
+// 对应位为0的一方留下前一半。所有进程用同一个函数计算，0号进程据此知道收集时每个进程发来的是哪一段
+void piece(int r, int p2, std::size_t n, std::size_t &lo, std::size_t &hi)
+{
+	lo = 0;
+	hi = n;
+	for (int b = 1; b < p2; b *= 2)
+	{
+		std::size_t mid = lo + (hi - lo) / 2;
+		if (r & b) lo = mid;
+		else hi = mid;
+	}
+}
+
+} // namespace
+
+ProcessGroup::ProcessGroup(const std::string &dir, int rank, int size) : dir_(dir), rank_(rank), size_(size), channels_(size, -1)
+{
+	sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	std::string path = socketPath(rank);
+	if (path.size() >= sizeof(address.sun_path))
+	{
+		std::cerr << "socket path too long: " << path << std::endl;
+		return;
+	}
+	std::strcpy(address.sun_path, path.c_str());
+	listener_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener_ < 0) return;
+	::unlink(path.c_str()); // 删除上次运行遗留的套接字文件
+	if (::bind(listener_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || ::listen(listener_, size) < 0)
+	{
+		std::cerr << "bind " << path << ": " << std::strerror(errno) << std::endl;
+		::close(listener_);
+		listener_ = -1;
+	}
+}
+
+ProcessGroup::~ProcessGroup()
+{
+	for (int fd : channels_)
+		if (fd >= 0) ::close(fd);
+	if (listener_ >= 0)
+	{
+		::close(listener_);
+		::unlink(socketPath(rank_).c_str());
+	}
+}
+
+std::string ProcessGroup::socketPath(int r) const
+{
+	return dir_ + "/rank" + std::to_string(r) + ".sock";
+}
+
+// channel函数：编号小的一方主动连接(对方可能还没启动，重试到超时)，连接后先发送自己的编号；
+// 编号大的一方接受连接，按对方发来的编号登记，先到的其他进程的连接留给以后使用
+int ProcessGroup::channel(int peer)
+{
+	if (channels_[peer] >= 0) return channels_[peer];
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(CONNECT_TIMEOUT_MS);
+	if (rank_ < peer)
+	{
+		sockaddr_un address;
+		std::memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		std::strcpy(address.sun_path, socketPath(peer).c_str());
+		while (std::chrono::steady_clock::now() < deadline)
+		{
+			int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+			if (fd < 0) return -1;
+			if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0)
+			{
+				channels_[peer] = fd;
+				int hello = rank_;
+				if (!send(peer, &hello, sizeof(hello)))
+				{
+					::close(fd);
+					channels_[peer] = -1;
+					return -1;
+				}
+				return fd;
+			}
+			::close(fd);
+			std::this_thread::sleep_for(std::chrono::milliseconds(10)); // 对方还没有开始监听
+		}
+	}
+	else
+	{
+		while (channels_[peer] < 0)
+		{
+			int remaining = int(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count());
+			pollfd waiting = { listener_, POLLIN, 0 };
+			if (remaining <= 0 || ::poll(&waiting, 1, remaining) <= 0) break;
+			int fd = ::accept(listener_, nullptr, nullptr);
+			if (fd < 0) continue;
+			int hello = -1;
+			std::size_t done = 0;
+			while (done < sizeof(hello))
+			{
+				ssize_t n = ::recv(fd, reinterpret_cast<char *>(&hello) + done, sizeof(hello) - done, 0);
+				if (n <= 0) break;
+				done += std::size_t(n);
+			}
+			if (done != sizeof(hello) || hello < 0 || hello >= rank_ || channels_[hello] >= 0)
+			{
+				::close(fd); // 不是本组中编号更小的进程
+				continue;
+			}
+			channels_[hello] = fd;
+		}
+	}
+	if (channels_[peer] < 0)
+		std::cerr << "process " << rank_ << ": cannot connect to process " << peer << std::endl;
+	return channels_[peer];
+}
+
+bool ProcessGroup::send(int peer, const void *data, std::size_t bytes)
+{
+	int fd = channel(peer);
+	if (fd < 0) return false;
+	const char *p = static_cast<const char *>(data);
+	while (bytes > 0)
+	{
+		ssize_t n = ::send(fd, p, bytes, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		p += n;
+		bytes -= std::size_t(n);
+	}
+	return true;
+}
+
+bool ProcessGroup::recv(int peer, void *data, std::size_t bytes)
+{
+	int fd = channel(peer);
+	if (fd < 0) return false;
+	char *p = static_cast<char *>(data);
+	while (bytes > 0)
+	{
+		ssize_t n = ::recv(fd, p, bytes, 0);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		p += n;
+		bytes -= std::size_t(n);
+	}
+	return true;
+}
+
+DepthCompositor::DepthCompositor(ProcessGroup &group) : group_(group)
+{
+}
+
+bool DepthCompositor::sendRange(int peer, const float *z, const Vec3f *color, std::size_t count)
+{
+	return group_.send(peer, z, count * sizeof(float)) && (!color || group_.send(peer, color, count * sizeof(Vec3f)));
+}
+
+// recvRange函数：接收到recvZ_/recvColor_，容量不够时才扩容
+bool DepthCompositor::recvRange(int peer, std::size_t count, bool withColor)
+{
+	if (recvZ_.size() < count) recvZ_.resize(count);
+	if (withColor && recvColor_.size() < count) recvColor_.resize(count);
+	return group_.recv(peer, recvZ_.data(), count * sizeof(float)) && (!withColor || group_.recv(peer, recvColor_.data(), count * sizeof(Vec3f)));
+}
+
+bool DepthCompositor::exchange(int peer, const float *sendZ, const Vec3f *sendColor, std::size_t sendCount, std::size_t recvCount)
+{
+	if (group_.rank() < peer)
+		return sendRange(peer, sendZ, sendColor, sendCount) && recvRange(peer, recvCount, sendColor != nullptr);
+	return recvRange(peer, recvCount, sendColor != nullptr) && sendRange(peer, sendZ, sendColor, sendCount);
+}
+
+// merge函数：逐个采样比较深度，按块并行
+void DepthCompositor::merge(JobSystem &jobs, float *z, Vec3f *color, std::size_t count, bool theirsWin)
+{
+	const int GRAIN = 64 * 1024;
+	jobs.parallelFor(0, int(count), GRAIN, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			float theirs = recvZ_[i];
+			if (theirs > z[i] || (theirsWin && theirs == z[i]))
+			{
+				z[i] = theirs;
+				if (color) color[i] = recvColor_[i];
+			}
+		}
+	});
+}
+
+// reduceScatter函数：多出的进程先把整个画面交给编号减p2的进程，之后p2个进程做log2(p2)轮二分交换
+bool DepthCompositor::reduceScatter(JobSystem &jobs, float *z, Vec3f *color, std::size_t cntUnit, unsigned unitSize, std::size_t &lo, std::size_t &hi)
+{
+	int rank = group_.rank(), size = group_.size(), p2 = floorPow2(size);
+	std::size_t total = cntUnit * unitSize;
+	lo = hi = 0;
+	if (rank >= p2)
+		return sendRange(rank - p2, z, color, total);
+	if (rank + p2 < size)
+	{
+		if (!recvRange(rank + p2, total, color != nullptr)) return false;
+		merge(jobs, z, color, total, true); // 多出的进程编号更大
+	}
+
+	lo = 0;
+	hi = cntUnit;
+	for (int b = 1; b < p2; b *= 2)
+	{
+		int partner = rank ^ b;
+		std::size_t mid = lo + (hi - lo) / 2;
+		// 对应位为0的一方留下前一半，把后一半发给伙伴
+		std::size_t keepLo = (rank & b) ? mid : lo, keepHi = (rank & b) ? hi : mid;
+		std::size_t sendLo = (rank & b) ? lo : mid, sendHi = (rank & b) ? mid : hi;
+		std::size_t keep = (keepHi - keepLo) * unitSize;
+		if (!exchange(partner, z + sendLo * unitSize, color ? color + sendLo * unitSize : nullptr, (sendHi - sendLo) * unitSize, keep))
+			return false;
+		// 伙伴一组的编号都比本组大时，z相同取伙伴的
+		merge(jobs, z + keepLo * unitSize, color ? color + keepLo * unitSize : nullptr, keep, (partner & b) != 0);
+		lo = keepLo;
+		hi = keepHi;
+	}
+	return true;
+}
+
+// reduce函数：二分交换之后，各进程把自己的那一段直接发给0号进程
+bool DepthCompositor::reduce(JobSystem &jobs, float *z, Vec3f *color, std::size_t cntUnit, unsigned unitSize)
+{
+	std::size_t lo, hi;
+	if (!reduceScatter(jobs, z, color, cntUnit, unitSize, lo, hi)) return false;
+	int rank = group_.rank(), p2 = floorPow2(group_.size());
+	if (rank >= p2) return true;
+	if (rank != 0)
+		return sendRange(0, z + lo * unitSize, color ? color + lo * unitSize : nullptr, (hi - lo) * unitSize);
+	for (int r = 1; r < p2; ++r)
+	{
+		std::size_t rlo, rhi;
+		piece(r, p2, cntUnit, rlo, rhi);
+		std::size_t offset = rlo * unitSize, count = (rhi - rlo) * unitSize;
+		if (!group_.recv(r, z + offset, count * sizeof(float))) return false;
+		if (color && !group_.recv(r, color + offset, count * sizeof(Vec3f))) return false;
+	}
+	return true;
+}
+
+// allreduce函数：二分交换之后按相反的顺序与同一批伙伴交换各自的那一段(全收集)，
+// 每轮拥有的范围翻倍，最后再把整个结果发回给多出的进程
+bool DepthCompositor::allreduce(JobSystem &jobs, float *z, Vec3f *color, std::size_t cntUnit, unsigned unitSize)
+{
+	std::size_t lo, hi;
+	if (!reduceScatter(jobs, z, color, cntUnit, unitSize, lo, hi)) return false;
+	int rank = group_.rank(), size = group_.size(), p2 = floorPow2(size);
+	std::size_t total = cntUnit * unitSize;
+	if (rank >= p2)
+		return group_.recv(rank - p2, z, total * sizeof(float)) && (!color || group_.recv(rank - p2, color, total * sizeof(Vec3f)));
+
+	for (int b = p2 / 2; b >= 1; b /= 2)
+	{
+		int partner = rank ^ b;
+		// 伙伴当前拥有的范围：只按不高于b的位划分(比b高的位已经在前几轮收集回来)
+		std::size_t parentLo = 0, parentHi = cntUnit;
+		for (int c = 1; c < b; c *= 2)
+		{
+			std::size_t mid = parentLo + (parentHi - parentLo) / 2;
+			if (partner & c) parentLo = mid;
+			else parentHi = mid;
+		}
+		std::size_t mid = parentLo + (parentHi - parentLo) / 2;
+		std::size_t plo = (partner & b) ? mid : parentLo, phi = (partner & b) ? parentHi : mid;
+		std::size_t sendCount = (hi - lo) * unitSize, recvCount = (phi - plo) * unitSize;
+		float *recvZ = z + plo * unitSize;
+		Vec3f *recvColor = color ? color + plo * unitSize : nullptr;
+		// 直接收到最终位置，编号小的一方先发后收
+		bool ok = rank < partner
+			? sendRange(partner, z + lo * unitSize, color ? color + lo * unitSize : nullptr, sendCount) &&
+			  group_.recv(partner, recvZ, recvCount * sizeof(float)) && (!color || group_.recv(partner, recvColor, recvCount * sizeof(Vec3f)))
+			: group_.recv(partner, recvZ, recvCount * sizeof(float)) && (!color || group_.recv(partner, recvColor, recvCount * sizeof(Vec3f))) &&
+			  sendRange(partner, z + lo * unitSize, color ? color + lo * unitSize : nullptr, sendCount);
+		if (!ok) return false;
+		lo = std::min(lo, plo);
+		hi = std::max(hi, phi);
+	}
+	if (rank + p2 < size)
+		return sendRange(rank + p2, z, color, total);
+	return true;
+}
@@ -0,0 +1,70 @@
+#pragma once // 防止头文件被重复包含
+
+#include <cstddef>    // 包含std::size_t
+#include <string>     // 包含std::string
+#include <vector>     // 包含std::vector
+
+#include "geometry.h" // 包含Vec3f
+#include "jobs.h"     // 包含JobSystem类，并行合并
+
+// ProcessGroup类：一组协作渲染的进程之间的点对点连接，基于本地Unix域套接字
+// 每个进程(编号rank，共size个)在dir下监听rank<r>.sock；两个进程第一次通信时由编号小的一方连接编号大的一方，
+// 连接建立后一直保持，之后每帧都复用。对方还没启动时连接会重试，直到超时
+class ProcessGroup {
+public:
+	ProcessGroup(const std::string &dir, int rank, int size);
+	~ProcessGroup();
+	ProcessGroup(const ProcessGroup &) = delete;
+	ProcessGroup &operator=(const ProcessGroup &) = delete;
+
+	bool ok() const { return listener_ >= 0; } // 监听套接字是否创建成功
+	int rank() const { return rank_; }
+	int size() const { return size_; }
+
+	// 向peer发送/从peer接收bytes字节，阻塞直到完成，失败(超时或对方断开)返回false
+	bool send(int peer, const void *data, std::size_t bytes);
+	bool recv(int peer, void *data, std::size_t bytes);
+
+private:
+	int channel(int peer);            // 与peer的连接，还没有时建立，失败返回-1
+	std::string socketPath(int r) const;
+
+	std::string dir_;
+	int rank_, size_;
+	int listener_ = -1;
+	std::vector<int> channels_;       // 与每个进程的连接，-1表示还没有建立
+};
+
+// DepthCompositor类：排序在后(sort-last)的分布式渲染中按深度合并各进程的部分画面
+// 每个进程只渲染场景的一部分模型，得到完整分辨率的深度和颜色；合并时每个采样保留z最大(最近)的那个，
+// z相同时保留编号较大的进程的采样，与单进程按模型顺序绘制时后画的覆盖先画的一致(模型按编号轮流分配给进程；
+// 进程数不是2的幂时，多出的进程与其他进程之间z相同的采样不保证这个顺序)
+// 合并用二分交换(binary swap)：log2(size)轮中每个进程与一个伙伴(编号相差1, 2, 4, ...)交换当前区域的一半，各自合并留下的一半，
+// 每个进程每轮收发的数据量减半，最后每个进程拥有1/size的完整结果。进程数不是2的幂时，多出的进程先把
+// 整个画面交给对应的进程，不参与交换
+class DepthCompositor {
+public:
+	explicit DepthCompositor(ProcessGroup &group);
+
+	int rank() const { return group_.rank(); }
+
+	// 合并到0号进程(jobs用于并行合并)：z和color各有cntUnit * unitSize个采样(unitSize为每个像素的采样数)，color可以为nullptr
+	// 返回后0号进程的z和color是所有进程合并的结果，其他进程的缓冲区内容不再有意义
+	bool reduce(JobSystem &jobs, float *z, Vec3f *color, std::size_t cntUnit, unsigned unitSize);
+	// 合并到所有进程：返回后每个进程的z和color都是合并的结果(用于阴影贴图，每个进程着色时都需要完整的阴影)
+	bool allreduce(JobSystem &jobs, float *z, Vec3f *color, std::size_t cntUnit, unsigned unitSize);
+
+private:
+	// 二分交换部分，返回后本进程拥有[lo, hi)个像素的合并结果；多出的进程返回时lo == hi
+	bool reduceScatter(JobSystem &jobs, float *z, Vec3f *color, std::size_t cntUnit, unsigned unitSize, std::size_t &lo, std::size_t &hi);
+	// 把收到的采样合并到本地，theirsWin为true时z相等也取收到的
+	void merge(JobSystem &jobs, float *z, Vec3f *color, std::size_t count, bool theirsWin);
+	bool sendRange(int peer, const float *z, const Vec3f *color, std::size_t count);
+	bool recvRange(int peer, std::size_t count, bool withColor);
+	// 与peer交换：编号小的一方先发后收，编号大的一方先收后发，两边不会同时阻塞在发送上
+	bool exchange(int peer, const float *sendZ, const Vec3f *sendColor, std::size_t sendCount, std::size_t recvCount);
+
+	ProcessGroup &group_;
+	std::vector<float> recvZ_;       // 接收缓冲区，容量只增不减，稳态下不再分配
+	std::vector<Vec3f> recvColor_;
+};
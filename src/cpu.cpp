@@ -0,0 +1,102 @@
+#include <atomic>   // 包含std::atomic，覆盖选择的等级
+#include <cstring>  // 包含strcmp
+
+#include "cpu.h"    // 包含SimdLevel的声明
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CPU_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>  // 包含__cpuidex, _xgetbv
+#else
+#include <cpuid.h>   // 包含__get_cpuid_count
+#endif
+#endif
+
+#ifdef CPU_X86
+// cpuid函数：执行CPUID指令，r依次为eax, ebx, ecx, edx；leaf超出范围时返回全0
+static void cpuid(unsigned leaf, unsigned subleaf, unsigned r[4])
+{
+#if defined(_MSC_VER)
+	int v[4];
+	__cpuidex(v, int(leaf), int(subleaf));
+	for (int i = 0; i < 4; ++i) r[i] = unsigned(v[i]);
+#else
+	if (!__get_cpuid_count(leaf, subleaf, &r[0], &r[1], &r[2], &r[3]))
+		r[0] = r[1] = r[2] = r[3] = 0;
+#endif
+}
+
+// xgetbv函数：读取XCR0，看操作系统在线程切换时保存了哪些寄存器状态
+static unsigned long long xgetbv()
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	unsigned eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+}
+#endif
+
+// detectSimdLevel函数：CPU支持某个指令集还不够，操作系统也要保存对应的寄存器(XCR0)，否则执行时会出错
+//   AVX：CPUID.1:ECX的AVX位和OSXSAVE位，XCR0保存了XMM和YMM(位1、2)
+//   AVX-512F：CPUID.7.0:EBX位16，XCR0还保存了opmask和ZMM(位5、6、7)
+SimdLevel detectSimdLevel()
+{
+	static const SimdLevel detected = []()
+	{
+#ifdef CPU_X86
+		unsigned r[4];
+		cpuid(0, 0, r);
+		unsigned maxLeaf = r[0];
+		cpuid(1, 0, r);
+		if (!(r[3] & (1u << 26))) return SIMD_SCALAR;  // SSE2
+		bool osxsave = (r[2] & (1u << 27)) != 0, avx = (r[2] & (1u << 28)) != 0;
+		if (!osxsave || !avx) return SIMD_SSE2;
+		unsigned long long xcr0 = xgetbv();
+		if ((xcr0 & 0x6) != 0x6) return SIMD_SSE2;
+		if (maxLeaf < 7) return SIMD_AVX;
+		cpuid(7, 0, r);
+		if ((r[1] & (1u << 16)) && (xcr0 & 0xe6) == 0xe6) return SIMD_AVX512;
+		return SIMD_AVX;
+#else
+		return SIMD_SCALAR;
+#endif
+	}();
+	return detected;
+}
+
+// 覆盖选择请求的等级，SIMD_LEVEL_COUNT表示自动；整个进程共用一个，几何阶段在其他线程上读取，所以是原子变量
+static std::atomic<SimdLevel> requested(SIMD_LEVEL_COUNT);
+
+SimdLevel activeSimdLevel()
+{
+	SimdLevel detected = detectSimdLevel();
+	SimdLevel level = requested.load(std::memory_order_relaxed);
+	return level < detected ? level : detected;
+}
+
+bool setSimdOverride(const char *name)
+{
+	if (std::strcmp(name, "auto") == 0)
+	{
+		requested.store(SIMD_LEVEL_COUNT, std::memory_order_relaxed);
+		return true;
+	}
+	for (int level = 0; level < SIMD_LEVEL_COUNT; ++level)
+	{
+		if (std::strcmp(name, simdLevelName(SimdLevel(level))) == 0)
+		{
+			requested.store(SimdLevel(level), std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+const char *simdLevelName(SimdLevel level)
+{
+	static const char *const names[SIMD_LEVEL_COUNT] = { "scalar", "sse2", "avx", "avx512" };
+	return level < SIMD_LEVEL_COUNT ? names[level] : "auto";
+}
@@ -0,0 +1,27 @@
+#pragma once // 防止头文件被重复包含
+
+// SIMD指令集等级，数值越大越宽；每一级都包含前面各级
+enum SimdLevel
+{
+	SIMD_SCALAR,  // 不用SIMD(非x86或者强制关闭)
+	SIMD_SSE2,    // 4路float，x86-64的基线
+	SIMD_AVX,     // 8路float，AVX2的机器也走这一级(核心只有浮点运算，用不到AVX2的整数指令)
+	SIMD_AVX512,  // 16路float，需要AVX-512F
+	SIMD_LEVEL_COUNT
+};
+
+// 用CPUID(以及XGETBV确认操作系统保存了对应的寄存器)检测本机支持的最高等级，结果只算一次
+SimdLevel detectSimdLevel();
+
+// 当前使用的等级：默认是检测到的最高等级，setSimdOverride可以把它降低
+// 这是整个进程的设置，所有RenderContext共用。三角形设置、矩阵变换、光栅化和解析的核心在每个绘制(或每个通道)开始时读一次，
+// 遮挡缓冲区的光栅化在每个遮挡模型开始时读一次，纹理采样和立方体阴影查询在每次采样时读取，选出对应的实现(见simd.h)
+SimdLevel activeSimdLevel();
+
+// 覆盖选择："scalar"、"sse2"、"avx"、"avx512"或"auto"，名字无效时返回false并保持原来的选择
+// 请求的等级超过本机支持的等级时退回到本机支持的最高等级。可以在任何线程调用(包括有上下文正在渲染时)，
+// 正在进行的绘制继续用开始时读到的等级，之后的绘制才换成新的
+bool setSimdOverride(const char *name);
+
+// 等级的名字，用于报告选择的路径
+const char *simdLevelName(SimdLevel level);
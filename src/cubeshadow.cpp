@@ -0,0 +1,218 @@
+#include <algorithm>    // 包含std::min和std::max
+#include <cmath>        // 包含fabsf, acosf
+#include <limits>       // 包含float的最大值，清除值
+
+#include "cubeshadow.h" // 包含CubeShadowMap类的声明
+#include "gl.h"         // 包含projection和viewport
+#include "simd.h"       // 包含SIMD_TARGET_PUSH和指令集等级，4个方向的查询按指令集编译多份
+
+const int ROWS_PER_CLEAR = 16;  // 清除时每个作业处理的行数
+
+// 每个面的朝向：前方F、右方R和上方U，见头文件中的表
+static const float FACE_AXES[CUBE_FACES][3][3] = {
+	{ { 1, 0, 0 }, { 0, 0, 1 }, { 0, 1, 0 } },    // +X
+	{ { -1, 0, 0 }, { 0, 0, -1 }, { 0, 1, 0 } },  // -X
+	{ { 0, 1, 0 }, { 1, 0, 0 }, { 0, 0, 1 } },    // +Y
+	{ { 0, -1, 0 }, { 1, 0, 0 }, { 0, 0, -1 } },  // -Y
+	{ { 0, 0, 1 }, { -1, 0, 0 }, { 0, 1, 0 } },   // +Z
+	{ { 0, 0, -1 }, { 1, 0, 0 }, { 0, 1, 0 } },   // -Z
+};
+
+// PCF的4个采样方向：正四面体的4个顶点，偏移量乘以片段处大约1.5个纹素的距离
+static const float PCF_OFFSETS[4][3] = { { 1, 1, 1 }, { 1, -1, -1 }, { -1, 1, -1 }, { -1, -1, 1 } };
+
+CubeShadowMap::CubeShadowMap(unsigned size, float zNear, float zFar)
+	: size_(size), near_(zNear), far_(zFar), center_(),
+	  z_(size_t(CUBE_FACES) * size * size), distance_(size_t(CUBE_FACES) * size * size)
+{
+}
+
+// faceProjView函数：视图矩阵的三行是R, U, -F，与lookat的结果形式相同(旋转 * 平移)，投影为90度视场
+Matrix CubeShadowMap::faceProjView(int face) const
+{
+	Matrix rotate = Matrix::identity(), translate = Matrix::identity();
+	for (int i = 0; i < 3; ++i)
+	{
+		rotate[0][i] = FACE_AXES[face][1][i];
+		rotate[1][i] = FACE_AXES[face][2][i];
+		rotate[2][i] = -FACE_AXES[face][0][i];
+		translate[i][3] = -center_[i];
+	}
+	return projection(acosf(-1.0f) / 2.0f, 1.0f, -near_, -far_) * rotate * translate;
+}
+
+Matrix CubeShadowMap::faceVpPV(int face) const
+{
+	return viewport(size_, size_) * faceProjView(face);
+}
+
+// faceVisible函数：面的视锥是以F为轴的四棱锥，四个侧面为(F - R).p >= 0, (F + R).p >= 0, (F - U).p >= 0, (F + U).p >= 0
+bool CubeShadowMap::faceVisible(int face, const Vec3f &bmin, const Vec3f &bmax, const Matrix &model) const
+{
+	const float (&axes)[3][3] = FACE_AXES[face];
+	Vec3f F(axes[0][0], axes[0][1], axes[0][2]), R(axes[1][0], axes[1][1], axes[1][2]), U(axes[2][0], axes[2][1], axes[2][2]);
+	Vec3f planes[4] = { F - R, F + R, F - U, F + U };
+	unsigned outside[5] = {};  // 在每个侧面和远平面外侧的角点数
+	for (int c = 0; c < 8; ++c)
+	{
+		Vec4f corner(c & 1 ? bmax.x : bmin.x, c & 2 ? bmax.y : bmin.y, c & 4 ? bmax.z : bmin.z, 1.0f);
+		Vec3f p = proj<3>(model * corner) - center_;
+		for (int i = 0; i < 4; ++i)
+			outside[i] += dot(planes[i], p) < 0.0f;
+		outside[4] += dot(F, p) > far_;
+	}
+	for (int i = 0; i < 5; ++i)
+		if (outside[i] == 8) return false;
+	return true;
+}
+
+// clearFace函数：按行并行清除一个面
+void CubeShadowMap::clearFace(JobSystem &jobs, int face)
+{
+	float *z = zBuffer(face);
+	Vec3f *distance = distanceBuffer(face);
+	jobs.parallelFor(0, size_, ROWS_PER_CLEAR, [&](int begin, int end)
+	{
+		for (size_t i = size_t(begin) * size_; i < size_t(end) * size_; ++i)
+		{
+			z[i] = -std::numeric_limits<float>::max();
+			distance[i] = Vec3f(std::numeric_limits<float>::max(), 0.0f, 0.0f);
+		}
+	});
+}
+
+// lookupTexel函数：主轴决定面，面内坐标按头文件中的表取符号，再按viewport映射到像素，取最近的纹素
+// 像素坐标先加0.5再截断到[0, size - 1]，等价于四舍五入并把超出面边缘的部分夹到边上
+static int lookupTexel(unsigned size, float x, float y, float z)
+{
+	float ax = fabsf(x), ay = fabsf(y), az = fabsf(z);
+	bool isX = ax >= ay && ax >= az, isY = !isX && ay >= az;
+	float face, ma, sc, tc;
+	if (isX)
+	{
+		face = x > 0.0f ? 0.0f : 1.0f;
+		ma = ax;
+		sc = x > 0.0f ? z : -z;
+		tc = y;
+	}
+	else if (isY)
+	{
+		face = y > 0.0f ? 2.0f : 3.0f;
+		ma = ay;
+		sc = x;
+		tc = y > 0.0f ? z : -z;
+	}
+	else
+	{
+		face = z > 0.0f ? 4.0f : 5.0f;
+		ma = az;
+		sc = z > 0.0f ? -x : x;
+		tc = y;
+	}
+	float half = size * 0.5f, offset = (size - 1) * 0.5f + 0.5f, maxTexel = float(size - 1);
+	float tx = std::min(std::max(sc / ma * half + offset, 0.0f), maxTexel);
+	float ty = std::min(std::max(tc / ma * half + offset, 0.0f), maxTexel);
+	// 下标在float中计算，六个面的纹素总数远小于2^24，整数都能精确表示
+	return int(face * float(size) * float(size) + float(int(ty)) * float(size) + float(int(tx)));
+}
+
+// 4个方向一起查询的实现，每个指令集一份，与lookupTexel逐路的结果完全相同；运行时由lookup4Kernel选出
+typedef void (*Lookup4Kernel)(unsigned size, const float *x, const float *y, const float *z, int *index);
+
+namespace cube_scalar {
+static void lookup4(unsigned size, const float *x, const float *y, const float *z, int *index)
+{
+	for (int l = 0; l < 4; ++l)
+		index[l] = lookupTexel(size, x[l], y[l], z[l]);
+}
+}
+
+#ifdef SIMD_X86
+// SSE2：与lookupTexel相同的计算，分支换成掩码选择
+SIMD_TARGET_PUSH("sse2")
+namespace cube_sse2 {
+static void lookup4(unsigned size, const float *x, const float *y, const float *z, int *index)
+{
+	__m128 vx = _mm_loadu_ps(x), vy = _mm_loadu_ps(y), vz = _mm_loadu_ps(z);
+	__m128 signMask = _mm_set1_ps(-0.0f), zero = _mm_setzero_ps();
+	__m128 ax = _mm_andnot_ps(signMask, vx), ay = _mm_andnot_ps(signMask, vy), az = _mm_andnot_ps(signMask, vz);
+	auto select = [](__m128 mask, __m128 a, __m128 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); };
+	__m128 isX = _mm_and_ps(_mm_cmpge_ps(ax, ay), _mm_cmpge_ps(ax, az));
+	__m128 isY = _mm_andnot_ps(isX, _mm_cmpge_ps(ay, az));
+	__m128 posX = _mm_cmpgt_ps(vx, zero), posY = _mm_cmpgt_ps(vy, zero), posZ = _mm_cmpgt_ps(vz, zero);
+	__m128 nx = _mm_xor_ps(vx, signMask), nz = _mm_xor_ps(vz, signMask);  // 取负
+
+	__m128 face = select(isX, select(posX, _mm_set1_ps(0.0f), _mm_set1_ps(1.0f)),
+		select(isY, select(posY, _mm_set1_ps(2.0f), _mm_set1_ps(3.0f)), select(posZ, _mm_set1_ps(4.0f), _mm_set1_ps(5.0f))));
+	__m128 ma = select(isX, ax, select(isY, ay, az));
+	__m128 sc = select(isX, select(posX, vz, nz), select(isY, vx, select(posZ, nx, vx)));
+	__m128 tc = select(isY, select(posY, vz, nz), vy);
+
+	__m128 half = _mm_set1_ps(size * 0.5f), offset = _mm_set1_ps((size - 1) * 0.5f + 0.5f), maxTexel = _mm_set1_ps(float(size - 1));
+	__m128 tx = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(_mm_div_ps(sc, ma), half), offset), zero), maxTexel);
+	__m128 ty = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(_mm_div_ps(tc, ma), half), offset), zero), maxTexel);
+	tx = _mm_cvtepi32_ps(_mm_cvttps_epi32(tx));  // 截断为整数
+	ty = _mm_cvtepi32_ps(_mm_cvttps_epi32(ty));
+	__m128 vsize = _mm_set1_ps(float(size));
+	__m128 idx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(face, vsize), vsize), _mm_mul_ps(ty, vsize)), tx);
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(index), _mm_cvttps_epi32(idx));
+}
+}
+SIMD_TARGET_POP
+#endif
+
+// lookup4Kernel函数：按指令集等级选出实现
+// 一次只查4个方向，AVX和AVX-512没有更宽的用武之地，都用SSE2的实现；没有编译进来的等级退回标量实现
+static Lookup4Kernel lookup4Kernel(SimdLevel level)
+{
+#ifdef SIMD_X86
+	switch (level)
+	{
+	case SIMD_AVX512:
+	case SIMD_AVX:
+	case SIMD_SSE2: return cube_sse2::lookup4;
+	default: break;
+	}
+#endif
+	return cube_scalar::lookup4;
+}
+
+int CubeShadowMap::lookup(float x, float y, float z) const
+{
+	return lookupTexel(size_, x, y, z);
+}
+
+// lookup4函数：每次查询时按当前的指令集等级选出实现，与纹理采样相同
+void CubeShadowMap::lookup4(const float *x, const float *y, const float *z, int *index) const
+{
+	lookup4Kernel(activeSimdLevel())(size_, x, y, z, index);
+}
+
+// shadow函数：4个采样方向一起选面和投影，再逐个比较距离
+// 偏差随距离增大，抵消纹素在远处覆盖的范围变大带来的自阴影
+float CubeShadowMap::shadow(const Vec3f &d, float dist) const
+{
+	if (!(dist > 0.0f)) return 0.0f;
+	float radius = dist * 3.0f / size_;  // 约1.5个纹素(90度视场下一个纹素约对应2/size弧度)
+	float x[4], y[4], z[4];
+	for (int l = 0; l < 4; ++l)
+	{
+		x[l] = d.x + PCF_OFFSETS[l][0] * radius;
+		y[l] = d.y + PCF_OFFSETS[l][1] * radius;
+		z[l] = d.z + PCF_OFFSETS[l][2] * radius;
+	}
+	int index[4];
+	lookup4(x, y, z, index);
+	float test = dist - (0.01f + dist * 4.0f / size_);  // 偏差：常数项加上约两个纹素的距离
+	float shadow = 0.0f;
+	for (int l = 0; l < 4; ++l)
+		if (test > distance_[index[l]].x) shadow += 0.25f;
+	return shadow;
+}
+
+float CubeShadowMap::shadowTap(const Vec3f &d, float dist) const
+{
+	if (!(dist > 0.0f)) return 0.0f;
+	float test = dist - (0.01f + dist * 4.0f / size_);
+	return test > distance_[lookup(d.x, d.y, d.z)].x ? 1.0f : 0.0f;
+}
@@ -0,0 +1,56 @@
+#pragma once // 防止头文件被重复包含
+
+#include <vector>      // 包含std::vector
+
+#include "geometry.h"  // 包含Vec3f和Matrix
+#include "jobs.h"      // 包含JobSystem类，并行清除
+
+const int CUBE_FACES = 6;  // 立方体的面：+X, -X, +Y, -Y, +Z, -Z
+
+// CubeShadowMap类：点光源的立方体阴影贴图
+// 六个面各是一个90度视场的透视深度目标，光源位于立方体中心。每个面保存的不是深度缓冲区的z，
+// 而是最近表面到光源的距离(颜色缓冲区的x分量，由距离着色器写入)，查询时直接与片段到光源的距离比较，
+// 与面的投影无关，跨面的采样也不用换算
+// 面的朝向(视图矩阵的行R, U, -F都是正负坐标轴，且R x U = -F)：
+//   +X: R=+z U=+y   -X: R=-z U=+y   +Y: R=+x U=+z   -Y: R=+x U=-z   +Z: R=-x U=+y   -Z: R=+x U=+y
+// 方向d落在主轴对应的面上，面内坐标为(R.d, U.d) / |主轴分量|，查询完全由这张表决定，与渲染时的矩阵一致
+class CubeShadowMap {
+public:
+	// size为每个面的边长(像素)，zNear, zFar为渲染各个面时的近、远平面距离
+	CubeShadowMap(unsigned size, float zNear, float zFar);
+
+	// 设置光源位置，之后渲染和查询都以它为中心
+	void setCenter(const Vec3f &center) { center_ = center; }
+	const Vec3f &center() const { return center_; }
+	unsigned size() const { return size_; }
+
+	// 第face个面的投影 * 视图矩阵(用于裁剪)和视口 * 投影 * 视图矩阵(顶点着色器使用)
+	Matrix faceProjView(int face) const;
+	Matrix faceVpPV(int face) const;
+
+	// 模型空间的包围盒经过model变换后是否可能在第face个面的视锥内：
+	// 8个角点都在某个侧面(或远平面)外侧时剔除，结果是保守的
+	bool faceVisible(int face, const Vec3f &bmin, const Vec3f &bmax, const Matrix &model) const;
+
+	// 第face个面的深度缓冲区和距离缓冲区，清除后深度为负无穷，距离为无穷远(不遮挡)
+	float *zBuffer(int face) { return &z_[size_t(face) * size_ * size_]; }
+	Vec3f *distanceBuffer(int face) { return &distance_[size_t(face) * size_ * size_]; }
+	void clearFace(JobSystem &jobs, int face);
+
+	// 阴影因子(0到1之间)：d为片段相对光源的位置，dist为|d|
+	// shadow在d周围取4个方向一起查询(4路向量化选面和投影)，shadowTap只查d本身
+	float shadow(const Vec3f &d, float dist) const;
+	float shadowTap(const Vec3f &d, float dist) const;
+
+private:
+	unsigned size_;
+	float near_, far_;
+	Vec3f center_;
+	std::vector<float> z_;         // 六个面的深度缓冲区，逐面存储
+	std::vector<Vec3f> distance_;  // 六个面的距离缓冲区，x分量为最近表面到光源的距离
+
+	// 4个方向各自所在的面和纹素，结果为距离缓冲区中的下标
+	void lookup4(const float *x, const float *y, const float *z, int *index) const;
+	// 1个方向的纹素下标，与lookup4的每一路相同
+	int lookup(float x, float y, float z) const;
+};
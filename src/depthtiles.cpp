@@ -0,0 +1,117 @@
+#include <cfloat>        // 包含FLT_MAX，深度的清除值
+
+#include "depthtiles.h"  // 包含DepthTiles类的声明
+
+// 清除值对应的深度平面：处处为-FLT_MAX，部分覆盖的已清除分块用它表示没写过的采样点
+static const DepthPlane CLEAR_PLANE = { 0.0f, 0.0f, { -FLT_MAX, 0.0f, 0.0f }, { 1.0f, 0.0f, 0.0f } };
+
+// 构造函数：按RASTER_BLOCK划分分块，保存采样点偏移
+DepthTiles::DepthTiles(unsigned width, unsigned height, const float d[][2], unsigned cntSample)
+	: width_(width), height_(height), cntSample_(cntSample),
+	  tilesX_((width + RASTER_BLOCK - 1) / RASTER_BLOCK), tilesY_((height + RASTER_BLOCK - 1) / RASTER_BLOCK),
+	  tiles_(tilesX_ * tilesY_)
+{
+	for (unsigned i = 0; i < cntSample && i < MAX_SAMPLES; ++i)
+	{
+		d_[i][0] = d[i][0];
+		d_[i][1] = d[i][1];
+	}
+	clear();
+}
+
+// clear函数：快速清除，不压缩时所有分块都是DEPTH_RAW，由调用者自己清除原始缓冲区
+void DepthTiles::clear()
+{
+	for (DepthTile &tile : tiles_)
+		tile.state = enabled() ? DEPTH_CLEAR : DEPTH_RAW;
+}
+
+// depth函数：按选择掩码找到采样点所在的平面并求值
+float DepthTiles::depth(const DepthTile &tile, unsigned bit, int x, int y, unsigned i) const
+{
+	if (tile.state == DEPTH_CLEAR) return -FLT_MAX;
+	return evalDepth(tile.plane[(tile.select[bit / 64] >> (bit % 64)) & 1], x, y, d_[i]);
+}
+
+// merge函数：一次写入之后分块里的深度由三部分组成：没通过的采样点用到的旧平面(最多两个)和新平面
+// 新平面覆盖了所有采样点时分块只剩一个平面，旧平面只剩一个还在用时变成两个平面，否则解压
+void DepthTiles::merge(DepthTile &tile, const uint64_t *pass, const DepthPlane &plane, float *zBuffer, int bx, int by) const
+{
+	unsigned cntBit = RASTER_BLOCK * RASTER_BLOCK * cntSample_;
+	unsigned cntWord = (cntBit + 63) / 64;
+	bool used[2] = { false, false };  // 没通过的采样点是否还在用旧的plane[0]/plane[1]
+	for (unsigned w = 0; w < cntWord; ++w)
+	{
+		uint64_t valid = (w == cntWord - 1 && cntBit % 64) ? (uint64_t(1) << (cntBit % 64)) - 1 : ~uint64_t(0);
+		uint64_t keep = ~pass[w] & valid;
+		if (tile.state == DEPTH_CLEAR)
+		{
+			used[0] = used[0] || keep != 0;
+			continue;
+		}
+		used[0] = used[0] || (keep & ~tile.select[w]) != 0;
+		used[1] = used[1] || (keep & tile.select[w]) != 0;
+	}
+
+	if (used[0] && used[1])
+	{
+		decompress(tile, zBuffer, bx, by, pass, &plane);
+		return;
+	}
+	if (!used[0] && !used[1])  // 新平面覆盖了整个分块
+	{
+		tile.state = DEPTH_PLANES;
+		tile.cntPlane = 1;
+		tile.plane[0] = plane;
+		for (unsigned w = 0; w < DEPTH_MASK_WORDS; ++w) tile.select[w] = 0;
+		return;
+	}
+	// 留下还在用的旧平面作为plane[0]，新平面作为plane[1]，选择掩码就是通过的采样点
+	tile.plane[0] = tile.state == DEPTH_CLEAR ? CLEAR_PLANE : tile.plane[used[0] ? 0 : 1];
+	tile.plane[1] = plane;
+	tile.state = DEPTH_PLANES;
+	tile.cntPlane = 2;
+	for (unsigned w = 0; w < DEPTH_MASK_WORDS; ++w) tile.select[w] = w < cntWord ? pass[w] : 0;
+}
+
+// decompress函数：逐采样点求出深度写回原始缓冲区，超出屏幕的像素跳过
+void DepthTiles::decompress(DepthTile &tile, float *zBuffer, int bx, int by, const uint64_t *pass, const DepthPlane *plane) const
+{
+	if (tile.state == DEPTH_RAW) return;
+	for (int y = by; y < by + RASTER_BLOCK && y < int(height_); ++y)
+	{
+		for (int x = bx; x < bx + RASTER_BLOCK && x < int(width_); ++x)
+		{
+			for (unsigned i = 0; i < cntSample_; ++i)
+			{
+				unsigned bit = ((y - by) * RASTER_BLOCK + (x - bx)) * cntSample_ + i;
+				bool written = pass && ((pass[bit / 64] >> (bit % 64)) & 1);
+				zBuffer[cntSample_ * (y * width_ + x) + i] = written ? evalDepth(*plane, x, y, d_[i]) : depth(tile, bit, x, y, i);
+			}
+		}
+	}
+	tile.state = DEPTH_RAW;
+}
+
+// resolve函数：通道结束时把仍然压缩的分块写回，之后原始缓冲区就是完整的深度
+void DepthTiles::resolve(JobSystem &jobs, float *zBuffer)
+{
+	jobs.parallelFor(0, tilesY_, 1, [&](int begin, int end)
+	{
+		for (int ty = begin; ty < end; ++ty)
+			for (int tx = 0; tx < tilesX_; ++tx)
+				decompress(tile(tx, ty), zBuffer, tx * RASTER_BLOCK, ty * RASTER_BLOCK);
+	});
+}
+
+// count函数：统计各状态的分块数，resolve之前调用才能看到压缩的效果
+void DepthTiles::count(unsigned cnt[4]) const
+{
+	cnt[0] = cnt[1] = cnt[2] = cnt[3] = 0;
+	for (const DepthTile &tile : tiles_)
+	{
+		if (tile.state == DEPTH_CLEAR) cnt[0]++;
+		else if (tile.state == DEPTH_PLANES) cnt[tile.cntPlane]++;
+		else cnt[3]++;
+	}
+}
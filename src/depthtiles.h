@@ -0,0 +1,85 @@
+#pragma once // 防止头文件被重复包含
+
+#include <cstdint>         // 包含uint64_t，采样点选择掩码
+#include <vector>          // 包含std::vector
+
+#include "gl.h"            // 包含Plane、RASTER_BLOCK和MAX_SAMPLES
+#include "jobs.h"          // 包含JobSystem类，并行解压
+
+const unsigned DEPTH_TILE_MAX_SAMPLES = 4;  // 能压缩的最大每像素采样数，超过时所有分块都按原始深度处理
+const unsigned DEPTH_MASK_WORDS = RASTER_BLOCK * RASTER_BLOCK * DEPTH_TILE_MAX_SAMPLES / 64; // 一个分块的采样点掩码占几个64位字
+
+// 深度平面：光栅化写入的深度是z/w的平面除以1/w的平面，两个平面方程就能精确表示一个三角形在分块内写入的所有深度
+struct DepthPlane
+{
+	float x0, y0;  // 平面方程的原点
+	Plane z, w;    // z/w和1/w
+};
+
+// evalDepth函数：深度平面在像素(x, y)中偏移为d的采样点处的深度，压缩路径写入、比较和解压都用它，
+// 计算方式与不压缩时rasterSpan写入的深度相同(像素左下角的值加上采样点的增量，见planeAt)，结果逐位相同
+inline float evalDepth(const DepthPlane &p, int x, int y, const float d[2])
+{
+	return (planeAt(p.z, p.x0, p.y0, x, y) + planeDelta(p.z, d)) / (planeAt(p.w, p.x0, p.y0, x, y) + planeDelta(p.w, d));
+}
+
+// 压缩分块的状态
+enum DepthTileState : unsigned char
+{
+	DEPTH_CLEAR,   // 快速清除：所有采样点都是清除值，原始深度没有写过
+	DEPTH_PLANES,  // 每个采样点的深度由1个或2个深度平面之一给出，原始深度没有写过
+	DEPTH_RAW      // 深度在原始深度缓冲区里
+};
+
+// 一个RASTER_BLOCK x RASTER_BLOCK像素分块的压缩深度
+struct DepthTile
+{
+	DepthTileState state;
+	unsigned char cntPlane;           // DEPTH_PLANES时的平面数，1或2
+	DepthPlane plane[2];
+	uint64_t select[DEPTH_MASK_WORDS]; // 第((y * RASTER_BLOCK + x) * cntSample + i)位为1表示该采样点用plane[1]
+};
+
+// DepthTiles类：深度缓冲区的分块压缩，与光栅化的块一一对应
+// 每个分块保存快速清除标记、1~2个深度平面或者标记深度在原始缓冲区中。大面积的平面(地板)在分块内
+// 只由一两个三角形覆盖，深度测试只需计算平面，完全不读写原始深度；平面放不下时才解压成原始深度。
+// 对调用者透明：triangle在压缩的分块上自动走平面路径，通道结束时resolve把仍然压缩的分块写回原始缓冲区，
+// 之后原始缓冲区与不压缩时逐位相同(evalDepth与光栅化写入深度的计算方式相同)
+// 分块之间互不影响，分块光栅化的各个作业写不同的分块，不需要加锁
+class DepthTiles {
+public:
+	// width, height为像素尺寸，d, cntSample为采样点偏移，必须与光栅化时的相同
+	DepthTiles(unsigned width, unsigned height, const float d[][2], unsigned cntSample);
+
+	// 是否启用压缩(每像素采样数不超过DEPTH_TILE_MAX_SAMPLES)
+	bool enabled() const { return cntSample_ <= DEPTH_TILE_MAX_SAMPLES; }
+
+	// 快速清除：只把所有分块标记为DEPTH_CLEAR，不写原始深度缓冲区
+	void clear();
+
+	// 把所有压缩的分块解压到原始深度缓冲区，按分块行并行；之后所有分块都是DEPTH_RAW
+	void resolve(JobSystem &jobs, float *zBuffer);
+
+	// 统计各状态的分块数：cnt[0]清除，cnt[1]一个平面，cnt[2]两个平面，cnt[3]原始
+	void count(unsigned cnt[4]) const;
+
+	DepthTile &tile(int bx, int by) { return tiles_[by * tilesX_ + bx]; }
+	const float *sample(unsigned i) const { return d_[i]; }  // 第i个采样点的偏移
+	unsigned cntSample() const { return cntSample_; }
+
+	// 分块中第bit个采样点(像素(x, y)的第i个采样点)当前的深度，分块不能是DEPTH_RAW
+	float depth(const DepthTile &tile, unsigned bit, int x, int y, unsigned i) const;
+
+	// 合并一次写入：pass中为1的采样点的深度换成plane，平面数超过2时解压到原始缓冲区
+	// bx, by为分块的像素坐标
+	void merge(DepthTile &tile, const uint64_t *pass, const DepthPlane &plane, float *zBuffer, int bx, int by) const;
+
+	// 把一个分块解压到原始缓冲区，pass/plane不为空时同时应用一次写入
+	void decompress(DepthTile &tile, float *zBuffer, int bx, int by, const uint64_t *pass = nullptr, const DepthPlane *plane = nullptr) const;
+
+private:
+	unsigned width_, height_, cntSample_;
+	int tilesX_, tilesY_;
+	float d_[MAX_SAMPLES][2];
+	std::vector<DepthTile> tiles_;
+};
@@ -0,0 +1,101 @@
+#pragma once // 防止头文件被重复包含
+
+#include <cmath>       // 包含std::sqrt, std::exp, std::pow, std::floor
+#include <cstdint>     // 包含uint32_t，浮点数的位模式
+#include <cstring>     // 包含memcpy，浮点数和整数之间按位转换
+
+#include "geometry.h"  // 包含向量模板
+
+// 着色用的数学函数：精确模式调用标准库，快速模式用近似实现
+// 编译时用-DFAST_MATH=1打开快速模式，默认是精确模式，输出与直接调用标准库完全相同
+// 近似实现只用加减乘、比较和整数位运算，没有分支和查表，编译器可以直接向量化
+// 下面各函数注释中的误差界由tests/fastmath_test.cpp在着色的输入范围内检查
+#ifndef FAST_MATH
+#define FAST_MATH 0
+#endif
+
+const bool FAST_MATH_ENABLED = FAST_MATH != 0;
+
+inline uint32_t floatBits(float f)
+{
+	uint32_t u;
+	std::memcpy(&u, &f, sizeof(u));
+	return u;
+}
+
+inline float bitsFloat(uint32_t u)
+{
+	float f;
+	std::memcpy(&f, &u, sizeof(f));
+	return f;
+}
+
+// rsqrtApprox函数：1/sqrt(x)，x > 0
+// 位模式给出初值(相对误差3.4%)，一次牛顿迭代y = y * (1.5 - 0.5 * x * y * y)后相对误差不超过1.8e-3，
+// 法线的长度误差在8位颜色中小于半个灰度级
+inline float rsqrtApprox(float x)
+{
+	float y = bitsFloat(0x5f375a86u - (floatBits(x) >> 1));
+	return y * (1.5f - 0.5f * x * y * y);
+}
+
+// exp2Approx函数：2^x
+// x = n + f，n为最近的整数，|f| <= 0.5，2^n直接拼出指数位，2^f = e^(f ln2)用5次泰勒多项式，
+// 截断误差不超过(0.347^6 / 720) = 2.4e-6，加上舍入实测相对误差不超过3.4e-6
+// x截断到[-126, 127]，超出范围时结果分别是2^-126和2^127附近的值而不是0和无穷大
+inline float exp2Approx(float x)
+{
+	x = x < -126.0f ? -126.0f : (x > 127.0f ? 127.0f : x);
+	float n = std::floor(x + 0.5f);
+	float t = (x - n) * 0.69314718f;  // f * ln2
+	float p = 1.0f + t * (1.0f + t * (1.0f / 2.0f + t * (1.0f / 6.0f + t * (1.0f / 24.0f + t * (1.0f / 120.0f)))));
+	return p * bitsFloat(uint32_t(int32_t(n) + 127) << 23);
+}
+
+// expApprox函数：e^x = 2^(x log2(e))，x乘log2(e)带来的额外相对误差约为|x| * 6e-8
+inline float expApprox(float x)
+{
+	return exp2Approx(x * 1.44269504f);
+}
+
+// powInt函数：整数次幂x^N，按二进制展开做O(log N)次乘法，两种模式都可以用
+// 每次乘法最多带来半个ulp的相对误差，x^N的相对误差不超过(N - 1)个ulp(x^32不超过3.7e-6)
+template<unsigned N>
+inline float powInt(float x)
+{
+	if constexpr (N == 0) return 1.0f;
+	else if constexpr (N == 1) return x;
+	else
+	{
+		float half = powInt<N / 2>(x);
+		return N % 2 ? half * half * x : half * half;
+	}
+}
+
+// mathExp函数：着色用的e^x
+inline float mathExp(float x)
+{
+	if constexpr (FAST_MATH_ENABLED) return expApprox(x);
+	else return std::exp(x);
+}
+
+// mathPow函数：着色用的x^N，N为编译期常量，x >= 0
+template<unsigned N>
+inline float mathPow(float x)
+{
+	if constexpr (FAST_MATH_ENABLED) return powInt<N>(x);
+	else return std::pow(x, float(N));
+}
+
+// mathNormalize函数：着色用的向量归一化，精确模式与vec::normalize()相同，快速模式用rsqrtApprox代替开方和除法
+template<size_t DIM>
+inline vec<DIM, float> mathNormalize(vec<DIM, float> v)
+{
+	if constexpr (FAST_MATH_ENABLED)
+	{
+		float len2 = 0.0f;
+		for (size_t i = 0; i < DIM; ++i) len2 += v[i] * v[i];
+		return v * rsqrtApprox(len2);
+	}
+	else return v.normalize();
+}
@@ -4,6 +4,10 @@
 #include <cassert>    // 包含断言库，用于程序调试
 
 #include "gl.h"       // 包含自定义的图形库头文件
+#include "depthtiles.h" // 包含DepthTiles类，压缩深度分块上的光栅化
+#include "simd.h"     // 包含SIMD_TARGET_PUSH和各指令集的向量包装，按运行时检测到的指令集选择核心
+
+const int MESHLETS_PER_JOB = 4; // 几何前端每个作业处理的网格簇数量
 
 // lookat函数：创建视图矩阵（View Matrix）
 // 参数：eye - 相机位置，center - 观察目标点，up - 上方向向量
@@ -90,98 +94,378 @@ Matrix viewport(unsigned width, unsigned height)
 
 
 
-// barycentric函数：计算点P在三角形ABC中的重心坐标
-// 参数：A,B,C为三角形三个顶点，P为待检测点
-// 返回：点P关于三角形ABC的重心坐标
-Vec3f barycentric(Vec2f A, Vec2f B, Vec2f C, Vec2f P)
+const int SETUP_BATCH = 16;  // 一批的三角形数，是各指令集向量宽度的公倍数
+
+// PrimitiveBatch结构：一批顶点着色后的三角形，按SoA排列(每个分量一行，每个三角形一列)，方便SIMD一次处理一整批
+// SIMD核心总是按整个向量读取，不满一批时也会读到count之后的列：这些列在作业开始时清零，之后是上一批留下的数据，
+// 都是确定的值，算出来的结果直接丢弃
+struct PrimitiveBatch
 {
-	Vec3f t[2];                           // 创建两个向量数组
-	for (int i = 0; i < 2; i++)           // 对x和y坐标分别处理
+	float x[3][SETUP_BATCH], y[3][SETUP_BATCH];     // 三个顶点的屏幕坐标
+	float z[3][SETUP_BATCH], w[3][SETUP_BATCH];     // 三个顶点的z/w和1/w
+	float varying[MAX_VARYINGS][3][SETUP_BATCH];    // 三个顶点的插值变量/w
+	int count = 0;                                  // 批中的三角形数
+
+	// 把一个图元转置进批的下一列
+	void add(const Primitive &prim, unsigned nvaryings)
 	{
-		t[i][0] = B[i] - A[i];            // 计算AB边的分量
-		t[i][1] = C[i] - A[i];            // 计算AC边的分量
-		t[i][2] = A[i] - P[i];            // 计算PA的分量
+		for (int v = 0; v < 3; ++v)
+		{
+			x[v][count] = prim.screenCoords[v].x;
+			y[v][count] = prim.screenCoords[v].y;
+			z[v][count] = prim.screenCoords[v].z;
+			w[v][count] = prim.screenCoords[v].w;
+			for (unsigned k = 0; k < nvaryings; ++k)
+				varying[k][v][count] = prim.varying[v][k];
+		}
+		count++;
 	}
-	Vec3f u = cross(t[0], t[1]);          // 计算叉乘，使用行列式求解线性方程组
+};
+
+// stampCoverage函数：包围盒能放进2x2或4x4印章的小三角形，预先算出印章内所有采样点的覆盖掩码
+// 返回是否选择了印章路径。掩码只有64位，印章的采样点总数(边长^2 * cntSample)不能超过64，
+// 因此4x4印章最多4个采样点，2x2印章最多16个；放不下时走通用路径
+// 重心坐标与通用路径一样用planeAt在像素左下角求值再加上采样点的planeDelta，运算顺序相同，结果逐位相同，
+// 内部判定也相同(三个都非负)，共享边上的采样点不会被两个三角形都占用或都漏掉
+static bool stampCoverage(TriangleSetup &setup, const float d[][2], unsigned cntSample)
+{
+	int w = setup.bboxmax.x - setup.bboxmin.x + 1, h = setup.bboxmax.y - setup.bboxmin.y + 1;
+	setup.stamp = 0;
+	if (w <= 2 && h <= 2 && 4 * cntSample <= 64) setup.stamp = 2;
+	else if (w <= 4 && h <= 4 && 16 * cntSample <= 64) setup.stamp = 4;
+	else return false;
+
+	setup.coverage = 0;
+	for (int py = 0; py < h; ++py)
+	{
+		for (int px = 0; px < w; ++px)
+		{
+			int bx = setup.bboxmin.x + px, by = setup.bboxmin.y + py;
+			for (unsigned i = 0; i < cntSample; ++i)
+			{
+				bool inside = true;
+				for (int j = 0; j < 3; ++j)
+				{
+					const Plane &e = setup.bar[j];
+					if (planeAt(e, setup.x0, setup.y0, bx, by) + planeDelta(e, d[i]) < 0) inside = false;
+				}
+				if (inside) setup.coverage |= uint64_t(1) << ((py * setup.stamp + px) * cntSample + i);
+			}
+		}
+	}
+	return true;
+}
 
-	if (fabs(u.z) < 1e-5) return Vec3f(-1.0f, 0.0f, 0.0f); // 如果u.z接近0，表示三角形退化或点不在平面上
-	return Vec3f(1.0f - (u.x + u.y) / u.z, u.x / u.z, u.y / u.z); // 返回规范化的重心坐标(1-α-β, α, β)
+// SetupLanes结构：SIMD核心对一整批三角形算出的结果，剔除和写回由标量代码完成
+struct SetupLanes
+{
+	float area2[SETUP_BATCH];                          // 有向面积的两倍
+	float xmin[SETUP_BATCH], xmax[SETUP_BATCH];        // 包围盒
+	float ymin[SETUP_BATCH], ymax[SETUP_BATCH];
+	TriangleSetup setups[SETUP_BATCH];                 // 填好了所有平面方程
+};
+
+// SampleDeltas结构：每个采样点相对像素左下角的偏移，对应到重心坐标、z/w、1/w上的增量，每个三角形算一次
+struct SampleDeltas
+{
+	float bar[MAX_SAMPLES][3], z[MAX_SAMPLES], w[MAX_SAMPLES];
+};
+
+// 几何和光栅化的核心：三角形设置(setupkernel.h)、矩阵变换(transformkernel.h)和光栅化(rasterkernel.h)
+// 在每个指令集的命名空间里各编译一次，运行时按指令集等级选出一组(见simdKernels)
+namespace gl_scalar {
+using namespace simd_scalar;
+#include "setupkernel.h"
+#include "transformkernel.h"
+#include "rasterkernel.h"
 }
 
-// triangle函数：三角形光栅化
-// 参数：screenCoords - 三角形三个顶点的屏幕坐标，shader - 着色器对象，
-//      colorBuffer - 颜色缓冲区，zBuffer - 深度缓冲区，
-//      width - 屏幕宽度，height - 屏幕高度，
-//      d - MSAA采样点偏移数组，cntSample - 每像素采样点数量
+#ifdef SIMD_X86
+SIMD_TARGET_PUSH("sse2")
+namespace gl_sse2 {
+using namespace simd_sse2;
+#include "setupkernel.h"
+#include "transformkernel.h"
+#include "rasterkernel.h"
+}
+SIMD_TARGET_POP
+
+SIMD_TARGET_PUSH("avx")
+namespace gl_avx {
+using namespace simd_avx;
+#include "setupkernel.h"
+#include "transformkernel.h"
+#include "rasterkernel.h"
+}
+SIMD_TARGET_POP
+
+SIMD_TARGET_PUSH("avx512f")
+namespace gl_avx512 {
+using namespace simd_avx512;
+#include "setupkernel.h"
+#include "transformkernel.h"
+#include "rasterkernel.h"
+}
+SIMD_TARGET_POP
+#endif
 
-//screenCoords 是一个包含3个顶点的数组，每个顶点是 Vec4f 类型（齐次坐标，形式为 (x, y, z, w)）
-//screenCoords[i] 表示第 i 个顶点的齐次坐标，其中 x, y, z 是屏幕坐标，w 是透视校正因子
-//screenCoords[i][j] 表示第 i 个顶点的第 j 个分量，其中 j=0 表示 x 坐标，j=1 表示 y 坐标，j=2 表示 z 坐标，j=3 表示 w 坐标
+// SetupKernel：一种指令集的三角形设置核心
+typedef void (*SetupKernel)(const PrimitiveBatch &batch, unsigned nvaryings, SetupLanes &out);
+// TransformKernel：一种指令集的矩阵变换核心，out[i] = m * in[i]
+typedef void (*TransformKernel)(const Matrix &m, const Vec4f *in, Vec4f *out, int n);
 
-void triangle(Vec4f *screenCoords, IShader &shader, Vec3f *colorBuffer, float *zBuffer, unsigned width, unsigned height, const float d[][2], unsigned cntSample)
+// SimdKernels结构：同一个指令集的一组核心
+struct SimdKernels
 {
+	SetupKernel setup;
+	TransformKernel transform;
+	TriangleKernel triangle;
+};
 
+// simdKernels函数：按指令集等级选出一组核心，没有编译进来的等级退回标量实现
+static const SimdKernels &simdKernels(SimdLevel level)
+{
+	static const SimdKernels scalar = { gl_scalar::computeSetup, gl_scalar::transformPoints, gl_scalar::triangle };
+#ifdef SIMD_X86
+	static const SimdKernels sse2 = { gl_sse2::computeSetup, gl_sse2::transformPoints, gl_sse2::triangle };
+	static const SimdKernels avx = { gl_avx::computeSetup, gl_avx::transformPoints, gl_avx::triangle };
+	static const SimdKernels avx512 = { gl_avx512::computeSetup, gl_avx512::transformPoints, gl_avx512::triangle };
+	switch (level)
+	{
+	case SIMD_AVX512: return avx512;
+	case SIMD_AVX: return avx;
+	case SIMD_SSE2: return sse2;
+	default: break;
+	}
+#endif
+	return scalar;
+}
+
+TriangleKernel triangleKernel(SimdLevel level)
+{
+	return simdKernels(level).triangle;
+}
 
-	// 计算三角形在屏幕上的最小包围盒
-	Vec2i bboxmin(width - 1, height - 1); // 初始化包围盒最右上点为屏幕最大坐标
-	Vec2i bboxmax(0.0f, 0.0f);            // 初始化包围盒最左下点为原点
+// setupBatch函数：批量三角形设置，同时完成图元设置阶段的剔除
+// 参数：kernel - 按指令集选出的SIMD核心，batch - 一批三角形，draw - 绘制参数(剔除模式、渲染目标尺寸和采样点)，
+//      nvaryings - 插值变量个数，bin - 通过剔除的三角形的设置结果追加到这里，count - 按SetupResult累加的统计
+// 有向面积、包围盒以及所有平面方程由SIMD核心一次算出整批(见setupkernel.h)，剔除判断和结果写回是逐个三角形的标量代码
+// 剔除的原因：
+//   背面：有向面积的符号与剔除模式不符。屏幕空间的面积同时考虑了透视，比变换面法线更准确
+//   退化：面积接近0
+//   不覆盖采样点：对每个采样点偏移(dx, dy)，包围盒内没有任何 x+dx、y+dy (x, y为屏幕内的整数)
+//     密集网格上大量细小三角形落在采样点之间，光栅化时一个采样点都不会写
+// 包围盒不超过2x2或4x4像素的小三角形在这里直接算出每个采样点的覆盖掩码(见stampCoverage)，
+// 掩码为空的同样按不覆盖采样点剔除；cntStamp累加走印章路径的三角形数
+static void setupBatch(SetupKernel kernel, const PrimitiveBatch &batch, const DrawCall &draw, unsigned nvaryings, std::pmr::vector<TriangleSetup> &bin, unsigned *count, unsigned &cntStamp)
+{
+	SetupLanes lanes;
+	kernel(batch, nvaryings, lanes);
+	const float *area2s = lanes.area2, *xmin = lanes.xmin, *xmax = lanes.xmax, *ymin = lanes.ymin, *ymax = lanes.ymax;
+	TriangleSetup *setups = lanes.setups;
 
-	for (int i = 0; i < 3; ++i)           // 遍历三角形的三个顶点
+	for (int l = 0; l < batch.count; ++l)
 	{
-		for (int j = 0; j < 2; ++j)       // 对x和y坐标分别处理
+		SetupResult result = SETUP_NO_SAMPLE;
+		if (fabs(area2s[l]) < 1e-5)
+			result = SETUP_DEGENERATE;
+		else if ((draw.cull == CULL_BACK && area2s[l] < 0.0f) || (draw.cull == CULL_FRONT && area2s[l] > 0.0f))
+			result = SETUP_BACKFACE;
+		else
 		{
-			bboxmin[j] = std::min(bboxmin[j], int(screenCoords[i][j])); // 更新包围盒最小坐标
-			bboxmax[j] = std::max(bboxmax[j], int(screenCoords[i][j])); // 更新包围盒最大坐标
+			// 先裁剪到屏幕上采样点可能出现的范围，再看每个采样点偏移下包围盒里有没有采样点
+			float x0 = std::max(xmin[l], 0.0f), y0 = std::max(ymin[l], 0.0f);
+			float x1 = std::min(xmax[l], float(draw.width)), y1 = std::min(ymax[l], float(draw.height));
+			for (unsigned i = 0; i < draw.cntSample && result != SETUP_ACCEPT; ++i)
+			{
+				float dx = draw.samples[i][0], dy = draw.samples[i][1];
+				if (std::ceil(x0 - dx) <= std::floor(x1 - dx) && std::ceil(y0 - dy) <= std::floor(y1 - dy)
+					&& std::ceil(x0 - dx) <= draw.width - 1 && std::ceil(y0 - dy) <= draw.height - 1)
+					result = SETUP_ACCEPT;
+			}
 		}
+
+		// 光栅化用的整数包围盒：取整是单调的，与先逐顶点取整再求最值相同
+		TriangleSetup &setup = setups[l];
+		if (result == SETUP_ACCEPT)
+		{
+			setup.bboxmin = Vec2i(std::max(0, int(xmin[l])), std::max(0, int(ymin[l])));
+			setup.bboxmax = Vec2i(std::min(int(draw.width - 1), int(xmax[l])), std::min(int(draw.height - 1), int(ymax[l])));
+			setup.x0 = batch.x[0][l];
+			setup.y0 = batch.y[0][l];
+			setup.nvaryings = nvaryings;
+			if (stampCoverage(setup, draw.samples, draw.cntSample) && setup.coverage == 0)
+				result = SETUP_NO_SAMPLE;
+		}
+		count[result]++;
+		if (result != SETUP_ACCEPT) continue;
+		if (setup.stamp) cntStamp++;
+		bin.push_back(setup);
 	}
-	// 将包围盒裁剪到屏幕范围内
-	bboxmin[0] = std::max(0, bboxmin[0]); // x坐标不小于0
-	bboxmin[1] = std::max(0, bboxmin[1]); // y坐标不小于0
-	bboxmax[0] = std::min(int(width - 1), bboxmax[0]);  // x坐标不大于屏幕最大宽度
-	bboxmax[1] = std::min(int(height - 1), bboxmax[1]); // y坐标不大于屏幕最大高度
+}
 
+// worldTriangle函数：第i个面的三个顶点从模型空间变换到世界空间，并计算几何法线，clipCoord不填写
+// transform为按指令集选出的矩阵变换核心，modelInverTranspose为模型矩阵的逆转置，用于变换法线
+// 三个顶点和三条切线(w为0)一起乘模型矩阵，三条法线一起乘逆转置
+static void worldTriangle(TransformKernel transform, const Model &model, int i, const Matrix &modelTrans, const Matrix &modelInverTranspose, Vertex *out)
+{
+	Vec4f points[6], normals[3];  // 前3个是顶点，后3个是切线
+	for (int j = 0; j < 3; j++)
+	{
+		points[j] = embed<4>(model.vert(i, j));
+		points[3 + j] = Vec4f(proj<3>(model.tangent(i, j)), 0.0f);  // 加载时预计算的切线，随模型矩阵变换，手性不变
+		normals[j] = Vec4f(model.normal(i, j), 0.0f);
+	}
+	transform(modelTrans, points, points, 6);
+	transform(modelInverTranspose, normals, normals, 3);
+	for (int j = 0; j < 3; j++)
+		out[j] = Vertex(points[j], Vec4f(), model.uv(i, j), proj<3>(normals[j]), Vec4f(proj<3>(points[3 + j]), model.tangent(i, j).w));
+	// 几何法线：世界空间中两条边的叉积，裁剪产生的顶点沿用它
+	Vec3f faceNormal = cross(proj<3>(out[1].worldCoord - out[0].worldCoord), proj<3>(out[2].worldCoord - out[0].worldCoord));
+	for (int j = 0; j < 3; j++) out[j].faceNormal = faceNormal;
+}
 
-	// 三角形光栅化过程 
-	//proj<2>：从齐次坐标中提取前2个分量（x, y），丢弃其他分量
+// worldStage函数：并行完成meshlets中所有面的模型空间 -> 世界空间变换，结果写入world
+// 多视图渲染时每个模型调用一次，之后各视图的geometryStage通过DrawCall::world共用结果
+void worldStage(JobSystem &jobs, const Model &model, Matrix modelTrans, const std::pmr::vector<int> &meshlets, WorldGeometry &world)
+{
+	Matrix modelInverTranspose = modelTrans.invert_transpose();
+	TransformKernel transform = simdKernels(activeSimdLevel()).transform;
+	world.corners.resize(size_t(model.nfaces()) * 3);
+	jobs.parallelFor(0, int(meshlets.size()), MESHLETS_PER_JOB, [&](int begin, int end)
+	{
+		for (int c = begin; c < end; ++c)
+		{
+			const Meshlet &meshlet = model.meshlet(meshlets[c]);
+			for (int i = meshlet.firstFace; i < meshlet.firstFace + meshlet.nfaces; ++i)
+				worldTriangle(transform, model, i, modelTrans, modelInverTranspose, &world.corners[size_t(i) * 3]);
+		}
+	});
+}
 
-	Vec2f A = proj<2>(screenCoords[0]), B = proj<2>(screenCoords[1]), C = proj<2>(screenCoords[2]); // 提取三角形顶点的2D坐标
-	
-	for (int x = bboxmin.x; x <= bboxmax.x; ++x) // 遍历包围盒中的每个像素的x坐标
+// frustumVisible函数：模型空间的包围盒经过PVM(投影 * 视图 * 模型矩阵)变换后是否可能在视锥内
+// 8个角点都在同一个裁剪平面外侧时剔除，结果是保守的。可见区域的w为负，x/w <= 1等价于x - w >= 0，x/w >= -1等价于-x - w >= 0
+bool frustumVisible(const Vec3f &bmin, const Vec3f &bmax, const Matrix &PVM)
+{
+	unsigned outside[6] = {};  // 在每个裁剪平面外侧的角点数
+	for (int c = 0; c < 8; ++c)
 	{
-		for (int y = bboxmin.y; y <= bboxmax.y; ++y) // 遍历包围盒中的每个像素的y坐标
+		Vec4f clip = PVM * Vec4f(c & 1 ? bmax.x : bmin.x, c & 2 ? bmax.y : bmin.y, c & 4 ? bmax.z : bmin.z, 1.0f);
+		for (int axis = 0; axis < 3; ++axis)
 		{
-			// 计算每个像素的多个采样点的颜色和深度
-			Vec3f barMiddle, color;        // barMiddle存储像素中心点的重心坐标，color存储颜色
-			bool covered = false;          // 标记该像素是否被三角形覆盖
+			outside[2 * axis] += clip[axis] - clip.w < 0.0f;
+			outside[2 * axis + 1] += -clip[axis] - clip.w < 0.0f;
+		}
+	}
+	for (int i = 0; i < 6; ++i)
+		if (outside[i] == 8) return false;
+	return true;
+}
 
-			for (int i = 0; i < cntSample; ++i) // 遍历每个采样点
+// geometryStage函数：几何前端，并行完成顶点变换、z裁剪、顶点着色和图元设置(剔除)，生成图元
+// 参数：jobs - 作业调度器，draw - 绘制参数，meshlets - 需要处理的网格簇索引(已经过遮挡剔除)，
+//      bins - 输出，bins[c]是第c个网格簇生成的图元，所有临时内存都来自bins的内存资源，
+//      stats - 不为空时累加图元设置阶段的统计
+// 每个作业处理若干个网格簇，结果写进各自网格簇对应的bin，光栅化时按bin的顺序消费，
+// 因此图元的提交顺序与串行处理时完全一致
+void geometryStage(JobSystem &jobs, const DrawCall &draw, const std::pmr::vector<int> &meshlets, PrimitiveBins &bins, SetupStats *stats)
+{
+	const Model &model = *draw.model;
+	const IShader &shader = *draw.shader;
+	Matrix modelTrans = draw.modelTrans;
+	Matrix modelInverTranspose = modelTrans.invert_transpose();  // 模型矩阵的逆转置，用于变换法线
+	unsigned nvaryings = shader.nvaryings();
+	const SimdKernels &kernels = simdKernels(activeSimdLevel());  // 每次绘制选一次，之后所有作业共用
+
+	std::pmr::memory_resource *arena = bins.get_allocator().resource();
+	bins.clear();
+	bins.resize(meshlets.size());  // 内层的bin沿用bins的内存资源
+	jobs.parallelFor(0, int(meshlets.size()), MESHLETS_PER_JOB, [&](int begin, int end)
+	{
+		VertexList original(arena), clipped(arena);  // 每个作业自己的顶点列表，避免线程间共享
+		original.reserve(3);
+		clipped.reserve(8);
+		unsigned count[SETUP_RESULT_COUNT] = {};     // 本作业的图元设置统计，最后一次性累加
+		unsigned cntStamp = 0;
+		PrimitiveBatch batch{};                       // 等待设置的一批三角形，值初始化，第一批不满时核心读到的多余列也是0
+		for (int c = begin; c < end; ++c)
+		{
+			const Meshlet &meshlet = model.meshlet(meshlets[c]);
+			std::pmr::vector<TriangleSetup> &bin = bins[c];
+			bin.reserve(meshlet.nfaces);
+			for (int i = meshlet.firstFace; i < meshlet.firstFace + meshlet.nfaces; ++i)
 			{
-				//d[i][0]和d[i][1]是MSAA采样点相对于像素中心的偏移量，用于在每个像素内进行多重采样
-				
-				Vec2f sample(x + d[i][0], y + d[i][1]); 
-				Vec3f barSample = barycentric(A, B, C, sample); // 计算采样点的重心坐标
-
-				float w = screenCoords[0].w * barSample.x + screenCoords[1].w * barSample.y + screenCoords[2].w * barSample.z; // 计算w分量插值
-				w = 1.0f / w;              // 透视校正插值的权重因子
-				float z = screenCoords[0].z * barSample.x + screenCoords[1].z * barSample.y + screenCoords[2].z * barSample.z; // 计算z分量插值
-				z = z * w;                 // 应用透视校正
-				
-				unsigned idx = cntSample * (y*width + x) + i; // 计算采样点在缓冲区中的索引, 索引是像素的索引乘以采样点数加上采样点索引
-				
-				if (barSample.x < 0 || barSample.y < 0 || barSample.z < 0 || z < zBuffer[idx]) continue; // 如果采样点不在三角形内部或被遮挡，跳过
-
-				if (!covered) // 如果这是该像素第一次被覆盖，计算颜色
+				// 顶点变换：模型空间 -> 世界空间(已由worldStage算好时直接读取) -> 裁剪空间
+				Vertex corners[3];
+				if (draw.world)
+					std::copy_n(&draw.world->corners[size_t(i) * 3], 3, corners);
+				else
+					worldTriangle(kernels.transform, model, i, modelTrans, modelInverTranspose, corners);
+				Vec4f clipCoord[3] = { corners[0].worldCoord, corners[1].worldCoord, corners[2].worldCoord };
+				kernels.transform(draw.PV, clipCoord, clipCoord, 3);
+				original.clear();
+				for (int j = 0; j < 3; j++)
 				{
-					barMiddle = barycentric(A, B, C, Vec2f(x + 0.5f, y + 0.5f)); // 计算像素中心点的重心坐标
-					if (!shader.fragment(barMiddle, color)) break; // 调用片段着色器计算颜色，若返回false则跳过该像素
-					covered = true;        // 标记该像素已被覆盖
+					corners[j].clipCoord = clipCoord[j];
+					original.push_back(corners[j]);
 				}
 
-				colorBuffer[idx] = color;  // 将颜色写入颜色缓冲区
-				zBuffer[idx] = z;          // 将深度写入深度缓冲区
+				// z轴裁剪：去除远近平面外的部分，裁剪后少于3个顶点则无法形成三角形
+				if (draw.clip)
+				{
+					clipped.clear();
+					homogeneousClip(original, clipped, 2);
+				}
+				const VertexList &polygon = draw.clip ? clipped : original;
+				if (polygon.size() < 3) continue;
+
+				// 顶点着色：裁剪后的多边形按扇形拆成三角形
+				for (size_t j = 1; j + 1 < polygon.size(); ++j)
+				{
+					Primitive prim;
+					prim.screenCoords[0] = shader.vertex(polygon[0], prim.varying[0]);
+					prim.screenCoords[1] = shader.vertex(polygon[j], prim.varying[1]);
+					prim.screenCoords[2] = shader.vertex(polygon[j + 1], prim.varying[2]);
+					// 攒够一批再做三角形设置，背面、退化、不覆盖采样点的三角形在设置时统一剔除
+					batch.add(prim, nvaryings);
+					if (batch.count == SETUP_BATCH)
+					{
+						setupBatch(kernels.setup, batch, draw, nvaryings, bin, count, cntStamp);
+						batch.count = 0;
+					}
+				}
+			}
+			// 网格簇结束时处理不满一批的三角形，保证每个bin只包含自己网格簇的三角形
+			if (batch.count > 0)
+			{
+				setupBatch(kernels.setup, batch, draw, nvaryings, bin, count, cntStamp);
+				batch.count = 0;
 			}
 		}
+		if (stats)
+		{
+			for (int r = 0; r < SETUP_RESULT_COUNT; ++r) stats->count[r] += count[r];
+			stats->cntStamp += cntStamp;
+		}
+	});
+}
+
+// barycentric函数：计算点P在三角形ABC中的重心坐标
+// 参数：A,B,C为三角形三个顶点，P为待检测点
+// 返回：点P关于三角形ABC的重心坐标
+Vec3f barycentric(Vec2f A, Vec2f B, Vec2f C, Vec2f P)
+{
+	Vec3f t[2];                           // 创建两个向量数组
+	for (int i = 0; i < 2; i++)           // 对x和y坐标分别处理
+	{
+		t[i][0] = B[i] - A[i];            // 计算AB边的分量
+		t[i][1] = C[i] - A[i];            // 计算AC边的分量
+		t[i][2] = A[i] - P[i];            // 计算PA的分量
 	}
+	Vec3f u = cross(t[0], t[1]);          // 计算叉乘，使用行列式求解线性方程组
+
+	if (fabs(u.z) < 1e-5) return Vec3f(-1.0f, 0.0f, 0.0f); // 如果u.z接近0，表示三角形退化或点不在平面上
+	return Vec3f(1.0f - (u.x + u.y) / u.z, u.x / u.z, u.y / u.z); // 返回规范化的重心坐标(1-α-β, α, β)
 }
 
 
@@ -191,24 +475,28 @@ void triangle(Vec4f *screenCoords, IShader &shader, Vec3f *colorBuffer, float *z
 
 
 
+
+
 // singleFaceZClip函数：对多边形进行单一平面的裁剪
 // 参数：original - 原始顶点列表，result - 裁剪后的顶点列表，axis - 裁剪的坐标轴索引
 //顶点列表是模型的所有顶点坐标的集合
 
-void singleFaceZClip(const std::vector<Vertex> &original, std::vector<Vertex> &result, unsigned axis)
+void singleFaceZClip(const VertexList &original, VertexList &result, unsigned axis)
 {
 	for (unsigned i = 0; i < original.size(); ++i) // 遍历原始多边形的所有边
 	{
 		Vertex now = original[i], next = original[(i + 1) % original.size()]; // 获取当前边的两个端点
 
-		float checkNow = now.clipCoord[axis] / now.clipCoord.w, checkNext = next.clipCoord[axis] / next.clipCoord.w; // 计算端点在裁剪坐标系中的位置
+		// 端点到裁剪平面的有向距离：可见区域的w为负(projection的n、f为负)，z/w <= 1等价于z - w >= 0
+		// 不能先除以w再比较：相机后方的点w为正，z/w会落在[-1, 1]附近，被误判为在平面内侧
+		float checkNow = now.clipCoord[axis] - now.clipCoord.w, checkNext = next.clipCoord[axis] - next.clipCoord.w;
 		
-		if (checkNow <= 1.0f)             // 如果当前顶点在裁剪平面内部或平面上
+		if (checkNow >= 0.0f)             // 如果当前顶点在裁剪平面内部或平面上
 		{
 			result.push_back(now);         // 将当前顶点添加到结果列表
 		}
 		
-		if ((checkNow < 1.0f && checkNext > 1.0f) || (checkNow > 1.0f && checkNext < 1.0f)) // 如果当前边与裁剪平面相交
+		if ((checkNow > 0.0f && checkNext < 0.0f) || (checkNow < 0.0f && checkNext > 0.0f)) // 如果当前边与裁剪平面相交
 		{
 			pushIntersection(result, now, next, axis); // 计算交点并添加到结果列表
 		}
@@ -218,34 +506,36 @@ void singleFaceZClip(const std::vector<Vertex> &original, std::vector<Vertex> &r
 
 // pushIntersection函数：计算边与裁剪平面的交点并添加到结果列表
 // 参数：result - 结果顶点列表，now/next - 边的两个端点，axis - 裁剪的坐标轴索引
-void pushIntersection(std::vector<Vertex> &result, Vertex now, Vertex next, unsigned axis)
+void pushIntersection(VertexList &result, Vertex now, Vertex next, unsigned axis)
 {
 	// 计算参数t，使得 w0 + t*(w1-w0) = z0 + t*(z1-z0)
 	float t0 = now.clipCoord.w - now.clipCoord[axis];  // t0 = w0 - z0
 	float t1 = next.clipCoord.w - next.clipCoord[axis]; // t1 = w1 - z1
 	float t = t0 / (t0 - t1);             // 计算交点的插值参数t
 
-	float w = 1.0f / now.clipCoord.w + t * (1.0f / next.clipCoord.w - 1.0f / now.clipCoord.w); // 计算交点的透视校正权重
-	w = 1.0f / w;                         // 取倒数得到w
-
-	// 计算交点
+	// 计算交点：裁剪空间是世界空间的线性变换(齐次坐标)，交点的所有属性都按同一个t线性插值，
+	// 透视校正发生在之后的透视除法和光栅化中，这里不能再乘w
 	Vertex inter;                          // 创建交点顶点
 	inter.clipCoord = now.clipCoord + (next.clipCoord - now.clipCoord) * t; // 计算交点的裁剪坐标
 	inter.worldCoord = now.worldCoord + (next.worldCoord - now.worldCoord) * t; // 计算交点的世界坐标
-	inter.worldCoord = inter.worldCoord * w; // 应用透视校正
 	inter.normal = now.normal + (next.normal - now.normal) * t; // 计算交点的法线
-	inter.normal = inter.normal * w;      // 应用透视校正
 	inter.uv = now.uv + (next.uv - now.uv) * t; // 计算交点的纹理坐标
-	inter.uv = inter.uv * w;              // 应用透视校正
+	Vec3f tangent = proj<3>(now.tangent) + (proj<3>(next.tangent) - proj<3>(now.tangent)) * t; // 计算交点的切线
+	inter.tangent = Vec4f(tangent, now.tangent.w); // 手性沿用端点的值
+	inter.faceNormal = now.faceNormal;    // 几何法线在三角形内不变
 	result.push_back(inter);              // 将交点添加到结果列表
 }
 
 
 // homogeneousClip函数：对多边形进行齐次裁剪, 也就是对齐次坐标进行裁剪, 裁剪的坐标轴索引是axis, 裁剪的平面是w+axis和w-axis
 // 参数：original - 原始顶点列表，result - 裁剪后的顶点列表，axis - 裁剪的坐标轴索引
-void homogeneousClip(const std::vector<Vertex> &original, std::vector<Vertex> &result, unsigned axis)
+void homogeneousClip(const VertexList &original, VertexList &result, unsigned axis)
 {
-	std::vector<Vertex> intermediate;     // 创建中间顶点列表
+	// 中间顶点列表放在栈上的缓冲区里，每个平面最多多出一个顶点，三角形裁剪不会超出缓冲区
+	alignas(Vertex) char stack[8 * sizeof(Vertex)];
+	std::pmr::monotonic_buffer_resource local(stack, sizeof(stack), result.get_allocator().resource());
+	VertexList intermediate(&local);      // 创建中间顶点列表
+	intermediate.reserve(original.size() + 1);
 
 	// 第一次裁剪：处理正方向平面（如右裁剪平面 x ≤ w）// 对w+axis平面进行裁剪
 	singleFaceZClip(original, intermediate, axis); 
@@ -1,33 +1,152 @@
 #pragma once
 
 #include <vector>
+#include <memory_resource>
+#include <atomic>
+#include <cstdint>
 
 #include "geometry.h"
 #include "tgaimage.h"
 #include "model.h"
-
-// interface for shader struct
-//这个是shader的接口，定义了顶点着色器和片段着色器
-struct IShader
-{
-	virtual Vec4f vertex(unsigned nthvert, Vec4f worldCoord, Vec2f uv, Vec3f normal) = 0;
-	//顶点着色器，输入参数是顶点索引，顶点在世界坐标系中的坐标，顶点的纹理坐标，顶点的法线，输出参数是顶点在裁剪坐标系中的坐标
-	virtual bool fragment(Vec3f bar, Vec3f &color) = 0; //片段着色器，输入参数是重心坐标，输出参数是颜色
-};
+#include "jobs.h"
+#include "cpu.h"
 
 // struct for clipping parameter
 //这个是顶点结构体，定义了顶点着色器和片段着色器的输入参数
 //worldCoord是顶点在世界坐标系中的坐标，clipCoord是顶点在裁剪坐标系中的坐标，uv是顶点的纹理坐标，normal是顶点的法线
+//tangent是顶点的切线，w分量为副切线的手性(+1或-1)
 struct Vertex
 {
 	Vec3f normal;
 	Vec4f worldCoord, clipCoord;
 	Vec2f uv;
+	Vec4f tangent;
+	Vec3f faceNormal;  // 所在三角形的几何法线(世界空间，未归一化)，三个顶点相同，用于平面着色
 
-	Vertex(Vec4f worldCoord = Vec4f(), Vec4f clipCoord = Vec4f(), Vec2f uv = Vec2f(), Vec3f normal = Vec3f())
-		: worldCoord(worldCoord), clipCoord(clipCoord), uv(uv), normal(normal) {}
+	Vertex(Vec4f worldCoord = Vec4f(), Vec4f clipCoord = Vec4f(), Vec2f uv = Vec2f(), Vec3f normal = Vec3f(), Vec4f tangent = Vec4f())
+		: worldCoord(worldCoord), clipCoord(clipCoord), uv(uv), normal(normal), tangent(tangent) {}
 };
 
+// 每个顶点最多能向片段着色器传递的插值变量(varying)个数，以float为单位
+const unsigned MAX_VARYINGS = 16;
+// 每个像素最多的采样点数(MSAA)
+const unsigned MAX_SAMPLES = 16;
+// 分层光栅化的块大小(像素)，块按屏幕坐标对齐，必须是2的幂
+const int RASTER_BLOCK = 8;
+
+// interface for shader struct
+//这个是shader的接口，定义了顶点着色器和片段着色器
+//着色器只读取uniform变量，插值变量由图元携带，所以同一个着色器可以被多个线程同时使用
+struct IShader
+{
+	virtual unsigned nvaryings() const = 0; //着色器使用的插值变量个数 (不超过MAX_VARYINGS)
+	virtual Vec4f vertex(const Vertex &in, float *varying) const = 0;
+	//顶点着色器，输入参数是顶点属性，插值变量写入varying(已除以w，用于透视校正)，输出参数是顶点的屏幕坐标(x, y, z/w, 1/w)
+	virtual bool fragment(const float *varying, Vec3f &color) const = 0; //片段着色器，输入参数是透视校正后的插值变量，输出参数是颜色
+};
+
+// 图元：顶点着色之后的三角形，包含三个顶点的屏幕坐标和插值变量
+// 几何前端并行生成图元，批量完成三角形设置之后交给光栅化阶段按提交顺序消费
+struct Primitive
+{
+	Vec4f screenCoords[3];            // 三个顶点的屏幕坐标
+	float varying[3][MAX_VARYINGS];   // 三个顶点的插值变量
+};
+
+// 平面方程：屏幕空间中线性变化的量 q(x, y) = q0 + dqdx * (x - x0) + dqdy * (y - y0)，(x0, y0)为三角形第一个顶点
+struct Plane
+{
+	float q0, dqdx, dqdy;
+};
+
+// 平面在像素(x, y)左下角的值；采样点上的值是它加上planeDelta，像素中心的值用planeAtCenter
+// 所有光栅化路径(逐行、印章、压缩的深度分块)和深度压缩的求值、解压都这样逐像素求值而不沿扫描线累加，
+// 同一个采样点的覆盖、深度和插值变量只取决于平面本身，与从哪个像素开始遍历无关，压缩与否结果逐位相同
+inline float planeAt(const Plane &p, float x0, float y0, int x, int y)
+{
+	return p.q0 + p.dqdx * (x - x0) + p.dqdy * (y - y0);
+}
+
+inline float planeAtCenter(const Plane &p, float x0, float y0, int x, int y)
+{
+	return p.q0 + p.dqdx * (x + 0.5f - x0) + p.dqdy * (y + 0.5f - y0);
+}
+
+// 采样点相对像素左下角的偏移d对应的平面增量
+inline float planeDelta(const Plane &p, const float d[2])
+{
+	return p.dqdx * d[0] + p.dqdy * d[1];
+}
+
+// 三角形设置(setup)的结果：光栅化需要的所有量都表示成平面方程，逐像素直接求值(见planeAt)
+struct TriangleSetup
+{
+	Vec2i bboxmin, bboxmax;           // 屏幕包围盒(已裁剪到屏幕范围)
+	float x0, y0;                     // 平面方程的原点
+	Plane bar[3];                     // 三个重心坐标，全部非负时采样点在三角形内部
+	Plane z;                          // z/w
+	Plane w;                          // 1/w
+	Plane varying[MAX_VARYINGS];      // 插值变量/w
+	unsigned nvaryings;               // 插值变量个数
+	unsigned stamp;                   // 小三角形的印章(stamp)边长：0表示走通用路径，否则为2或4
+	uint64_t coverage;                // 印章的覆盖掩码，以bboxmin为原点，第(py * stamp + px) * cntSample + i位表示像素(px, py)的第i个采样点在三角形内
+};
+
+// 背面剔除模式，正面为屏幕空间中逆时针(有向面积为正)的三角形
+enum CullMode { CULL_NONE, CULL_BACK, CULL_FRONT };
+
+// 模型空间的顶点处理结果：世界坐标、法线、切线和几何法线，与相机无关
+// 同一个模型从多个视角渲染时只由worldStage计算一次，各视图的几何阶段只需再乘上自己的投影 * 视图矩阵
+// 第i个面的第j个顶点在corners[3 * i + j]，clipCoord不填写；只有传给worldStage的网格簇的面是有效的
+struct WorldGeometry
+{
+	std::pmr::vector<Vertex> corners;
+
+	explicit WorldGeometry(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) : corners(resource) {}
+};
+
+// 一次绘制的输入：模型、变换矩阵、着色器和前端的开关
+struct DrawCall
+{
+	const Model *model;     // 模型数据
+	const IShader *shader;  // 顶点/片段着色器
+	Matrix modelTrans;      // 模型矩阵
+	Matrix PV;              // 投影 * 视图矩阵，用于裁剪
+	CullMode cull;          // 背面剔除模式
+	bool clip;              // 是否做z平面裁剪
+	unsigned width, height; // 渲染目标尺寸，用于剔除不覆盖任何采样点的三角形
+	const float (*samples)[2]; // 每个像素的采样点偏移，与传给triangle的相同
+	unsigned cntSample;     // 每个像素的采样点数
+	const WorldGeometry *world = nullptr; // 不为空时顶点的世界空间属性直接从这里读取，不再用modelTrans变换
+};
+
+// 图元设置阶段的结果：保留，或者被剔除的原因
+enum SetupResult { SETUP_ACCEPT, SETUP_BACKFACE, SETUP_DEGENERATE, SETUP_NO_SAMPLE, SETUP_RESULT_COUNT };
+
+// 图元设置阶段的统计，每种结果的图元数
+struct SetupStats
+{
+	std::atomic<unsigned> count[SETUP_RESULT_COUNT];
+	std::atomic<unsigned> cntStamp;   // 通过剔除的三角形中走小三角形印章路径的数量
+	SetupStats() : cntStamp(0) { for (auto &c : count) c = 0; }
+};
+
+// 渲染管线中的临时数据都用std::pmr容器，内存来自每帧的FrameArena，帧结束时整体回收
+typedef std::pmr::vector<Vertex> VertexList;                   // 裁剪用的顶点列表
+typedef std::pmr::vector<std::pmr::vector<TriangleSetup>> PrimitiveBins; // bins[c]是第c个网格簇生成的三角形(已完成设置)
+
+// 从插值变量数组中读取/写入一个向量
+template<size_t DIM> vec<DIM, float> loadVarying(const float *varying)
+{
+	vec<DIM, float> ret;
+	for (size_t i = DIM; i--; ret[i] = varying[i]);
+	return ret;
+}
+template<size_t DIM> void storeVarying(float *varying, const vec<DIM, float> &v)
+{
+	for (size_t i = DIM; i--; varying[i] = v[i]);
+}
+
 // functions for viewing transformation
 Matrix lookat(Vec3f eye, Vec3f center, Vec3f up);
 Matrix projection(double fov, double ratio, double n, double f);
@@ -35,11 +154,20 @@ Matrix perspective(double n, double f);
 Matrix ortho(float l, float r, float b, float t, float n, float f);
 Matrix viewport(unsigned width, unsigned height);
 
+// functions for geometry processing
+void worldStage(JobSystem &jobs, const Model &model, Matrix modelTrans, const std::pmr::vector<int> &meshlets, WorldGeometry &world);
+void geometryStage(JobSystem &jobs, const DrawCall &draw, const std::pmr::vector<int> &meshlets, PrimitiveBins &bins, SetupStats *stats = nullptr);
+bool frustumVisible(const Vec3f &bmin, const Vec3f &bmax, const Matrix &PVM);
+
 // functions for rasterization
 Vec3f barycentric(Vec2f A, Vec2f B, Vec2f C, Vec2f P);
-void triangle(Vec4f *screenCoords, IShader &shader, Vec3f *colorBuffer, float *zBuffer, unsigned width, unsigned height, const float d[][2], unsigned cntSample);
+class DepthTiles;
+// 三角形光栅化的核心(见rasterkernel.h)，每个指令集编译一份，triangleKernel按等级选出，每次光栅化一批三角形之前选一次
+typedef void (*TriangleKernel)(const TriangleSetup &setup, const IShader &shader, Vec3f *colorBuffer, float *zBuffer, unsigned width, const float d[][2], unsigned cntSample,
+	Vec2i rectMin, Vec2i rectMax, DepthTiles *depthTiles);
+TriangleKernel triangleKernel(SimdLevel level);
 
 // functions for clipping
-void homogeneousClip(const std::vector<Vertex> &original, std::vector<Vertex> &result, unsigned axis);
-void singleFaceZClip(const std::vector<Vertex> &original, std::vector<Vertex> &result, unsigned axis);
-void pushIntersection(std::vector<Vertex> &result, Vertex now, Vertex next, unsigned axis);
+void homogeneousClip(const VertexList &original, VertexList &result, unsigned axis);
+void singleFaceZClip(const VertexList &original, VertexList &result, unsigned axis);
+void pushIntersection(VertexList &result, Vertex now, Vertex next, unsigned axis);
@@ -0,0 +1,201 @@
+#include <algorithm> // 包含std::min, std::max
+
+#include "jobs.h" // 包含JobSystem类的声明
+
+const std::size_t INITIAL_QUEUE_SIZE = 256; // 每个作业队列的初始容量
+
+// 每个线程记录自己属于哪个调度器以及在其中的编号
+// 不属于当前调度器的线程(例如主线程)统一使用0号队列
+static thread_local const JobSystem *tlsOwner = nullptr;
+static thread_local unsigned tlsIndex = 0;
+
+// 构造函数：创建队列并启动工作线程
+JobSystem::JobSystem(unsigned cntWorker) : queued_(0), stop_(false)
+{
+	if (cntWorker == 0)
+	{
+		unsigned hw = std::thread::hardware_concurrency();
+		cntWorker = hw > 1 ? hw - 1 : 0; // 主线程也会在wait中执行作业，所以少开一个
+	}
+	for (unsigned i = 0; i <= cntWorker; ++i)
+	{
+		queues_.emplace_back(new WorkQueue());
+		queues_.back()->ring.resize(INITIAL_QUEUE_SIZE); // 预先分配，一般的负载不需要再扩容
+	}
+	for (unsigned i = 1; i <= cntWorker; ++i)
+		workers_.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+// 析构函数：通知所有工作线程退出并等待它们结束
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex_);
+		stop_ = true;
+	}
+	wake_.notify_all();
+	for (auto &worker : workers_)
+		worker.join();
+}
+
+// threadIndex函数：返回当前线程的队列编号
+unsigned JobSystem::threadIndex() const
+{
+	return tlsOwner == this ? tlsIndex : 0;
+}
+
+// pushBack函数：压入队尾，满了就按原顺序搬到容量翻倍的新缓冲区
+void JobSystem::WorkQueue::pushBack(JobTask task)
+{
+	if (count == ring.size())
+	{
+		std::vector<JobTask> grown(std::max<std::size_t>(INITIAL_QUEUE_SIZE, ring.size() * 2));
+		for (std::size_t i = 0; i < count; ++i)
+			grown[i] = std::move(ring[(head + i) % ring.size()]);
+		ring.swap(grown);
+		head = 0;
+	}
+	ring[(head + count) % ring.size()] = std::move(task);
+	count++;
+}
+
+// popBack函数：从队尾取出一个作业，队列为空时返回false
+bool JobSystem::WorkQueue::popBack(JobTask &task)
+{
+	if (count == 0) return false;
+	count--;
+	task = std::move(ring[(head + count) % ring.size()]);
+	return true;
+}
+
+// popFront函数：从队头取出一个作业，队列为空时返回false
+bool JobSystem::WorkQueue::popFront(JobTask &task)
+{
+	if (count == 0) return false;
+	task = std::move(ring[head]);
+	head = (head + 1) % ring.size();
+	count--;
+	return true;
+}
+
+// push函数：把作业压入当前线程自己的队列尾部
+void JobSystem::push(JobTask task)
+{
+	WorkQueue &queue = *queues_[threadIndex()];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.pushBack(std::move(task));
+	}
+	queued_.fetch_add(1, std::memory_order_release);
+	// 先拿一下sleepMutex_再通知，保证不会有线程在"检查完条件、还没睡下"时错过这次唤醒
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex_);
+	}
+	wake_.notify_one();
+}
+
+// submit函数：作业和计数器一起放进队列，执行完毕后由runOne递减计数
+void JobSystem::submit(Job job, JobCounter *counter)
+{
+	if (counter) counter->pending_.fetch_add(1, std::memory_order_relaxed);
+	push(JobTask{ std::move(job), counter });
+}
+
+// submitAfter函数：依赖还没完成时先挂在依赖的计数器上，归零时由finish负责提交
+void JobSystem::submitAfter(JobCounter &dependency, Job job, JobCounter *counter)
+{
+	if (counter) counter->pending_.fetch_add(1, std::memory_order_relaxed);
+	JobTask wrapped{ std::move(job), counter };
+	{
+		std::lock_guard<std::mutex> lock(dependency.mutex_);
+		if (!dependency.done())
+		{
+			dependency.continuations_.push_back(std::move(wrapped));
+			return;
+		}
+	}
+	push(std::move(wrapped)); // 依赖已经完成，直接提交
+}
+
+// finish函数：计数减一，最后一个完成的作业负责把后续作业放进队列
+// 递减在锁内进行：wait看到计数归零后还会再拿一次这把锁，保证返回时finish已经不再访问counter，
+// 这样调用者在wait返回后立即销毁counter(例如栈上的局部变量)也是安全的
+void JobSystem::finish(JobCounter *counter)
+{
+	if (!counter) return;
+	std::vector<JobTask> continuations;
+	{
+		std::lock_guard<std::mutex> lock(counter->mutex_);
+		if (counter->pending_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			continuations.swap(counter->continuations_);
+	}
+	for (auto &task : continuations)
+		push(std::move(task));
+}
+
+// runOne函数：先从自己队列尾部取作业，取不到再依次从其他线程队列头部窃取
+bool JobSystem::runOne(unsigned index)
+{
+	JobTask task;
+	bool found = false;
+	for (size_t k = 0; k < queues_.size() && !found; ++k)
+	{
+		size_t victim = (index + k) % queues_.size();
+		WorkQueue &queue = *queues_[victim];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (k == 0)
+			found = queue.popBack(task);  // 自己的队列：后进先出
+		else
+			found = queue.popFront(task); // 窃取：从头部拿最早提交的(通常也是最大的)作业
+	}
+	if (!found) return false;
+	queued_.fetch_sub(1, std::memory_order_relaxed);
+	task.job();
+	finish(task.counter);
+	return true;
+}
+
+// workerLoop函数：工作线程不断执行作业，没有作业时睡眠等待唤醒
+void JobSystem::workerLoop(unsigned index)
+{
+	tlsOwner = this;
+	tlsIndex = index;
+	while (true)
+	{
+		if (runOne(index)) continue;
+		std::unique_lock<std::mutex> lock(sleepMutex_);
+		wake_.wait(lock, [this]() { return stop_ || queued_.load(std::memory_order_acquire) > 0; });
+		if (stop_) return;
+	}
+}
+
+// wait函数：帮忙执行作业直到counter归零
+// 正在执行的作业可能在别的线程上，这时队列是空的，只能让出时间片再检查
+void JobSystem::wait(JobCounter &counter)
+{
+	unsigned index = threadIndex();
+	while (!counter.done())
+	{
+		if (!runOne(index)) std::this_thread::yield();
+	}
+	std::lock_guard<std::mutex> lock(counter.mutex_); // 等最后一个finish离开临界区
+}
+
+// parallelForRange函数：切块后提交到当前线程的队列，其他线程会来窃取，当前线程也一起执行
+void JobSystem::parallelForRange(int begin, int end, int grain, const std::function<void(int, int)> &fn)
+{
+	if (begin >= end) return;
+	if (grain < 1) grain = 1;
+	if (end - begin <= grain) // 只有一块，没必要进队列
+	{
+		fn(begin, end);
+		return;
+	}
+	JobCounter counter;
+	for (int chunk = begin; chunk < end; chunk += grain)
+	{
+		int chunkEnd = std::min(end, chunk + grain);
+		submit([&fn, chunk, chunkEnd]() { fn(chunk, chunkEnd); }, &counter);
+	}
+	wait(counter);
+}
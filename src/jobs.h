@@ -0,0 +1,99 @@
+#pragma once // 防止头文件被重复包含
+
+#include <atomic>             // 包含std::atomic，用于无锁计数
+#include <condition_variable> // 包含std::condition_variable，空闲线程在上面睡眠
+#include <functional>         // 包含std::function，作业的类型
+#include <memory>             // 包含std::unique_ptr
+#include <mutex>              // 包含std::mutex
+#include <thread>             // 包含std::thread
+#include <vector>             // 包含std::vector
+
+// 作业：一个不带参数、不返回值的可调用对象
+// 捕获不超过16字节且可平凡复制的lambda(例如[this, i])存放在std::function内部，不会分配堆内存
+typedef std::function<void()> Job;
+
+class JobCounter;
+
+// 队列中的一项：作业本身和它完成后要递减的计数器
+struct JobTask {
+	Job job;
+	JobCounter *counter;
+};
+
+// JobCounter类：记录一批作业中还有多少个没有完成
+// 计数归零时，挂在它上面的后续作业(依赖它的作业)会被自动提交
+class JobCounter {
+public:
+	JobCounter() : pending_(0) {}
+	JobCounter(const JobCounter &) = delete;
+	JobCounter &operator=(const JobCounter &) = delete;
+
+	// 这一批作业是否已经全部完成
+	bool done() const { return pending_.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+	std::atomic<int> pending_;     // 未完成的作业数
+	std::mutex mutex_;             // 保护continuations_
+	std::vector<JobTask> continuations_; // 计数归零后才能执行的作业
+};
+
+// JobSystem类：工作窃取(work stealing)的作业调度器
+// 每个线程有自己的双端队列：自己从尾部压入/取出(后进先出，缓存友好)，空闲的线程从别人队列的头部窃取
+// 整个渲染器共享一个调度器，各个阶段都往里提交作业，避免多个线程池同时运行造成的超额订阅
+class JobSystem {
+public:
+	// 构造函数，cntWorker为工作线程数，0表示使用(硬件线程数 - 1)，调用线程本身也会参与执行
+	explicit JobSystem(unsigned cntWorker = 0);
+	~JobSystem();
+	JobSystem(const JobSystem &) = delete;
+	JobSystem &operator=(const JobSystem &) = delete;
+
+	// 提交一个作业，counter不为空时先把计数加一，作业完成后再减一
+	void submit(Job job, JobCounter *counter = nullptr);
+
+	// 提交一个依赖dependency的作业：dependency归零之后它才会进入队列
+	void submitAfter(JobCounter &dependency, Job job, JobCounter *counter = nullptr);
+
+	// 等待counter归零 (fork/join)，等待期间当前线程会去执行队列中的作业，而不是阻塞
+	void wait(JobCounter &counter);
+
+	// 并行for：把[begin, end)按grain大小切块，fn(chunkBegin, chunkEnd)在各线程上执行，返回前等待全部完成
+	// fn按引用传给std::function，不管lambda捕获了多少东西都不会分配堆内存
+	template<class Fn> void parallelFor(int begin, int end, int grain, const Fn &fn)
+	{
+		parallelForRange(begin, end, grain, std::cref(fn));
+	}
+
+	// 参与执行作业的线程总数 (工作线程 + 调用线程)
+	unsigned cntThread() const { return unsigned(queues_.size()); }
+
+	// 当前线程在本调度器中的编号，0为外部线程(例如主线程)，1..cntWorker为工作线程
+	unsigned threadIndex() const;
+
+private:
+	// 作业队列：环形缓冲区实现的双端队列，容量只增不减，稳态下入队出队不再分配内存
+	struct WorkQueue {
+		std::mutex mutex;          // 保护下面所有成员
+		std::vector<JobTask> ring; // 环形缓冲区
+		std::size_t head = 0;      // 队头在ring中的位置
+		std::size_t count = 0;     // 队列中的作业数
+
+		void pushBack(JobTask task);  // 压入队尾，满了就把容量翻倍
+		bool popBack(JobTask &task);  // 从队尾取出
+		bool popFront(JobTask &task); // 从队头取出
+	};
+
+	std::vector<std::unique_ptr<WorkQueue>> queues_; // 0号给外部线程，其余每个工作线程一个
+	std::vector<std::thread> workers_;               // 工作线程
+	std::atomic<int> queued_;                        // 所有队列中的作业总数
+	std::atomic<bool> stop_;                         // 析构时通知工作线程退出
+	std::mutex sleepMutex_;                          // 配合wake_使用
+	std::condition_variable wake_;                   // 没有作业时工作线程在这里睡眠
+
+	void workerLoop(unsigned index);  // 工作线程主循环
+	bool runOne(unsigned index);      // 取出(或窃取)并执行一个作业，没有作业时返回false
+	void push(JobTask task);          // 把作业放进当前线程的队列并唤醒一个空闲线程
+	void finish(JobCounter *counter); // 递减计数，归零时提交后续作业
+	void parallelForRange(int begin, int end, int grain, const std::function<void(int, int)> &fn); // parallelFor的实现
+};
@@ -1,497 +1,305 @@
-﻿#include <limits>
-#include <vector>
-
-#include <filesystem>
-
-#include "tgaimage.h"
-#include "geometry.h"
-#include "model.h"
-#include "gl.h"
-
-/**
- * DepthShader类：专门用于生成阴影贴图的着色器
- * 实现了IShader接口，用于深度值计算而非颜色渲染
- */
-struct DepthShader : public IShader
+﻿#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <memory>
+#include <atomic>
+#include <new>
+
+#include "renderer.h"
+#include "cpu.h"
+#include "fastmath.h"
+#include "assetcache.h"
+#include "server.h"
+#include "composite.h"
+#include "sortfirst.h"
+
+// 命令行程序：解析参数，加载模型，用一个RenderContext渲染内置场景或者作为渲染服务常驻
+
+const int CNT_FRAME = 2;  // 渲染的帧数，第一帧之后各处容量都已就绪，之后的帧应当没有堆分配
+
+// 渲染服务：由命令行参数--serve <socket>选择，常驻进程在本地Unix域套接字上接受渲染请求
+// 工作线程、帧分配器和加载过的模型(及纹理)在请求之间保持，模型缓存按--cache-mb的预算做LRU淘汰
+const std::size_t DEFAULT_CACHE_MB = 512;  // 模型缓存的默认预算(MB)
+
+// 排序在后的分布式渲染：由命令行参数--composite RANK SIZE DIR选择，SIZE个进程各自以不同的RANK启动，
+// 模型按编号轮流分配给各进程，每个进程只加载自己的那部分；进程之间通过DIR下的Unix域套接字按深度合并画面
+const int MAX_COMPOSITE_SIZE = 64;
+
+// 排序在前的分布式渲染：由命令行参数--sort-first RANK SIZE DIR选择，所有进程都加载整个场景，0号进程是协调者，
+// 每帧把画面按行分给各进程，拼接结果，并按各横条的渲染时间重新划分；多渲染几帧，划分才能收敛
+const int CNT_FRAME_SORT_FIRST = 4;
+
+// 全局堆分配计数：替换全局operator new，每次分配加一，通过HeapCounterHook交给渲染库查询(见arena.h)
+// 替换的是普通版本和对齐版本；数组版本和nothrow版本默认都转发到这两个，因此同样计数
+// 分配失败时按标准的要求反复调用new_handler，没有new_handler时抛出std::bad_alloc
+static std::atomic<std::size_t> cntHeapAllocation(0);
+static thread_local int tlsUncounted = 0;  // 大于0时当前线程的分配不计数
+
+static std::size_t countHeapAllocations()
 {
-	// 统一变量（uniform变量）：在整个着色过程中保持不变的数据
-	Matrix uVpPV;  // 视口变换 * 投影矩阵 * 视图矩阵的组合变换矩阵
-	// 顶点间插值变量（varying变量）：在顶点间插值传递的数据
-	mat<4, 3, float> vScreenCoords;  // 存储3个顶点的屏幕坐标
-
-
-	DepthShader() {}  // 默认构造函数
-
-	/**
-	 * 顶点着色器函数：将顶点从世界坐标转换为屏幕坐标
-	 * @param nthvert 当前顶点的索引(0,1,2)
-	 * @param worldCoord 世界坐标
-	 * @param uv 纹理坐标（此处未使用）
-	 * @param normal 法线向量（此处未使用）
-	 * @return 变换后的屏幕坐标
-	 */
-	Vec4f vertex(unsigned nthvert, Vec4f worldCoord, Vec2f uv, Vec3f normal)
-	{
-		// 将世界坐标转换为屏幕坐标
-		Vec4f screenCoord = uVpPV * worldCoord;
-		// 进行透视除法，将齐次坐标转换为欧氏坐标
-		screenCoord = screenCoord / screenCoord[3];
-		// 存储屏幕坐标，用于后续的片段着色
-		vScreenCoords.set_col(nthvert, screenCoord);
-
-		return screenCoord;
-	}
+	return cntHeapAllocation.load(std::memory_order_relaxed);
+}
 
-	/**
-	 * 片段着色器函数：计算片段的颜色
-	 * @param bar 重心坐标，用于插值计算
-	 * @param color 输出的颜色
-	 * @return 是否渲染该片段
-	 */
-	bool fragment(Vec3f bar, Vec3f &color)
-	{
-		// 使用重心坐标计算插值后的片段位置
-		Vec4f fragPos = vScreenCoords * bar;
-		// 根据深度值计算颜色，深度值越大，颜色越暗，形成可视化的深度图
-		// 使用指数函数增强对比度，方便可视化
-		color = Vec3f(255.0f, 255.0f, 255.0f) * powf(expf(fragPos[2]-1.0f), 4.0f);
+static void pauseHeapCounting(bool paused)
+{
+	tlsUncounted += paused ? 1 : -1;
+}
 
-		return true;  // 渲染该片段
-	}
-};
+static const HeapCounterHook HEAP_COUNTER_HOOK = { countHeapAllocations, pauseHeapCounting };
 
-/**
- * LightColor结构：表示光源的颜色属性
- * 包含环境光、漫反射和镜面反射三种颜色分量
- */
-struct LightColor
+// heapAllocate函数：alignment为0时用malloc，否则用aligned_alloc(大小要凑成对齐的整数倍)
+static void *heapAllocate(std::size_t size, std::size_t alignment)
 {
-	Vec3f ambient, diffuse, specular;  // 环境光、漫反射和镜面反射颜色
-
-	/**
-	 * 构造函数：初始化光源颜色
-	 * @param ambi 环境光颜色
-	 * @param diff 漫反射颜色
-	 * @param spec 镜面反射颜色
-	 */
-	LightColor(Vec3f ambi = Vec3f(), Vec3f diff = Vec3f(), Vec3f spec = Vec3f())
+	if (tlsUncounted == 0) cntHeapAllocation.fetch_add(1, std::memory_order_relaxed);
+	if (size == 0) size = 1;
+	if (alignment) size = (size + alignment - 1) / alignment * alignment;
+	while (true)
 	{
-		ambient = ambi;
-		diffuse = diff;
-		specular = spec;
+		void *p = alignment ? std::aligned_alloc(alignment, size) : std::malloc(size);
+		if (p) return p;
+		std::new_handler handler = std::get_new_handler();
+		if (!handler) throw std::bad_alloc();
+		handler();
 	}
-};
+}
 
-/**
- * Shader类：实现Phong着色模型的着色器
- * 实现了IShader接口，用于执行完整的光照计算
- */
-struct Shader : public IShader
+void *operator new(std::size_t size)
 {
-	// 统一变量（在所有顶点和片段处理中保持一致的数据） uniform所以加u
-	Model *uTexture;  // 模型纹理
-	Matrix uModel, uVpPV, uLightVpPV;  // 模型、视图投影和光源视图投影变换矩阵
-	Vec3f uEyePos, uLightPos, uTangent, uBitangent;  // 视点位置、光源位置、切线和副切线向量
-	LightColor uLightColor;  // 光源颜色
-	float *uShadowBuffer;  // 阴影缓冲区（深度图）
-	unsigned uShadowBufferWidth, uShadowBufferHeight;  // 阴影缓冲区尺寸
-	
-	// 顶点间插值变量（varying变量）varying所以加v
-	mat<4, 3, float> vScreenCoords;  // 屏幕坐标
-	mat<2, 3, float> vUv;  // 纹理坐标
-	mat<3, 3, float> vN;  // 法线向量
-	mat<3, 3, float> vLightSpacePos;  // 光源空间位置，用于阴影计算
-	mat<3, 3, float> vWorldCoords;  // 世界坐标
-
-
-	Shader() {}  // 默认构造函数
-
-	/**
-	 * 顶点着色器函数：处理单个顶点
-	 * @param nthvert 当前顶点索引
-	 * @param worldCoord 世界坐标
-	 * @param uv 纹理坐标
-	 * @param normal 法线向量
-	 * @return 变换后的屏幕坐标
-	 */
-	Vec4f vertex(unsigned nthvert, Vec4f worldCoord, Vec2f uv, Vec3f normal)
-	{
-		// 计算屏幕坐标
-		Vec4f screenCoord = uVpPV * worldCoord;
-		float w = screenCoord[3];  // 保存透视除法的分母
-
-		// 存储世界坐标，透视校正插值需要除以w
-		vWorldCoords.set_col(nthvert, proj<3>(worldCoord) / w);
-
-		// 进行透视除法，将齐次坐标转换为标准设备坐标
-		screenCoord = screenCoord / w;
-		// 保存z/w值，用于透视校正插值
-		screenCoord[2] = screenCoord[2] / w;
-		// 保存1/w值，用于后续透视校正插值
-		screenCoord[3] = 1.0f / w;
-		vScreenCoords.set_col(nthvert, screenCoord);
-
-		// 存储纹理坐标，应用透视校正
-		Vec2f vertUv = uv / w;
-		vUv.set_col(nthvert, vertUv);
-
-		// 存储法线向量，应用透视校正
-		Vec3f vertN = normal / w;
-		vN.set_col(nthvert, vertN);
-
-		// 计算光源空间位置，用于阴影映射
-		Vec4f temp = uLightVpPV * worldCoord;  // 将顶点变换到光源空间
-		temp = temp / temp.w;  // 透视除法
-		Vec3f vertLightSpacePos = proj<3>(temp) / w;  // 投影到3D并应用透视校正
-		vLightSpacePos.set_col(nthvert, vertLightSpacePos);
-
-		return screenCoord;
-	}
-
-	/**
-	 * 片段着色器函数：计算片段颜色
-	 * @param bar 重心坐标，用于插值计算
-	 * @param color 输出的颜色
-	 * @return 是否渲染该片段
-	 */
-	bool fragment(Vec3f bar, Vec3f &color)
-	{
-		// 计算透视校正插值的w值
-		float w = (vScreenCoords * bar)[3];
-		if (fabs(w) < 1e-7) return false;  // 避免除以接近零的数
-		w = 1.0f / w;  // 将1/w转换回w
-
-		// 计算透视校正的纹理坐标
-		Vec2f uv = vUv * bar * w;
-
-		// 从切线空间计算法线向量（法线贴图）
-		mat<3, 3, float> TBN;  // 切线空间到世界空间的变换矩阵
-		TBN.set_col(0, uTangent);  // 设置切线向量
-		TBN.set_col(1, uBitangent);  // 设置副切线向量
-		TBN.set_col(2, vN * bar * w);  // 设置插值后的法线向量
-		// 从法线贴图获取切线空间法线并转换到世界空间
-		Vec3f n = (TBN * uTexture->normal(uv)).normalize();
-		
-		// 计算用于光照的方向向量
-		Vec3f worldCoord = vWorldCoords * bar * w;  // 插值后的世界坐标
-		Vec3f lightDir = uLightPos.normalize();  // 光照方向（此处假设为方向光）
-		Vec3f eyeDir = (uEyePos - worldCoord).normalize();  // 视线方向
-		Vec3f half = (lightDir + eyeDir) / 2.0f;  // 半程向量，用于Blinn-Phong高光计算
-
-		// 环境光反射计算
-		Vec3f materialAmbient = uTexture->diffuse(uv).rgb();  // 材质环境光反射系数（从漫反射纹理获取）
-		Vec3f ambient = uLightColor.ambient * materialAmbient;  // 环境光分量
-		
-		// 漫反射计算 (Lambert模型)
-		Vec3f materialDiffuse = uTexture->diffuse(uv).rgb();  // 材质漫反射系数
-		// 漫反射强度 = 光照强度 * 材质漫反射系数 * max(0, 法线·光照方向)
-		Vec3f diffuse = uLightColor.diffuse * (materialDiffuse * std::max(0.0f, dot(n, lightDir)));
-
-		// 镜面反射计算 (Blinn-Phong模型)
-		float materialSpecular = uTexture->specular(uv);  // 材质镜面反射系数
-		// 镜面反射强度 = 光照强度 * 材质镜面反射系数 * (法线·半程向量)^32
-		Vec3f specular = uLightColor.specular * (materialSpecular * powf(std::max(0.0f, dot(n, half)), 32.0f));
-
-		// 计算阴影
-		float shadow = 0.0f;
-		Vec3f lightSpacePos = vLightSpacePos * bar * w;  // 插值后的光源空间坐标
-		int cntSample = 0;  // 采样计数
-		// 进行阴影采样（PCF滤波，减少阴影锯齿）
-		for (int dx = -2; dx < 2; dx++)  // 在x方向采样4个点
-		{
-			int sampleX = lightSpacePos.x + dx;
-			if (sampleX < 0 || sampleX >= uShadowBufferWidth) continue;  // 边界检查
-			for (int dy = -2; dy < 2; dy++)  // 在y方向采样4个点
-			{
-				int sampleY = lightSpacePos.y + dy;
-				if (sampleY < 0 || sampleY >= uShadowBufferHeight) continue;  // 边界检查
-				cntSample++;  // 有效采样点计数
-				// 比较当前深度与阴影贴图中的深度
-				// 添加偏移量(0.005f)避免自阴影问题
-				if (lightSpacePos.z + 0.005f < uShadowBuffer[sampleY * uShadowBufferWidth + sampleX])
-					shadow += 1.0f;  // 在阴影中
-			}
-		}
-		shadow /= cntSample;  // 计算阴影因子（0到1之间）
-
-		// 使用Blinn-Phong光照模型计算最终颜色
-		// 环境光 + (漫反射 + 镜面反射) * (1 - 阴影因子)
-		color = ambient + (diffuse + specular) * (1.0f - shadow);
-
-		return true;  // 渲染该片段
-	}
-};
-
-
-
-
-// 常量定义
-const float PI = acosf(-1.0f);  // π值，用于角度计算
-
-const unsigned SCREEN_WIDTH = 800;   // 屏幕宽度
-const unsigned SCREEN_HEIGHT = 800;  // 屏幕高度
-
-const unsigned SHADOW_WIDTH = 800;   // 阴影贴图宽度
-const unsigned SHADOW_HEIGHT = 800;  // 阴影贴图高度
-
-const unsigned CNT_SAMPLE = 4;          // 每个像素的采样数（用于MSAA）
-const float D_MSAA[CNT_SAMPLE][2] = {   // MSAA采样点的偏移量
-	{0.25f, 0.25f}, {0.25f, 0.75f},
-	{0.75f, 0.25f}, {0.75f, 0.75f}
-};
-const float D_NonMSAA[1][2] = {         // 非MSAA采样的偏移量（居中采样）
-	{0.0f, 0.0f}
-};
-
+	return heapAllocate(size, 0);
+}
 
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+	return heapAllocate(size, std::size_t(alignment));
+}
 
-// 全局变量定义
-Vec3f lightPos(1.0f, 1.0f, 1.0f);  // 光源位置
-// 光源颜色：环境光、漫反射和镜面反射分量
-LightColor lightColor(Vec3f(0.3f, 0.3f, 0.3f), Vec3f(1.0f, 1.0f, 1.0f), Vec3f(0.5f, 0.5f, 0.5f));
+void operator delete(void *p) noexcept
+{
+	std::free(p);
+}
 
-Vec3f eye(1.0f, 1.0f, 3.0f);      // 相机位置
-Vec3f center(0.0f, 0.0f, 0.0f);   // 相机看向的点
-Vec3f up(0.0f, 1.0f, 0.0f);       // 相机上方向
+void operator delete(void *p, std::size_t) noexcept
+{
+	std::free(p);
+}
 
+void operator delete(void *p, std::align_val_t) noexcept
+{
+	std::free(p);
+}
 
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept
+{
+	std::free(p);
+}
 
 /**
- * 阴影映射函数：从光源视角渲染场景，生成深度图
- * @param modelData 模型数据数组
- * @param modelTrans 模型变换矩阵数组
- * @param cntModel 模型数量
- * @param zBuffer 深度缓冲区
- * @param colorBuffer 颜色缓冲区
- * @param depth 深度图像
- * @return 光源视图-投影-视口变换的组合矩阵
+ * 主函数
+ * 程序的执行顺序是main函数->RenderContext::render函数->PhongShading函数->triangle函数->homogeneousClip函数->singleFaceZClip函数->pushIntersection函数
  */
-Matrix shadowMapping(Model **modelData, Matrix *modelTrans, unsigned cntModel, float *zBuffer, Vec3f *colorBuffer, TGAImage &depth)
+int main(int argc, char **argv)
 {
-	// 设置光照视角的视图矩阵
-	Matrix view = lookat(lightPos, center, up);
-	// 设置正交投影矩阵（正交投影避免透视失真，适合阴影映射）
-	Matrix project = ortho(-2.0f, 2.0f, -2.0f, 2.0f, -0.01f, -10.0f);
-	// 设置视口变换矩阵（将NDC坐标转换为屏幕坐标）
-	Matrix vp = viewport(SHADOW_WIDTH, SHADOW_HEIGHT);
-
-	// 遍历所有模型
-	for (unsigned m = 0; m < cntModel; ++m)
+	setHeapCounterHook(&HEAP_COUNTER_HOOK);  // 每帧输出的堆分配次数来自上面替换的operator new
+
+	// 命令行参数：--shading phong|gouraud|flat，--light directional|point，--views N，--poster W H，--serve <socket>，--cache-mb N，
+	// --composite RANK SIZE DIR，--sort-first RANK SIZE DIR，--simd scalar|sse2|avx|avx512|auto
+	RenderConfig config;      // 渲染设置，默认值就是内置场景
+	std::string serveSocket;  // 渲染服务的套接字路径，为空表示只渲染一次内置场景
+	std::size_t cacheBytes = DEFAULT_CACHE_MB << 20;  // 模型缓存的预算(字节)
+	bool cacheGiven = false;  // 是否指定了--cache-mb，只有渲染服务才有模型缓存
+	int compositeRank = 0, compositeSize = 0;  // 分布式渲染中本进程的编号和进程总数，0表示不做分布式渲染
+	int sortFirstRank = 0, sortFirstSize = 0;  // 排序在前的分布式渲染中本进程的编号和进程总数，0表示不做
+	std::string groupDir;  // 分布式渲染的套接字目录
+	for (int i = 1; i < argc; ++i)
 	{
-		// 创建深度着色器并设置统一变量
-		DepthShader depthShader;
-		depthShader.uVpPV = vp * project*view;  // 组合变换矩阵
-
-		// 渲染管线：从光源视角计算深度
-		Matrix modelInverTranspose = modelTrans[m].invert_transpose();  // 计算模型变换矩阵的逆转置（用于法线变换）
-		for (int i = 0; i < modelData[m]->nfaces(); ++i)  // 遍历模型的每个面
+		bool known = false;
+		if (std::strcmp(argv[i], "--shading") == 0 && i + 1 < argc)
 		{
-			// 顶点处理阶段
-			Vec4f screenCoords[3];  // 存储变换后的顶点坐标
-			for (int j = 0; j < 3; ++j)  // 处理三角形的三个顶点
+			++i;
+			for (int mode = 0; mode < SHADING_MODE_COUNT; ++mode)
 			{
-				// 将顶点从模型空间变换到世界空间
-				Vec4f worldCoord = modelTrans[m] * embed<4>(modelData[m]->vert(i, j));
-				Vec2f uv = modelData[m]->uv(i, j);  // 获取纹理坐标
-				// 变换法线向量（使用逆转置矩阵）
-				Vec3f normal = proj<3>(modelInverTranspose * Vec4f(modelData[m]->normal(i, j), 0.0f));
-				// 调用顶点着色器处理顶点
-				screenCoords[j] = depthShader.vertex(j, worldCoord, uv, normal);
+				if (std::strcmp(argv[i], SHADING_MODE_NAMES[mode]) == 0)
+				{
+					config.shading = ShadingMode(mode);
+					known = true;
+				}
 			}
-
-			// 光栅化 + 片段处理阶段
-			// 使用非MSAA模式渲染三角形到深度缓冲区
-			triangle(screenCoords, depthShader, colorBuffer, zBuffer, SHADOW_WIDTH, SHADOW_HEIGHT, D_NonMSAA, 1);
 		}
-	}
-	
-	// 返回光源的视图-投影-视口变换组合矩阵（用于后续阴影计算）
-	return vp * project * view;
-}
-
-/**
- * Phong着色函数：使用Phong着色模型渲染场景
- * @param modelData 模型数据数组
- * @param modelTrans 模型变换矩阵数组
- * @param cntModel 模型数量
- * @param zBuffer 深度缓冲区
- * @param colorBuffer 颜色缓冲区
- * @param lightVpPV 光源视图-投影-视口变换组合矩阵
- * @param shadowBuffer 阴影缓冲区
- * @param frame 输出图像
- */
-void PhongShading(Model **modelData, Matrix *modelTrans, unsigned cntModel, float *zBuffer, Vec3f *colorBuffer, Matrix lightVpPV, float *shadowBuffer, TGAImage &frame)
-{
-	// 设置相机视角的视图矩阵
-	Matrix view = lookat(eye, center, up);
-	// 设置透视投影矩阵（FOV=45度，宽高比=1.0）
-	Matrix project = projection(PI / 4.0f, 1.0f, -0.01f, -10.0f);
-	// 设置视口变换矩阵
-	Matrix vp = viewport(SCREEN_WIDTH, SCREEN_HEIGHT);
-	Matrix PV = project * view;  // 组合投影和视图矩阵，用于裁剪
-
-	// 遍历所有模型
-	for (unsigned m = 0; m < cntModel; ++m)
-	{
-		// 创建Phong着色器并设置统一变量
-		Shader PhongShader;
-		PhongShader.uTexture = modelData[m];  // 设置模型纹理
-		PhongShader.uModel = modelTrans[m];  // 设置模型变换矩阵
-		PhongShader.uVpPV = vp * project * view;  // 设置视图-投影-视口变换组合矩阵
-		PhongShader.uLightVpPV = lightVpPV;  // 设置光源视图-投影-视口变换组合矩阵
-		PhongShader.uEyePos = eye;  // 设置相机位置
-		PhongShader.uLightPos = lightPos;  // 设置光源位置
-		PhongShader.uLightColor = lightColor;  // 设置光源颜色
-		PhongShader.uShadowBuffer = shadowBuffer;  // 设置阴影缓冲区
-		PhongShader.uShadowBufferWidth = SHADOW_WIDTH;  // 设置阴影缓冲区宽度
-		PhongShader.uShadowBufferHeight = SHADOW_HEIGHT;  // 设置阴影缓冲区高度
-
-		// 渲染管线：计算每个采样的信息
-		for (int i = 0; i < modelData[m]->nfaces(); ++i)  // 遍历模型的每个面
+		else if (std::strcmp(argv[i], "--light") == 0 && i + 1 < argc)
+		{
+			++i;
+			for (int mode = 0; mode < LIGHT_MODE_COUNT; ++mode)
+			{
+				if (std::strcmp(argv[i], LIGHT_MODE_NAMES[mode]) == 0)
+				{
+					config.light = LightMode(mode);
+					known = true;
+				}
+			}
+		}
+		else if (std::strcmp(argv[i], "--views") == 0 && i + 1 < argc)
+		{
+			int n = std::atoi(argv[++i]);
+			if (n >= 1 && n <= int(MAX_VIEWS))
+			{
+				config.cntView = unsigned(n);
+				known = true;
+			}
+		}
+		else if (std::strcmp(argv[i], "--poster") == 0 && i + 2 < argc)
+		{
+			int w = std::atoi(argv[i + 1]), h = std::atoi(argv[i + 2]);
+			i += 2;
+			if (w >= 1 && h >= 1 && w <= int(MAX_POSTER_SIZE) && h <= int(MAX_POSTER_SIZE))
+			{
+				config.posterWidth = unsigned(w);
+				config.posterHeight = unsigned(h);
+				known = true;
+			}
+		}
+		else if (std::strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+		{
+			serveSocket = argv[++i];
+			known = true;
+		}
+		else if (std::strcmp(argv[i], "--cache-mb") == 0 && i + 1 < argc)
 		{
-			// 背面剔除：计算面法线并判断是否背向相机
-			Vec3f n = cross(modelData[m]->vert(i, 1) - modelData[m]->vert(i, 0), modelData[m]->vert(i, 2) - modelData[m]->vert(i, 0)).normalize();
-			// 将法线从模型空间变换到相机空间
-			n = proj<3>((view * modelTrans[m]).invert_transpose() * Vec4f(n, 0.0f));
-			if (n.z <= 0.0f) continue;  // 如果面背向相机则跳过
-
-			// z轴裁剪：去除远近平面外的面片
-			Matrix modelInverTranspose = modelTrans[m].invert_transpose();  // 计算模型变换矩阵的逆转置
-			std::vector<Vertex> original, clipped;  // 原始顶点和裁剪后顶点
-			for (int j = 0; j < 3; j++)  // 处理三角形的三个顶点
+			int mb = std::atoi(argv[++i]);
+			if (mb >= 1)
 			{
-				// 将顶点从模型空间变换到世界空间
-				Vec4f worldCoord = modelTrans[m] * embed<4>(modelData[m]->vert(i, j));
-				// 将顶点变换到裁剪空间
-				Vec4f clipCoord = PV * worldCoord;
-				// 变换法线向量
-				Vec3f normal = proj<3>(modelInverTranspose * Vec4f(modelData[m]->normal(i, j), 0.0f));
-				Vec2f uv = modelData[m]->uv(i, j);  // 获取纹理坐标
-				// 创建顶点对象并存入原始顶点列表
-				Vertex vertex(worldCoord, clipCoord, uv, normal);
-				original.push_back(vertex);
+				cacheBytes = std::size_t(mb) << 20;
+				cacheGiven = true;
+				known = true;
 			}
-			// 执行齐次裁剪（z平面）
-			homogeneousClip(original, clipped, 2);
-
-			// 视锥体剔除：如果三角形完全在视锥体外则跳过
-			if (clipped.size() < 3) continue;  // 裁剪后少于3个顶点，无法形成三角形
-
-			// 计算三角形的切线和副切线向量（用于法线映射）
-			mat<2, 3, float> A;  // 存储边向量
-			// 计算三角形的两条边向量
-			A[0] = proj<3>(modelTrans[m] * Vec4f(modelData[m]->vert(i, 1) - modelData[m]->vert(i, 0), 0.0f));
-			A[1] = proj<3>(modelTrans[m] * Vec4f(modelData[m]->vert(i, 2) - modelData[m]->vert(i, 0), 0.0f));
-			mat<2, 2, float> U;  // 存储纹理坐标差值
-			// 计算纹理坐标的差值
-			U[0] = modelData[m]->uv(i, 1) - modelData[m]->uv(i, 0);
-			U[1] = modelData[m]->uv(i, 2) - modelData[m]->uv(i, 0);
-			// 通过求解线性方程组计算切线和副切线
-			mat<2, 3, float> tTB = U.invert() * A;
-			PhongShader.uTangent = tTB[0].normalize();  // 归一化切线向量
-			PhongShader.uBitangent = tTB[1].normalize();  // 归一化副切线向量
-
-			// 对每个子三角形进行着色（裁剪可能产生多个三角形）
-			for (size_t j = 1; j < clipped.size() - 1; ++j)
+		}
+		else if (std::strcmp(argv[i], "--simd") == 0 && i + 1 < argc)
+		{
+			known = setSimdOverride(argv[++i]);  // SIMD指令集的等级是整个进程的设置，名字无效时报错
+		}
+		else if ((std::strcmp(argv[i], "--composite") == 0 || std::strcmp(argv[i], "--sort-first") == 0) && i + 3 < argc)
+		{
+			bool composite = std::strcmp(argv[i], "--composite") == 0;
+			int rank = std::atoi(argv[i + 1]), size = std::atoi(argv[i + 2]);
+			groupDir = argv[i + 3];
+			i += 3;
+			if (size >= 1 && size <= MAX_COMPOSITE_SIZE && rank >= 0 && rank < size)
 			{
-				// 顶点处理：调用顶点着色器处理每个顶点
-				Vec4f screenCoords[3];
-				screenCoords[0] = PhongShader.vertex(0, clipped[0].worldCoord, clipped[0].uv, clipped[0].normal);
-				screenCoords[1] = PhongShader.vertex(1, clipped[j].worldCoord, clipped[j].uv, clipped[j].normal);
-				screenCoords[2] = PhongShader.vertex(2, clipped[j+1].worldCoord, clipped[j+1].uv, clipped[j+1].normal);
-
-				// 光栅化 + 片段处理：使用MSAA渲染三角形
-				triangle(screenCoords, PhongShader, colorBuffer, zBuffer, SCREEN_WIDTH, SCREEN_HEIGHT, D_MSAA, CNT_SAMPLE);
+				(composite ? compositeRank : sortFirstRank) = rank;
+				(composite ? compositeSize : sortFirstSize) = size;
+				known = true;
 			}
 		}
+		if (!known)
+		{
+			std::cerr << "usage: " << argv[0] << " [--shading phong|gouraud|flat] [--light directional|point] [--views 1-" << MAX_VIEWS
+				<< " | --poster W H] [--serve <socket> [--cache-mb N] | --composite RANK SIZE DIR | --sort-first RANK SIZE DIR]"
+				<< " [--simd scalar|sse2|avx|avx512|auto]" << std::endl;
+			return 1;
+		}
+	}
+	if ((compositeSize || sortFirstSize) && !serveSocket.empty())
+	{
+		std::cerr << "distributed rendering renders the built-in scene, it cannot be combined with --serve" << std::endl;
+		return 1;
+	}
+	if (cacheGiven && serveSocket.empty())
+	{
+		std::cerr << "--cache-mb sets the model cache of the render service, it requires --serve" << std::endl;
+		return 1;
+	}
+	if (compositeSize && sortFirstSize)
+	{
+		std::cerr << "--composite and --sort-first cannot be combined" << std::endl;
+		return 1;
+	}
+	if (sortFirstSize && (config.cntView > 1 || config.posterWidth))
+	{
+		std::cerr << "sort-first rendering supports single-view rendering only" << std::endl;
+		return 1;
+	}
+	// 分布式渲染的进程组：创建后就开始监听，其他进程第一次通信时再建立连接
+	std::unique_ptr<ProcessGroup> group;
+	std::unique_ptr<DepthCompositor> compositor;
+	if (compositeSize)
+	{
+		group.reset(new ProcessGroup(groupDir, compositeRank, compositeSize));
+		if (!group->ok()) return 1;
+		compositor.reset(new DepthCompositor(*group));
+		config.compositor = compositor.get();
+		std::cerr << "sort-last compositing: process " << compositeRank << " of " << compositeSize << std::endl;
+	}
+	else if (sortFirstSize)
+	{
+		group.reset(new ProcessGroup(groupDir, sortFirstRank, sortFirstSize));
+		if (!group->ok()) return 1;
+		std::cerr << "sort-first rendering: process " << sortFirstRank << " of " << sortFirstSize << (sortFirstRank == 0 ? " (coordinator)" : "") << std::endl;
 	}
-}
 
-/**
- * 将深度颜色写入TGA图像
- * @param depth 输出的深度图像
- * @param colorBuffer 颜色缓冲区
- */
-void writeDepth(TGAImage &depth, Vec3f *colorBuffer)
-{
-	// 将深度颜色写入TGAImage（用于调试和可视化）
-	for (unsigned x = 0; x < depth.get_width(); ++x)
+	std::string error;
+	if (!config.validate(error))
 	{
-		for (unsigned y = 0; y < depth.get_height(); ++y)
-		{
-			Vec3f color = colorBuffer[y * depth.get_width() + x];
-			depth.set(x, y, TGAColor(color.x, color.y, color.z, 255));
-		}
+		std::cerr << error << std::endl;
+		return 1;
 	}
-}
 
-/**
- * 将渲染结果写入TGA图像
- * @param frame 输出图像
- * @param zBuffer 深度缓冲区
- * @param colorBuffer 颜色缓冲区
- * @param cntSample 每个像素的采样数
- */
+	// 渲染上下文：拥有工作线程(所有阶段共用)和每帧的临时数据分配器(每个线程有自己的分配块，帧结束时整体回收)
+	RenderContext renderer(config);
+	std::cerr << "job system: " << renderer.jobs().cntThread() << " threads" << std::endl;
+	// SIMD指令集：默认用CPUID检测到的最高等级，--simd可以指定更低的等级
+	std::cerr << "simd: detected " << simdLevelName(detectSimdLevel()) << ", using " << simdLevelName(activeSimdLevel()) << std::endl;
+	std::cerr << "shading math: " << (FAST_MATH_ENABLED ? "fast (FAST_MATH=1)" : "exact") << std::endl;  // 编译时选择的数学函数
 
-void writeFrame(TGAImage &frame, float *zBuffer, Vec3f *colorBuffer, unsigned cntSample)
-{
-	// 将着色结果写入TGA图像，对每个像素的MSAA采样进行平均
-	for (unsigned x = 0; x < frame.get_width(); ++x)
+	if (!serveSocket.empty())
 	{
-		for (unsigned y = 0; y < frame.get_height(); ++y)
+		// 渲染服务：模型从缓存获取，每个请求渲染一帧到请求指定的目录
+		AssetCache cache(cacheBytes);
+		return serveRenderRequests(serveSocket, [&](const RenderRequest &request, std::string &reply)
 		{
-			if (x == 362 && y == 417)
-				x = x;  // 调试断点位置
-			Vec3f color(0.0f, 0.0f, 0.0f);  // 初始化颜色为黑色
-			for (unsigned i = 0; i < cntSample; ++i)  // 遍历像素的所有采样点
+			auto start = std::chrono::steady_clock::now();
+			unsigned cntHit = cache.cntHit(), cntMiss = cache.cntMiss();
+			unsigned cntModel = unsigned(request.models.size());
+			std::vector<std::shared_ptr<Model>> models(cntModel);  // 请求期间持有模型，即使它们被淘汰出缓存
+			std::vector<Model *> modelData(cntModel);
+			std::vector<Matrix> modelTrans(cntModel);
+			std::unique_ptr<bool[]> modelOccluder(new bool[cntModel]);
+			for (unsigned m = 0; m < cntModel; ++m)
 			{
-				// 如果采样点有深度值（被渲染）则累加颜色
-				if (zBuffer[cntSample * (y*frame.get_width() + x) + i] > -std::numeric_limits<float>::max())
+				const RequestModel &requested = request.models[m];
+				models[m] = cache.get(requested.path);
+				if (!models[m])
 				{
-					color = color + colorBuffer[cntSample * (y*frame.get_width() + x) + i];
+					reply = "cannot load model " + requested.path;
+					return false;
 				}
+				modelData[m] = models[m].get();
+				modelTrans[m] = Matrix::identity();
+				for (int k = 0; k < 3; ++k) modelTrans[m][k][3] = requested.translate[k];
+				modelOccluder[m] = requested.occluder;
 			}
-			color = color / cntSample;  // 计算平均颜色（MSAA抗锯齿原理）
-			frame.set(x, y, TGAColor(color.x, color.y, color.z, 255));  // 设置像素颜色
-		}
-	}
-}
 
-/**
- * 主函数
- * 程序的执行顺序是main函数->PhongShading函数->triangle函数->homogeneousClip函数->singleFaceZClip函数->pushIntersection函数
- */
-int main()
-{
-	if (!std::filesystem::exists("./thisoutput")) {
-		std::filesystem::create_directory("./thisoutput");
-	}
+			if (!renderer.render(modelData.data(), modelTrans.data(), modelOccluder.get(), cntModel, request.outputDir, 1))
+			{
+				reply = "render failed";
+				return false;
+			}
 
-	// 分配缓冲区内存
-	float *zBuffer = new float[SCREEN_WIDTH * SCREEN_HEIGHT * CNT_SAMPLE];  // 深度缓冲区
-	Vec3f *colorBuffer = new Vec3f[SCREEN_WIDTH * SCREEN_HEIGHT * CNT_SAMPLE];  // 颜色缓冲区
-	float *shadowZBuffer = new float[SCREEN_WIDTH * SCREEN_HEIGHT];  // 阴影深度缓冲区
-	Vec3f *shadowColorBuffer = new Vec3f[SCREEN_WIDTH * SCREEN_HEIGHT];  // 阴影颜色缓冲区
-	
-	// 初始化缓冲区
-	for (int i = 0; i < SCREEN_WIDTH*SCREEN_HEIGHT; ++i)
-	{
-		for (int j = 0; j < CNT_SAMPLE; ++j)
-		{
-			zBuffer[CNT_SAMPLE * i + j] = -std::numeric_limits<float>::max();  // 初始化深度为负无穷
-			colorBuffer[CNT_SAMPLE * i + j] = Vec3f(0.0f, 0.0f, 0.0f);  // 初始化颜色为黑色
-		}
-		shadowZBuffer[i] = -std::numeric_limits<float>::max();  // 初始化阴影深度为负无穷
-		shadowColorBuffer[i] = Vec3f(0.0f, 0.0f, 0.0f);  // 初始化阴影颜色为黑色
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			reply = std::to_string(int(ms + 0.5)) + " ms, cache " + std::to_string(cache.cntHit() - cntHit) + " hits " + std::to_string(cache.cntMiss() - cntMiss)
+				+ " misses, " + std::to_string(cache.size()) + " models " + std::to_string(cache.bytes() >> 20) + "/" + std::to_string(cache.budget() >> 20) + " MB";
+			std::cerr << "request " << request.outputDir << ": " << reply << ", " << cache.cntEvict() << " evictions so far" << std::endl;
+			return true;
+		});
 	}
 
-	// 加载模型
+	// 加载模型；分布式渲染时第m个模型属于第m % SIZE个进程，其他进程的模型不加载(为nullptr)
 	unsigned cntModel = 2;  // 模型数量
 	Model **modelData = new Model*[cntModel];  // 创建模型数组
+	auto ownModel = [&](unsigned m) { return compositeSize == 0 || int(m % compositeSize) == compositeRank; };
 
-	modelData[0] = new Model("输入你存放的路径");  // 这里一定一定要写成绝对路径!!!
+	modelData[0] = ownModel(0) ? new Model("输入你存放的路径") : nullptr;  // 这里一定一定要写成绝对路径!!!
 	//而且纹理tga的文件命名要按_diffuse和_nm_tangent以及_spec来命名
-	modelData[1] = new Model("输入你存放的路径");  // 加载地板模型
+	modelData[1] = ownModel(1) ? new Model("输入你存放的路径") : nullptr;  // 加载地板模型
 
 	std::cerr << std::endl;  // 输出空行
 	
@@ -501,25 +309,33 @@ int main()
 	modelTrans[1] = Matrix::identity();  // 地板模型基于单位矩阵
 	modelTrans[1][1][3] = -0.3f;  // 在y方向（高度）上偏移地板
 
-	// 阴影通道：从光源角度渲染深度图
-	TGAImage depth(SCREEN_WIDTH, SCREEN_HEIGHT, TGAImage::RGB);  // 创建深度图像
-	// 生成阴影贴图并获取光源变换矩阵
-	Matrix lightVpPV = shadowMapping(modelData, modelTrans, cntModel, shadowZBuffer, shadowColorBuffer, depth);
-	std::cerr << "finish shadow depth buffer calculation" << std::endl;  // 输出进度信息
-	writeDepth(depth, shadowColorBuffer);  // 将深度缓冲区写入图像
-	depth.write_tga_file("thisoutput/new_depth.tga");  // 保存深度图像
-	std::cerr << "finish writing depth.tga" << std::endl;  // 输出进度信息
-	std::cerr << "Shadow Pass Over" << std::endl << std::endl;  // 输出阶段完成信息
-
-	// 着色通道：从相机角度渲染场景
-	TGAImage frame(SCREEN_WIDTH, SCREEN_HEIGHT, TGAImage::RGB);  // 创建输出图像
-	// 使用Phong着色模型渲染场景
-	PhongShading(modelData, modelTrans, cntModel, zBuffer, colorBuffer, lightVpPV, shadowZBuffer, frame);
-	std::cerr << "finish shading" << std::endl;  // 输出进度信息
-	writeFrame(frame, zBuffer, colorBuffer, CNT_SAMPLE);  // 将渲染结果写入图像
-	frame.write_tga_file("thisoutput/new_frame.tga");  // 保存渲染图像
-	std::cerr << "finish writing frame.tga" << std::endl;  // 输出进度信息
-	std::cerr << "Shading Pass Over" << std::endl << std::endl;  // 输出阶段完成信息
+	// 标记哪些模型作为遮挡体写入遮挡缓冲区
+	bool *modelOccluder = new bool[cntModel];
+	modelOccluder[0] = false; // 人体网格又碎又密，光栅化成遮挡体不划算
+	modelOccluder[1] = true;  // 地板是大面积遮挡体，能挡住它下方/后方的几何体
+
+	// 去掉不属于本进程的模型，保持原来的顺序
+	unsigned cntOwn = 0;
+	for (unsigned m = 0; m < cntModel; ++m)
+	{
+		if (!modelData[m]) continue;
+		modelData[cntOwn] = modelData[m];
+		modelTrans[cntOwn] = modelTrans[m];
+		modelOccluder[cntOwn] = modelOccluder[m];
+		cntOwn++;
+	}
+	cntModel = cntOwn;
+
+	bool ok;
+	if (sortFirstSize)
+	{
+		// 排序在前：协调者渲染并拼接CNT_FRAME_SORT_FIRST帧后输出，工作进程一直渲染分到的横条，直到协调者通知结束
+		SortFirstRenderer sortFirst(renderer, *group);
+		if (sortFirstRank == 0) ok = sortFirst.coordinate(modelData, modelTrans, modelOccluder, cntModel, "thisoutput", CNT_FRAME_SORT_FIRST);
+		else ok = sortFirst.work(modelData, modelTrans, modelOccluder, cntModel);
+	}
+	else
+		ok = renderer.render(modelData, modelTrans, modelOccluder, cntModel, "thisoutput", CNT_FRAME);
 
 	// 释放资源
 	for (unsigned i = 0; i < cntModel; ++i)
@@ -528,10 +344,7 @@ int main()
 	}
 	delete[] modelData;    // 释放模型数组
 	delete[] modelTrans;   // 释放变换矩阵数组
-	delete[] zBuffer;      // 释放深度缓冲区
-	delete[] colorBuffer;  // 释放颜色缓冲区
-	delete[] shadowZBuffer;     // 释放阴影深度缓冲区
-	delete[] shadowColorBuffer; // 释放阴影颜色缓冲区
+	delete[] modelOccluder; // 释放遮挡体标记数组
 
-	return 0;  // 程序正常结束
+	return ok ? 0 : 1;  // 程序正常结束
 }
@@ -1,12 +1,18 @@
 #include <iostream>  // 用于标准输入输出流操作，例如 std::cerr
 #include <fstream>   // 用于文件流操作，例如 std::ifstream
 #include <sstream>   // 用于字符串流操作，例如 std::istringstream
+#include <algorithm> // 用于std::min、std::max
+#include <map>       // 用于std::map，按(顶点, 纹理, 法线)索引合并切线
+#include <tuple>     // 用于std::tuple
 
 #include "model.h"    // 包含Model类的声明
+#include "simd.h"     // 包含SIMD_TARGET_PUSH，纹理采样核心按指令集编译多份
+
+const int MESHLET_SIZE = 64; // 每个网格簇包含的面片数
 
 // Model类的构造函数，负责从.obj文件加载模型数据和纹理
 // 参数 filename: .obj文件的路径
-Model::Model(const std::string filename) : verts_(), uv_(), norms_(), facet_vrt_(), facet_tex_(), facet_nrm_(), diffusemap_(), normalmap_(), specularmap_() {
+Model::Model(const std::string filename) : verts_(), uv_(), norms_(), facet_vrt_(), facet_tex_(), facet_nrm_(), tangents_(), facet_tan_(), diffusemap_(), normalmap_(), specularmap_(), meshlets_(), bboxMin_(), bboxMax_() {
 	std::ifstream in; // 创建一个输入文件流对象
 	in.open(filename, std::ifstream::in); // 以只读方式打开指定的.obj文件
 	if (in.fail()) return; // 如果文件打开失败，则直接返回，不进行后续操作
@@ -53,12 +59,14 @@ Model::Model(const std::string filename) : verts_(), uv_(), norms_(), facet_vrt_
 		}
 	}
 	in.close(); // 完成文件读取后关闭文件流
+	build_meshlets(); // 划分网格簇，供遮挡剔除使用
+	build_tangents(); // 生成顶点切线，渲染时不再逐面求解
 	// 输出加载的模型信息：顶点数，面片数，纹理坐标数，法线向量数
 	std::cerr << "# v# " << nverts() << " f# " << nfaces() << " vt# " << uv_.size() << " vn# " << norms_.size() << std::endl;
 	// 加载纹理贴图，通常与.obj文件同名，但后缀不同
 	load_texture(filename, "_diffuse.tga", diffusemap_);    // 加载漫反射贴图
-	load_texture(filename, "_nm_tangent.tga", normalmap_); // 加载切线空间法线贴图
-	load_texture(filename, "_spec.tga", specularmap_);   // 加载镜面高光贴图
+	hasNormalMap_ = load_texture(filename, "_nm_tangent.tga", normalmap_); // 加载切线空间法线贴图
+	hasSpecularMap_ = load_texture(filename, "_spec.tga", specularmap_);   // 加载镜面高光贴图
 }
 
 // 返回模型中顶点的数量
@@ -83,45 +91,201 @@ Vec3f Model::vert(const int iface, const int nthvert) const {
 	return verts_[facet_vrt_[iface * 3 + nthvert]]; // 再根据此索引从 verts_ 中获取顶点坐标
 }
 
+// 把面片按顺序每MESHLET_SIZE个划分为一个网格簇，并计算每个簇和整个模型的包围盒
+// .obj中相邻的面片通常在空间上也相邻，所以按顺序切分就能得到比较紧凑的簇
+void Model::build_meshlets() {
+	meshlets_.clear();
+	for (int first = 0; first < nfaces(); first += MESHLET_SIZE) {
+		Meshlet meshlet;
+		meshlet.firstFace = first;
+		meshlet.nfaces = std::min(MESHLET_SIZE, nfaces() - first);
+		meshlet.bboxMin = meshlet.bboxMax = vert(first, 0);
+		for (int i = first; i < first + meshlet.nfaces; i++) {
+			for (int j = 0; j < 3; j++) {
+				Vec3f v = vert(i, j);
+				for (int k = 0; k < 3; k++) {
+					meshlet.bboxMin[k] = std::min(meshlet.bboxMin[k], v[k]);
+					meshlet.bboxMax[k] = std::max(meshlet.bboxMax[k], v[k]);
+				}
+			}
+		}
+		// 合并到整个模型的包围盒
+		if (meshlets_.empty()) {
+			bboxMin_ = meshlet.bboxMin;
+			bboxMax_ = meshlet.bboxMax;
+		}
+		for (int k = 0; k < 3; k++) {
+			bboxMin_[k] = std::min(bboxMin_[k], meshlet.bboxMin[k]);
+			bboxMax_[k] = std::max(bboxMax_[k], meshlet.bboxMax[k]);
+		}
+		meshlets_.push_back(meshlet);
+	}
+}
+
+// 为每个顶点生成切线空间 (MikkTSpace的思路)：
+// 1. 对每个面片求解 [e1; e2] = [duv1; duv2] * [T; B]，得到面切线T和面副切线B
+// 2. 位置、纹理坐标、法线都相同的角点才视为同一个顶点，按角点的夹角加权累加T和B
+// 3. 对累加的T做Gram-Schmidt正交化使其垂直于法线，副切线只保留手性 w = sign(dot(cross(n, t), B))
+// 这样着色时只需插值切线，副切线由 cross(n, t) * w 重建，也就不再需要逐面求逆矩阵
+void Model::build_tangents() {
+	std::map<std::tuple<int, int, int>, int> index; // (顶点, 纹理, 法线) -> 切线索引
+	std::vector<Vec3f> accT, accB;                   // 累加的切线和副切线
+	facet_tan_.resize(facet_vrt_.size());
+	for (size_t k = 0; k < facet_vrt_.size(); k++) {
+		auto key = std::make_tuple(facet_vrt_[k], facet_tex_[k], facet_nrm_[k]);
+		auto it = index.find(key);
+		if (it == index.end()) {
+			it = index.emplace(key, int(accT.size())).first;
+			accT.push_back(Vec3f());
+			accB.push_back(Vec3f());
+		}
+		facet_tan_[k] = it->second;
+	}
+
+	for (int i = 0; i < nfaces(); i++) {
+		Vec3f e1 = vert(i, 1) - vert(i, 0), e2 = vert(i, 2) - vert(i, 0);
+		Vec2f d1 = uv(i, 1) - uv(i, 0), d2 = uv(i, 2) - uv(i, 0);
+		float det = d1.x * d2.y - d2.x * d1.y;
+		if (std::fabs(det) < 1e-12f) continue; // 纹理坐标退化的面片无法确定切线方向
+		Vec3f T = (e1 * d2.y - e2 * d1.y) / det;
+		Vec3f B = (e2 * d1.x - e1 * d2.x) / det;
+		if (T.norm() < 1e-12f || B.norm() < 1e-12f) continue;
+		T.normalize();
+		B.normalize();
+		for (int j = 0; j < 3; j++) {
+			// 角点处两条边的夹角作为权重
+			Vec3f a = vert(i, (j + 1) % 3) - vert(i, j), b = vert(i, (j + 2) % 3) - vert(i, j);
+			float la = a.norm(), lb = b.norm();
+			if (la < 1e-12f || lb < 1e-12f) continue;
+			float angle = std::acos(std::max(-1.0f, std::min(1.0f, dot(a, b) / (la * lb))));
+			int t = facet_tan_[i * 3 + j];
+			accT[t] = accT[t] + T * angle;
+			accB[t] = accB[t] + B * angle;
+		}
+	}
+
+	tangents_.resize(accT.size());
+	for (auto &entry : index) {
+		int t = entry.second;
+		Vec3f n = norms_[std::get<2>(entry.first)];
+		Vec3f tanDir = accT[t] - n * dot(n, accT[t]); // Gram-Schmidt：去掉法线方向的分量
+		if (tanDir.norm() < 1e-12f) {
+			// 没有可用的纹理方向时，任取一个垂直于法线的方向
+			tanDir = cross(std::fabs(n.x) < 0.9f ? Vec3f(1, 0, 0) : Vec3f(0, 1, 0), n);
+		}
+		tanDir.normalize();
+		float w = dot(cross(n, tanDir), accB[t]) < 0.0f ? -1.0f : 1.0f;
+		tangents_[t] = Vec4f(tanDir, w);
+	}
+}
+
+// 根据面片索引 iface 和该面片内的顶点序号 nthvert 返回切线 (w为手性)
+Vec4f Model::tangent(const int iface, const int nthvert) const {
+	return tangents_[facet_tan_[iface * 3 + nthvert]];
+}
+
+// 返回网格簇数量
+int Model::nmeshlets() const {
+	return meshlets_.size();
+}
+
+// 根据索引 i 返回网格簇
+const Meshlet &Model::meshlet(const int i) const {
+	return meshlets_[i];
+}
+
+// 返回整个模型包围盒的最小角点
+Vec3f Model::bboxMin() const {
+	return bboxMin_;
+}
+
+// 返回整个模型包围盒的最大角点
+Vec3f Model::bboxMax() const {
+	return bboxMax_;
+}
+
 // 加载纹理文件的私有辅助函数
 // 参数 filename: .obj文件的原始路径名
 // 参数 suffix: 纹理文件的后缀 (例如 "_diffuse.tga")
 // 参数 img: TGAImage 对象，用于存储加载的纹理数据
-void Model::load_texture(std::string filename, const std::string suffix, TGAImage &img) {
+bool Model::load_texture(std::string filename, const std::string suffix, TGAImage &img) {
 	size_t dot = filename.find_last_of("."); // 查找原始文件名中最后一个'.'的位置，用于替换扩展名
-	if (dot == std::string::npos) return; // 如果没有找到'.'，则无法确定基本文件名，直接返回
+	if (dot == std::string::npos) return false; // 如果没有找到'.'，则无法确定基本文件名，直接返回
 	// 构建纹理文件的完整路径：原始文件名的基本部分 + 后缀
 	std::string texfile = filename.substr(0, dot) + suffix;
 	// 尝试读取TGA文件，并输出加载状态（成功或失败）
-	std::cerr << "texture file " << texfile << " loading " << (img.read_tga_file(texfile.c_str()) ? "ok" : "failed") << std::endl;
+	bool ok = img.read_tga_file(texfile.c_str());
+	std::cerr << "texture file " << texfile << " loading " << (ok ? "ok" : "failed") << std::endl;
 	img.flip_vertically(); // TGA图像通常需要垂直翻转以匹配OpenGL等图形API的纹理坐标系约定
+	return ok;
+}
+
+// 纹理采样核心(texturekernel.h)在每个指令集的命名空间里各编译一次，每次采样时按当前的指令集等级选出
+namespace texture_scalar {
+#include "texturekernel.h"
+}
+
+#ifdef SIMD_X86
+SIMD_TARGET_PUSH("sse2")
+namespace texture_sse2 {
+#include "texturekernel.h"
+}
+SIMD_TARGET_POP
+
+SIMD_TARGET_PUSH("avx")
+namespace texture_avx {
+#include "texturekernel.h"
+}
+SIMD_TARGET_POP
+
+SIMD_TARGET_PUSH("avx512f")
+namespace texture_avx512 {
+#include "texturekernel.h"
+}
+SIMD_TARGET_POP
+#endif
+
+// TextureKernels结构：同一个指令集的一组纹理采样核心
+struct TextureKernels
+{
+	TGAColor (*diffuse)(const TGAImage &image, const Vec2f &uv);
+	Vec3f (*normal)(const TGAImage &image, const Vec2f &uv);
+	double (*specular)(const TGAImage &image, const Vec2f &uv);
+};
+
+// textureKernels函数：按指令集等级选出一组核心，没有编译进来的等级退回标量实现
+static const TextureKernels &textureKernels(SimdLevel level)
+{
+	static const TextureKernels scalar = { texture_scalar::sampleDiffuse, texture_scalar::sampleNormal, texture_scalar::sampleSpecular };
+#ifdef SIMD_X86
+	static const TextureKernels sse2 = { texture_sse2::sampleDiffuse, texture_sse2::sampleNormal, texture_sse2::sampleSpecular };
+	static const TextureKernels avx = { texture_avx::sampleDiffuse, texture_avx::sampleNormal, texture_avx::sampleSpecular };
+	static const TextureKernels avx512 = { texture_avx512::sampleDiffuse, texture_avx512::sampleNormal, texture_avx512::sampleSpecular };
+	switch (level)
+	{
+	case SIMD_AVX512: return avx512;
+	case SIMD_AVX: return avx;
+	case SIMD_SSE2: return sse2;
+	default: break;
+	}
+#endif
+	return scalar;
 }
 
 // 根据给定的纹理坐标 uvf 从漫反射贴图中采样颜色
 TGAColor Model::diffuse(const Vec2f &uvf) const {
-	// 将归一化的UV坐标(0到1范围)映射到纹理图像的实际像素坐标
-	// uvf[0] (u) * 纹理宽度, uvf[1] (v) * 纹理高度
-	return diffusemap_.get(uvf[0] * diffusemap_.get_width(), uvf[1] * diffusemap_.get_height());
+	return textureKernels(activeSimdLevel()).diffuse(diffusemap_, uvf);
 }
 
 // 根据给定的纹理坐标 uvf 从法线贴图中采样法线向量
 Vec3f Model::normal(const Vec2f &uvf) const {
-	// 从法线贴图获取对应UV坐标的颜色值
-	TGAColor c = normalmap_.get(uvf[0] * normalmap_.get_width(), uvf[1] * normalmap_.get_height());
-	Vec3f res; // 用于存储转换后的法线向量
-	for (int i = 0; i < 3; i++)
-		// 法线贴图中的颜色值 (0-255) 需要映射到法线向量分量 (-1 到 1)
-		// 映射公式: (color_channel / 255.0) * 2.0 - 1.0
-		// 注意这里 res[2-i] = ... 是因为TGA颜色通道顺序(BGR)和期望法线向量(XYZ)的对应关系
-		res[2 - i] = c[i] / 255. * 2 - 1;
-	return res; // 返回计算得到的法线向量
+	return textureKernels(activeSimdLevel()).normal(normalmap_, uvf);
 }
 
 // 根据给定的纹理坐标 uvf 从镜面高光贴图中采样高光强度值
 // 通常镜面高光贴图是灰度图，只使用一个颜色通道（例如红色通道）的值
 double Model::specular(const Vec2f &uvf) const {
-	// 从镜面高光贴图获取对应UV坐标的像素颜色，并取其第一个颜色通道(通常是R通道)作为高光强度
-	return specularmap_.get(uvf[0] * specularmap_.get_width(), uvf[1] * specularmap_.get_height())[0];
+	return textureKernels(activeSimdLevel()).specular(specularmap_, uvf);
 }
 
 // 根据面片索引 iface 和该面片内的顶点序号 nthvert 返回纹理坐标
@@ -135,3 +299,11 @@ Vec3f Model::normal(const int iface, const int nthvert) const {
 	// facet_nrm_ 存储了面片法线向量索引，iface * 3 + nthvert 定位到具体某个顶点的法线索引
 	return norms_[facet_nrm_[iface * 3 + nthvert]]; // 再根据此索引从 norms_ 列表中获取法线向量
 }
+
+// 统计模型占用的内存：各数组按容量计算，再加上三张纹理的像素数据
+std::size_t Model::memoryBytes() const {
+	return verts_.capacity() * sizeof(Vec3f) + uv_.capacity() * sizeof(Vec2f) + norms_.capacity() * sizeof(Vec3f)
+		+ (facet_vrt_.capacity() + facet_tex_.capacity() + facet_nrm_.capacity() + facet_tan_.capacity()) * sizeof(int)
+		+ tangents_.capacity() * sizeof(Vec4f) + meshlets_.capacity() * sizeof(Meshlet)
+		+ diffusemap_.memory_bytes() + normalmap_.memory_bytes() + specularmap_.memory_bytes();
+}
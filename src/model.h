@@ -6,6 +6,13 @@
 #include "geometry.h"  // 包含自定义的几何运算相关头文件 (例如 Vec2f, Vec3f)
 #include "tgaimage.h"  // 包含自定义的TGA图像处理相关头文件
 
+// 网格簇(meshlet)：一段连续的面片及其模型空间包围盒，用于簇级别的遮挡剔除
+struct Meshlet {
+	int firstFace;          // 第一个面片的索引
+	int nfaces;             // 面片数量
+	Vec3f bboxMin, bboxMax; // 模型空间轴对齐包围盒
+};
+
 // Model类，用于加载和管理3D模型数据
 class Model {
 private:
@@ -15,12 +22,24 @@ private:
 	std::vector<int> facet_vrt_; // 存储每个面片(三角形)的顶点索引，三个一组构成一个三角形
 	std::vector<int> facet_tex_;  // 存储每个面片(三角形)的纹理坐标索引，三个一组构成一个三角形
 	std::vector<int> facet_nrm_;  // 存储每个面片(三角形)的法线向量索引，三个一组构成一个三角形
+	std::vector<Vec4f> tangents_; // 存储每个顶点的切线 (tx, ty, tz, w)，w为副切线的手性(+1或-1)
+	std::vector<int> facet_tan_;  // 存储每个面片(三角形)的切线索引，三个一组构成一个三角形
 	TGAImage diffusemap_;         // 漫反射贴图对象，存储颜色信息
 	TGAImage normalmap_;          // 法线贴图对象，存储表面法线扰动信息
 	TGAImage specularmap_;        // 镜面高光贴图对象，存储表面高光强度信息
+	bool hasNormalMap_ = false;   // 法线贴图是否加载成功
+	bool hasSpecularMap_ = false; // 镜面高光贴图是否加载成功
+	std::vector<Meshlet> meshlets_; // 按面片顺序划分的网格簇
+	Vec3f bboxMin_, bboxMax_;     // 整个模型的模型空间包围盒
+
+	// 私有辅助函数，加载完面片后划分网格簇并计算包围盒
+	void build_meshlets();
 
-	// 私有辅助函数，用于加载纹理文件
-	void load_texture(const std::string filename, const std::string suffix, TGAImage &img);
+	// 私有辅助函数，加载完面片后为每个顶点生成切线和手性
+	void build_tangents();
+
+	// 私有辅助函数，用于加载纹理文件，返回是否加载成功
+	bool load_texture(const std::string filename, const std::string suffix, TGAImage &img);
 
 public:
 	// 构造函数，从指定的.obj文件加载模型
@@ -35,6 +54,9 @@ public:
 	// 获取指定面片、指定顶点的法线向量
 	Vec3f normal(const int iface, const int nthvert) const;
 
+	// 获取指定面片、指定顶点的切线 (w分量为副切线手性)
+	Vec4f tangent(const int iface, const int nthvert) const;
+
 	// 根据UV坐标从法线贴图中采样法线向量
 	Vec3f normal(const Vec2f &uv) const;
 
@@ -52,4 +74,21 @@ public:
 
 	// 根据UV坐标从镜面高光贴图中采样高光强度值 (通常是灰度值)
 	double specular(const Vec2f &uv) const;
+
+	// 是否有法线贴图/镜面高光贴图，没有时对应的采样函数返回0，材质据此选择着色器的变体
+	bool hasNormalMap() const { return hasNormalMap_; }
+	bool hasSpecularMap() const { return hasSpecularMap_; }
+
+	// 获取网格簇数量
+	int nmeshlets() const;
+
+	// 获取指定索引的网格簇
+	const Meshlet &meshlet(const int i) const;
+
+	// 获取整个模型的包围盒
+	Vec3f bboxMin() const;
+	Vec3f bboxMax() const;
+
+	// 模型占用的内存(字节)：几何数据、网格簇和所有纹理，资源缓存按它计算预算
+	std::size_t memoryBytes() const;
 };
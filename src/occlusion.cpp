@@ -0,0 +1,283 @@
+#include <cmath>      // 包含数学函数库，提供floor、fabs等函数
+#include <limits>     // 包含数值极限，提供float的最大值
+#include <algorithm>  // 包含算法库，提供min、max等算法函数
+
+#include "occlusion.h" // 包含OcclusionBuffer类的声明
+#include "gl.h"        // 包含viewport等变换函数
+#include "simd.h"      // 包含SIMD_TARGET_PUSH和指令集等级，子块掩码按指令集编译多份
+
+// 构造函数：根据像素尺寸计算子块数量，并清空缓冲区
+OcclusionBuffer::OcclusionBuffer(unsigned width, unsigned height)
+	: width_(width), height_(height),
+	  tilesX_((width + SUBTILE_W - 1) / SUBTILE_W), tilesY_((height + SUBTILE_H - 1) / SUBTILE_H),
+	  vp_(viewport(width, height)), subtiles_(tilesX_ * tilesY_)
+{
+	clear();
+}
+
+// clear函数：重置所有子块，参考层为无限远(没有遮挡)，工作层为空
+void OcclusionBuffer::clear()
+{
+	for (auto &tile : subtiles_)
+	{
+		tile.mask = 0;
+		tile.zRef = -std::numeric_limits<float>::max();
+		tile.zWork = std::numeric_limits<float>::max();
+	}
+}
+
+// pixelIndex函数：把浮点坐标向下取整成像素索引，并限制在[-1, size]内，避免极大的坐标转int溢出
+static int pixelIndex(float v, unsigned size)
+{
+	return int(std::max(-1.0f, std::min(float(size), std::floor(v))));
+}
+
+// subtileMask函数：计算子块(sx, sy)中被三角形覆盖的像素的掩码
+// 参数：a,b,c - 三条边的边函数系数 E(x,y) = a*x + b*y + c，c中已经加入了到像素中心的偏移
+//      所以只需在像素角点(px, py)处求值，E >= 0 就说明像素中心在这条边内侧
+// 返回：32位掩码，第(y*8+x)位对应子块内像素(x, y)
+// 每个指令集一份实现，都按 a*x + (b*y + c) 的顺序求值，结果完全相同；运行时由subtileMaskKernel选出
+namespace occlusion_scalar {
+static std::uint32_t subtileMask(const float *a, const float *b, const float *c, int sx, int sy)
+{
+	std::uint32_t mask = 0;
+	for (int r = 0; r < OcclusionBuffer::SUBTILE_H; ++r)
+	{
+		float y = float(sy + r);
+		for (int i = 0; i < OcclusionBuffer::SUBTILE_W; ++i)
+		{
+			float x = float(sx + i);
+			bool inside = true;
+			for (int e = 0; e < 3; ++e)
+				inside = inside && (a[e] * x + (b[e] * y + c[e]) >= 0.0f);
+			if (inside) mask |= 1u << (r * OcclusionBuffer::SUBTILE_W + i);
+		}
+	}
+	return mask;
+}
+}
+
+#ifdef SIMD_X86
+// SSE2：每次处理一行中的4个像素
+SIMD_TARGET_PUSH("sse2")
+namespace occlusion_sse2 {
+static std::uint32_t subtileMask(const float *a, const float *b, const float *c, int sx, int sy)
+{
+	std::uint32_t mask = 0;
+	const __m128 lane = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f); // 4个相邻像素的x偏移
+	const __m128 zero = _mm_setzero_ps();
+	for (int r = 0; r < OcclusionBuffer::SUBTILE_H; ++r)
+	{
+		float y = float(sy + r);
+		for (int g = 0; g < OcclusionBuffer::SUBTILE_W; g += 4)
+		{
+			__m128 vx = _mm_add_ps(_mm_set1_ps(float(sx + g)), lane);
+			__m128 inside = _mm_cmpeq_ps(zero, zero); // 全1掩码
+			for (int e = 0; e < 3; ++e)
+			{
+				__m128 v = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[e]), vx), _mm_set1_ps(b[e] * y + c[e]));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(v, zero)); // 三条边都要在内侧
+			}
+			mask |= std::uint32_t(_mm_movemask_ps(inside)) << (r * OcclusionBuffer::SUBTILE_W + g);
+		}
+	}
+	return mask;
+}
+}
+SIMD_TARGET_POP
+
+// AVX：子块的一行正好8个像素，一次算完一行
+SIMD_TARGET_PUSH("avx")
+namespace occlusion_avx {
+static std::uint32_t subtileMask(const float *a, const float *b, const float *c, int sx, int sy)
+{
+	static_assert(OcclusionBuffer::SUBTILE_W == 8, "AVX实现要求子块一行是8个像素");
+	std::uint32_t mask = 0;
+	const __m256 vx = _mm256_add_ps(_mm256_set1_ps(float(sx)), _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+	const __m256 zero = _mm256_setzero_ps();
+	for (int r = 0; r < OcclusionBuffer::SUBTILE_H; ++r)
+	{
+		float y = float(sy + r);
+		__m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ); // 全1掩码
+		for (int e = 0; e < 3; ++e)
+		{
+			__m256 v = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(a[e]), vx), _mm256_set1_ps(b[e] * y + c[e]));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+		}
+		mask |= std::uint32_t(_mm256_movemask_ps(inside)) << (r * OcclusionBuffer::SUBTILE_W);
+	}
+	return mask;
+}
+}
+SIMD_TARGET_POP
+#endif
+
+// subtileMaskKernel函数：按指令集等级选出子块掩码的实现
+// 子块只有8x4个像素，AVX-512没有更宽的用武之地，和AVX用同一份；没有编译进来的等级退回标量实现
+static OcclusionBuffer::MaskKernel subtileMaskKernel(SimdLevel level)
+{
+#ifdef SIMD_X86
+	switch (level)
+	{
+	case SIMD_AVX512:
+	case SIMD_AVX: return occlusion_avx::subtileMask;
+	case SIMD_SSE2: return occlusion_sse2::subtileMask;
+	default: break;
+	}
+#endif
+	return occlusion_scalar::subtileMask;
+}
+
+// updateSubtile函数：把三角形在子块内的覆盖合并进子块 (Masked Occlusion的双层合并规则)
+// 参数：tile - 目标子块，mask - 三角形在子块内完全覆盖的像素，zTri - 三角形在子块内的最远深度
+void OcclusionBuffer::updateSubtile(Subtile &tile, std::uint32_t mask, float zTri)
+{
+	if (zTri <= tile.zRef) return; // 三角形比参考层还远，不能提供新的遮挡信息
+
+	// 启发式：新三角形离工作层比工作层离参考层还远时，丢弃旧的工作层重新开始
+	// 否则工作层深度会被很远的三角形一直往后拖，参考层仍然有效，所以这一步是保守的
+	if (tile.mask && zTri - tile.zWork > tile.zWork - tile.zRef)
+	{
+		tile.mask = 0;
+		tile.zWork = std::numeric_limits<float>::max();
+	}
+
+	tile.zWork = std::min(tile.zWork, zTri); // 工作层深度取所有合并三角形中最远的
+	tile.mask |= mask;
+
+	if (tile.mask == 0xffffffffu) // 工作层覆盖满了整个子块，把它提升为参考层
+	{
+		tile.zRef = std::max(tile.zRef, tile.zWork);
+		tile.mask = 0;
+		tile.zWork = std::numeric_limits<float>::max();
+	}
+}
+
+// renderTriangle函数：光栅化一个遮挡三角形，按当前的指令集等级选出子块掩码的实现
+void OcclusionBuffer::renderTriangle(const Vec3f *screenCoords)
+{
+	renderTriangle(screenCoords, subtileMaskKernel(activeSimdLevel()));
+}
+
+// renderTriangle函数：用给定的子块掩码实现光栅化一个遮挡三角形
+// 深度取三角形在子块范围内的最远值，所以记录的遮挡深度永远不会比真实情况更近
+void OcclusionBuffer::renderTriangle(const Vec3f *p, MaskKernel subtileMask)
+{
+	// 计算有向面积，退化三角形直接跳过
+	float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+	if (std::fabs(area) < 1e-8f) return;
+	float sign = area > 0.0f ? 1.0f : -1.0f; // 遮挡体不区分正反面，统一翻转成内部为正
+
+	// 构造三条边的边函数，并把c偏移到像素中心
+	// 用像素中心而不是整个像素做覆盖判断，共享边两侧的三角形才能拼成完整的覆盖，不会留下一条缝
+	float a[3], b[3], c[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		const Vec3f &v0 = p[i], &v1 = p[(i + 1) % 3];
+		a[i] = (v0.y - v1.y) * sign;
+		b[i] = (v1.x - v0.x) * sign;
+		c[i] = -(a[i] * v0.x + b[i] * v0.y);
+		c[i] += 0.5f * (a[i] + b[i]);
+	}
+
+	// 深度平面方程 z = p0.z + dzdx*(x-p0.x) + dzdy*(y-p0.y)
+	float dzdx = ((p[1].z - p[0].z) * (p[2].y - p[0].y) - (p[2].z - p[0].z) * (p[1].y - p[0].y)) / area;
+	float dzdy = ((p[2].z - p[0].z) * (p[1].x - p[0].x) - (p[1].z - p[0].z) * (p[2].x - p[0].x)) / area;
+	float zMinVert = std::min(p[0].z, std::min(p[1].z, p[2].z)); // 三角形本身的最远深度
+
+	// 三角形包围盒 (像素)，裁剪到缓冲区范围内
+	float xmin = std::min(p[0].x, std::min(p[1].x, p[2].x)), xmax = std::max(p[0].x, std::max(p[1].x, p[2].x));
+	float ymin = std::min(p[0].y, std::min(p[1].y, p[2].y)), ymax = std::max(p[0].y, std::max(p[1].y, p[2].y));
+	int px0 = pixelIndex(std::max(0.0f, xmin), width_), px1 = pixelIndex(std::min(float(width_ - 1), xmax), width_);
+	int py0 = pixelIndex(std::max(0.0f, ymin), height_), py1 = pixelIndex(std::min(float(height_ - 1), ymax), height_);
+	if (px0 > px1 || py0 > py1) return;
+
+	for (int ty = py0 / SUBTILE_H; ty <= py1 / SUBTILE_H; ++ty)
+	{
+		for (int tx = px0 / SUBTILE_W; tx <= px1 / SUBTILE_W; ++tx)
+		{
+			int sx = tx * SUBTILE_W, sy = ty * SUBTILE_H;
+			std::uint32_t mask = subtileMask(a, b, c, sx, sy);
+			if (!mask) continue;
+
+			// 平面在子块四个角中的最小值就是三角形在子块内的最远深度，再用顶点最远深度限制一下
+			float zCorner = p[0].z + dzdx * (sx - p[0].x) + dzdy * (sy - p[0].y)
+				+ std::min(dzdx * SUBTILE_W, 0.0f) + std::min(dzdy * SUBTILE_H, 0.0f);
+			updateSubtile(subtiles_[ty * tilesX_ + tx], mask, std::max(zCorner, zMinVert));
+		}
+	}
+}
+
+// renderOccluder函数：把模型的所有面光栅化为遮挡体
+// 与近/远平面相交的三角形先用homogeneousClip裁剪，再把裁剪出的多边形按扇形拆成三角形
+void OcclusionBuffer::renderOccluder(const Model &model, const Matrix &PVM)
+{
+	// 顶点列表都很短，放在栈上的缓冲区里，不分配堆内存
+	alignas(Vertex) char stack[16 * sizeof(Vertex)];
+	std::pmr::monotonic_buffer_resource local(stack, sizeof(stack));
+	VertexList original(3, &local), clipped(&local);  // 裁剪只需要clipCoord，其余属性留空
+	std::pmr::vector<Vec3f> polygon(&local);          // 裁剪后多边形的缓冲区坐标
+	clipped.reserve(8);
+	polygon.reserve(8);
+	MaskKernel subtileMask = subtileMaskKernel(activeSimdLevel());  // 按指令集选一次，所有面共用
+	for (int i = 0; i < model.nfaces(); ++i)
+	{
+		for (int j = 0; j < 3; ++j)
+			original[j].clipCoord = PVM * embed<4>(model.vert(i, j));
+		clipped.clear();
+		homogeneousClip(original, clipped, 2);
+		if (clipped.size() < 3) continue;  // 完全在近/远平面之外
+
+		// 透视除法 + 视口变换，得到缓冲区坐标
+		polygon.clear();
+		for (const auto &vertex : clipped)
+		{
+			Vec4f screenCoord = vp_ * (vertex.clipCoord / vertex.clipCoord.w);
+			polygon.push_back(Vec3f(screenCoord.x, screenCoord.y, screenCoord.z));
+		}
+		for (size_t j = 1; j + 1 < polygon.size(); ++j)
+		{
+			Vec3f screenCoords[3] = { polygon[0], polygon[j], polygon[j + 1] };
+			renderTriangle(screenCoords, subtileMask);
+		}
+	}
+}
+
+// testAABB函数：把包围盒的8个角投影到缓冲区，用屏幕矩形和最近深度做遮挡测试
+// 包围盒与近/远平面相交时无法给出可靠的矩形，保守地认为可见
+bool OcclusionBuffer::testAABB(const Vec3f &bmin, const Vec3f &bmax, const Matrix &PVM) const
+{
+	float xmin = std::numeric_limits<float>::max(), ymin = xmin;
+	float xmax = -std::numeric_limits<float>::max(), ymax = xmax, zNear = xmax;
+	for (int i = 0; i < 8; ++i)
+	{
+		Vec4f corner(i & 1 ? bmax.x : bmin.x, i & 2 ? bmax.y : bmin.y, i & 4 ? bmax.z : bmin.z, 1.0f);
+		Vec4f clipCoord = PVM * corner;
+		if (clipCoord.w == 0.0f || std::fabs(clipCoord.z / clipCoord.w) > 1.0f) return true;
+		Vec4f screenCoord = vp_ * (clipCoord / clipCoord.w);
+		xmin = std::min(xmin, screenCoord.x);
+		xmax = std::max(xmax, screenCoord.x);
+		ymin = std::min(ymin, screenCoord.y);
+		ymax = std::max(ymax, screenCoord.y);
+		zNear = std::max(zNear, screenCoord.z);
+	}
+	return testRect(xmin, ymin, xmax, ymax, zNear);
+}
+
+// testRect函数：矩形覆盖的任一子块的参考层不比zNear近，就认为可能可见
+// 完全在缓冲区外的矩形不会产生任何像素，直接判定为不可见
+bool OcclusionBuffer::testRect(float xmin, float ymin, float xmax, float ymax, float zNear) const
+{
+	int px0 = pixelIndex(std::max(0.0f, xmin), width_), px1 = pixelIndex(std::min(float(width_ - 1), xmax), width_);
+	int py0 = pixelIndex(std::max(0.0f, ymin), height_), py1 = pixelIndex(std::min(float(height_ - 1), ymax), height_);
+	if (px0 > px1 || py0 > py1) return false;
+
+	for (int ty = py0 / SUBTILE_H; ty <= py1 / SUBTILE_H; ++ty)
+	{
+		for (int tx = px0 / SUBTILE_W; tx <= px1 / SUBTILE_W; ++tx)
+		{
+			if (zNear >= subtiles_[ty * tilesX_ + tx].zRef) return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,61 @@
+#pragma once // 防止头文件被重复包含
+
+#include <vector>      // 包含std::vector容器
+#include <cstdint>     // 包含std::uint32_t
+
+#include "geometry.h"  // 包含自定义的几何运算相关头文件 (例如 Vec3f, Matrix)
+#include "model.h"     // 包含Model类和Meshlet结构
+
+// OcclusionBuffer类：Masked Software Occlusion Culling风格的低分辨率遮挡缓冲区
+// 缓冲区被划分为8x4像素的子块(subtile)，每个子块只存一个32位覆盖掩码和两层深度，而不是逐像素深度：
+//   zRef  - 参考层：整个子块都被遮挡体覆盖时，遮挡体中最远的深度
+//   zWork - 工作层：当前尚未覆盖满子块的那些遮挡三角形中最远的深度，mask记录它们的覆盖情况
+// 深度约定与zBuffer相同：z越大越靠近相机
+class OcclusionBuffer {
+public:
+	static const int SUBTILE_W = 8; // 子块宽度 (像素)
+	static const int SUBTILE_H = 4; // 子块高度 (像素)，8x4正好是一个32位掩码
+
+	// 构造函数，创建width*height像素的遮挡缓冲区 (通常比屏幕分辨率低)
+	OcclusionBuffer(unsigned width, unsigned height);
+
+	// 清空缓冲区，所有子块都变为"没有遮挡"
+	void clear();
+
+	// 把模型的所有面作为遮挡体光栅化到缓冲区
+	// PVM: 投影 * 视图 * 模型 矩阵，把模型空间顶点变换到裁剪空间
+	void renderOccluder(const Model &model, const Matrix &PVM);
+
+	// 光栅化一个遮挡三角形，screenCoords为缓冲区坐标系下的(x, y, z)
+	void renderTriangle(const Vec3f *screenCoords);
+
+	// 测试模型空间轴对齐包围盒是否可能可见，返回false表示被遮挡
+	bool testAABB(const Vec3f &bmin, const Vec3f &bmax, const Matrix &PVM) const;
+
+	// 测试缓冲区坐标系下的矩形在最近深度zNear处是否可能可见
+	bool testRect(float xmin, float ymin, float xmax, float ymax, float zNear) const;
+
+	unsigned get_width() const { return width_; }   // 获取缓冲区宽度
+	unsigned get_height() const { return height_; } // 获取缓冲区高度
+
+	// 子块掩码的实现(见occlusion.cpp)，每个指令集一份，返回三角形在子块(sx, sy)中覆盖的像素
+	typedef std::uint32_t (*MaskKernel)(const float *a, const float *b, const float *c, int sx, int sy);
+
+private:
+	struct Subtile {
+		std::uint32_t mask; // 工作层的覆盖掩码，第(y*8+x)位对应子块内像素(x, y)
+		float zRef;         // 参考层深度
+		float zWork;        // 工作层深度
+	};
+
+	unsigned width_, height_;         // 缓冲区尺寸 (像素)
+	unsigned tilesX_, tilesY_;        // 子块的列数和行数
+	Matrix vp_;                       // 缓冲区的视口变换矩阵
+	std::vector<Subtile> subtiles_;   // 所有子块，按行优先存储
+
+	// 用选好的子块掩码实现光栅化一个遮挡三角形，renderOccluder每个模型只选一次
+	void renderTriangle(const Vec3f *screenCoords, MaskKernel subtileMask);
+
+	// 把一个三角形在某个子块中的覆盖掩码和保守深度合并进子块
+	void updateSubtile(Subtile &tile, std::uint32_t mask, float zTri);
+};
@@ -0,0 +1,235 @@
+// 光栅化核心：三角形按块遍历，逐行、印章和压缩深度分块三条路径，以及它们共用的透视校正插值
+// 注意：这个文件没有#pragma once，gl.cpp在每个指令集的命名空间里各包含一次，每次用不同的编译目标编译同一份代码
+// 这里都是标量代码，宽向量上的代码由编译器按目标指令集生成；各命名空间中的浮点运算顺序相同，没有乘加融合，
+// 因此不同指令集光栅化的结果完全相同
+
+// pixelVaryings函数：在像素(x, y)中心做透视校正插值，顶点着色器已经把插值变量除以w，这里乘回w
+// 1/w接近0时返回false，这个像素不着色。所有光栅化路径都用它，插值结果与遍历顺序无关
+static bool pixelVaryings(const TriangleSetup &setup, int x, int y, float *varying)
+{
+	float wMiddle = planeAtCenter(setup.w, setup.x0, setup.y0, x, y);
+	if (fabs(wMiddle) < 1e-7) return false; // 避免除以接近零的数
+	float invW = 1.0f / wMiddle;
+	for (unsigned k = 0; k < setup.nvaryings; ++k)
+		varying[k] = planeAtCenter(setup.varying[k], setup.x0, setup.y0, x, y) * invW;
+	return true;
+}
+
+// rasterSpan函数：光栅化三角形在第y行上[xBegin, xEnd]之间的像素
+// 参数：full为true表示这些像素的所有采样点都在三角形内部，跳过覆盖测试，只做深度测试
+// 重心坐标、z/w、1/w在每个像素左下角(x, y)处用平面方程求值(不沿x累加，见planeAt)，采样点再加上偏移的增量；
+// 插值变量只在像素第一次有采样点通过时在像素中心求值
+static void rasterSpan(const TriangleSetup &setup, const SampleDeltas &delta, const IShader &shader, Vec3f *colorBuffer, float *zBuffer,
+	unsigned width, unsigned cntSample, int y, int xBegin, int xEnd, bool full)
+{
+	float varying[MAX_VARYINGS];           // 当前像素透视校正后的插值变量
+
+	for (int x = xBegin; x <= xEnd; ++x)
+	{
+		float bar[3], z, w;                // 当前像素左下角的重心坐标、z/w、1/w
+		for (int j = 0; j < 3; ++j)
+			bar[j] = planeAt(setup.bar[j], setup.x0, setup.y0, x, y);
+		z = planeAt(setup.z, setup.x0, setup.y0, x, y);
+		w = planeAt(setup.w, setup.x0, setup.y0, x, y);
+
+		// 计算每个像素的多个采样点的颜色和深度
+		Vec3f color;                   // color存储颜色
+		bool covered = false;          // 标记该像素是否被三角形覆盖
+
+		for (unsigned i = 0; i < cntSample; ++i) // 遍历每个采样点
+		{
+			unsigned idx = cntSample * (y*width + x) + i; // 计算采样点在缓冲区中的索引, 索引是像素的索引乘以采样点数加上采样点索引
+
+			if (!full && (bar[0] + delta.bar[i][0] < 0 || bar[1] + delta.bar[i][1] < 0 || bar[2] + delta.bar[i][2] < 0)) continue; // 采样点不在三角形内部
+			float zSample = (z + delta.z[i]) / (w + delta.w[i]);  // 透视校正后的深度
+			if (zSample < zBuffer[idx]) continue; // 采样点被遮挡
+
+			if (!covered) // 如果这是该像素第一次被覆盖，计算颜色
+			{
+				if (!pixelVaryings(setup, x, y, varying)) break;
+				if (!shader.fragment(varying, color)) break; // 调用片段着色器计算颜色，若返回false则跳过该像素
+				covered = true;        // 标记该像素已被覆盖
+			}
+
+			colorBuffer[idx] = color;  // 将颜色写入颜色缓冲区
+			zBuffer[idx] = zSample;    // 将深度写入深度缓冲区
+		}
+	}
+}
+
+// rasterStamp函数：小三角形的印章路径
+// 覆盖掩码在设置阶段已经算好，这里只遍历有采样点被覆盖的像素：深度和插值变量直接用平面方程求值，
+// 没有包围盒循环、块分类和逐采样点的覆盖测试
+static void rasterStamp(const TriangleSetup &setup, const SampleDeltas &delta, const IShader &shader, Vec3f *colorBuffer, float *zBuffer,
+	unsigned width, unsigned cntSample, Vec2i rectMin, Vec2i rectMax)
+{
+	uint64_t pixelMask = (cntSample == 64 ? ~uint64_t(0) : (uint64_t(1) << cntSample) - 1);  // 一个像素所有采样点的位
+	float varying[MAX_VARYINGS];
+	for (unsigned p = 0; p < setup.stamp * setup.stamp; ++p)
+	{
+		uint64_t mask = (setup.coverage >> (p * cntSample)) & pixelMask;
+		if (!mask) continue;
+		int x = setup.bboxmin.x + int(p % setup.stamp), y = setup.bboxmin.y + int(p / setup.stamp);
+		if (x < rectMin.x || x > rectMax.x || y < rectMin.y || y > rectMax.y) continue;
+		float z = planeAt(setup.z, setup.x0, setup.y0, x, y);
+		float w = planeAt(setup.w, setup.x0, setup.y0, x, y);
+
+		Vec3f color;
+		bool covered = false;
+		for (unsigned i = 0; i < cntSample; ++i)
+		{
+			if (!(mask >> i & 1)) continue;
+			float zSample = (z + delta.z[i]) / (w + delta.w[i]);
+			unsigned idx = cntSample * (y*width + x) + i;
+			if (zSample < zBuffer[idx]) continue;
+
+			if (!covered)
+			{
+				// 在像素中心做透视校正插值，与通用路径相同
+				if (!pixelVaryings(setup, x, y, varying)) break;
+				if (!shader.fragment(varying, color)) break;
+				covered = true;
+			}
+
+			colorBuffer[idx] = color;
+			zBuffer[idx] = zSample;
+		}
+	}
+}
+
+// rasterBlockCompressed函数：在压缩的深度分块上光栅化块内[x0, x1] x [y0, y1]的像素
+// 新旧深度都用evalDepth在采样点上求值，深度测试不碰原始缓冲区；覆盖测试和插值与rasterSpan的算法相同，full为true时跳过覆盖测试
+// 一个像素的采样点全部测试完再着色，片段被丢弃时这个像素的采样点都不写，与rasterSpan相同，因此结果与不压缩时逐位相同
+// 块内所有通过的采样点最后交给DepthTiles::merge，合并成新的平面或者解压
+static void rasterBlockCompressed(const TriangleSetup &setup, const SampleDeltas &delta, const IShader &shader, Vec3f *colorBuffer, float *zBuffer,
+	unsigned width, DepthTiles &depthTiles, int bx, int by, int x0, int x1, int y0, int y1, bool full)
+{
+	DepthTile &tile = depthTiles.tile(bx / RASTER_BLOCK, by / RASTER_BLOCK);
+	DepthPlane plane = { setup.x0, setup.y0, setup.z, setup.w };
+	unsigned cntSample = depthTiles.cntSample();
+	uint64_t pass[DEPTH_MASK_WORDS] = {};  // 通过深度测试并写入的采样点
+	bool written = false;
+	float varying[MAX_VARYINGS];
+
+	for (int y = y0; y <= y1; ++y)
+	{
+		for (int x = x0; x <= x1; ++x)
+		{
+			unsigned first = ((y - by) * RASTER_BLOCK + (x - bx)) * cntSample;  // 像素的第一个采样点在掩码中的位置
+			unsigned pixelPass = 0;
+			float bar[3];  // 像素左下角的重心坐标
+			for (int j = 0; j < 3; ++j)
+				bar[j] = planeAt(setup.bar[j], setup.x0, setup.y0, x, y);
+			for (unsigned i = 0; i < cntSample; ++i)
+			{
+				if (!full && (bar[0] + delta.bar[i][0] < 0 || bar[1] + delta.bar[i][1] < 0 || bar[2] + delta.bar[i][2] < 0)) continue;
+				if (evalDepth(plane, x, y, depthTiles.sample(i)) < depthTiles.depth(tile, first + i, x, y, i)) continue;
+				pixelPass |= 1u << i;
+			}
+			if (!pixelPass) continue;
+
+			// 在像素中心做透视校正插值，与通用路径相同
+			if (!pixelVaryings(setup, x, y, varying)) continue;
+			Vec3f color;
+			if (!shader.fragment(varying, color)) continue;
+
+			for (unsigned i = 0; i < cntSample; ++i)
+			{
+				if (!(pixelPass >> i & 1)) continue;
+				colorBuffer[cntSample * (y*width + x) + i] = color;
+				pass[(first + i) / 64] |= uint64_t(1) << ((first + i) % 64);
+			}
+			written = true;
+		}
+	}
+	if (written)
+		depthTiles.merge(tile, pass, plane, zBuffer, bx, by);
+}
+
+// triangle函数：三角形光栅化
+// 参数：setup - 三角形设置的结果(包围盒和平面方程)，shader - 着色器对象，
+//      colorBuffer - 颜色缓冲区，zBuffer - 深度缓冲区，
+//      width - 屏幕宽度(缓冲区的行距)，包围盒已经在设置阶段裁到屏幕内，不再需要高度，
+//      d - MSAA采样点偏移数组，cntSample - 每像素采样点数量
+
+// 三角形设置已经在几何阶段批量完成，这里按屏幕上对齐的RASTER_BLOCK x RASTER_BLOCK像素块分层遍历包围盒：
+// 重心坐标是线性的，在块内所有采样点构成的矩形的四个角上求值就能得到它在块内的范围
+//   某个重心坐标在整个块内都小于0：块在三角形外，整块跳过
+//   三个重心坐标在整个块内都大于0：块完全在三角形内，逐采样点的覆盖测试可以省掉
+//   其余情况：部分覆盖，逐采样点测试
+// 判断时留了一点余量，落在边上的采样点总是走逐采样点的测试，结果与不分块时完全一致
+// 设置阶段选了印章路径的小三角形(setup.stamp不为0)直接交给rasterStamp，
+// 此时d和cntSample必须与设置时DrawCall中的采样点相同
+// rectMin/rectMax限定只写入这个像素矩形(分块光栅化时为分块的范围)，矩形按RASTER_BLOCK对齐时块的划分与不限定时相同
+// depthTiles不为空时深度缓冲区按块压缩(见DepthTiles)，仍处于压缩状态的块交给rasterBlockCompressed
+static void triangle(const TriangleSetup &setup, const IShader &shader, Vec3f *colorBuffer, float *zBuffer, unsigned width, const float d[][2], unsigned cntSample,
+	Vec2i rectMin, Vec2i rectMax, DepthTiles *depthTiles)
+{
+	assert(cntSample <= MAX_SAMPLES);
+
+	SampleDeltas delta;
+	float dMin[2] = { d[0][0], d[0][1] }, dMax[2] = { d[0][0], d[0][1] };  // 采样点偏移的范围
+	for (unsigned i = 0; i < cntSample; ++i)
+	{
+		for (int j = 0; j < 3; ++j)
+			delta.bar[i][j] = planeDelta(setup.bar[j], d[i]);
+		delta.z[i] = planeDelta(setup.z, d[i]);  // 与evalDepth中的增量相同
+		delta.w[i] = planeDelta(setup.w, d[i]);
+		for (int j = 0; j < 2; ++j)
+		{
+			dMin[j] = std::min(dMin[j], d[i][j]);
+			dMax[j] = std::max(dMax[j], d[i][j]);
+		}
+	}
+	if (setup.stamp)
+	{
+		// 小三角形的平面几乎不可能留在压缩分块里，直接把它碰到的分块解压
+		if (depthTiles)
+		{
+			for (int y = std::max(setup.bboxmin.y, rectMin.y); y <= std::min(setup.bboxmax.y, rectMax.y); ++y)
+				for (int x = std::max(setup.bboxmin.x, rectMin.x); x <= std::min(setup.bboxmax.x, rectMax.x); ++x)
+				{
+					int bx = x & ~(RASTER_BLOCK - 1), by = y & ~(RASTER_BLOCK - 1);
+					depthTiles->decompress(depthTiles->tile(bx / RASTER_BLOCK, by / RASTER_BLOCK), zBuffer, bx, by);
+				}
+		}
+		rasterStamp(setup, delta, shader, colorBuffer, zBuffer, width, cntSample, rectMin, rectMax);
+		return;
+	}
+
+	Vec2i lo(std::max(setup.bboxmin.x, rectMin.x), std::max(setup.bboxmin.y, rectMin.y));  // 包围盒与矩形的交
+	Vec2i hi(std::min(setup.bboxmax.x, rectMax.x), std::min(setup.bboxmax.y, rectMax.y));
+	const float eps = 1e-5f;  // 分类的余量
+	for (int by = lo.y & ~(RASTER_BLOCK - 1); by <= hi.y; by += RASTER_BLOCK)
+	{
+		int y0 = std::max(by, lo.y), y1 = std::min(by + RASTER_BLOCK - 1, hi.y);
+		for (int bx = lo.x & ~(RASTER_BLOCK - 1); bx <= hi.x; bx += RASTER_BLOCK)
+		{
+			int x0 = std::max(bx, lo.x), x1 = std::min(bx + RASTER_BLOCK - 1, hi.x);
+
+			// 块内采样点矩形的四个角，相对平面方程的原点
+			float sx0 = x0 + dMin[0] - setup.x0, sx1 = x1 + dMax[0] - setup.x0;
+			float sy0 = y0 + dMin[1] - setup.y0, sy1 = y1 + dMax[1] - setup.y0;
+			bool outside = false, full = true;
+			for (int j = 0; j < 3 && !outside; ++j)
+			{
+				const Plane &e = setup.bar[j];
+				// 线性函数的最小/最大值在角上取到，按梯度的符号直接选角
+				float eMin = e.q0 + e.dqdx * (e.dqdx > 0 ? sx0 : sx1) + e.dqdy * (e.dqdy > 0 ? sy0 : sy1);
+				float eMax = e.q0 + e.dqdx * (e.dqdx > 0 ? sx1 : sx0) + e.dqdy * (e.dqdy > 0 ? sy1 : sy0);
+				if (eMax < -eps) outside = true;
+				if (eMin <= eps) full = false;
+			}
+			if (outside) continue;
+
+			// 深度分块仍是压缩的：走平面路径，不读写原始深度
+			if (depthTiles && depthTiles->tile(bx / RASTER_BLOCK, by / RASTER_BLOCK).state != DEPTH_RAW)
+			{
+				rasterBlockCompressed(setup, delta, shader, colorBuffer, zBuffer, width, *depthTiles, bx, by, x0, x1, y0, y1, full);
+				continue;
+			}
+			for (int y = y0; y <= y1; ++y)
+				rasterSpan(setup, delta, shader, colorBuffer, zBuffer, width, cntSample, y, x0, x1, full);
+		}
+	}
+}
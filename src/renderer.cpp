@@ -0,0 +1,1436 @@
+#include <limits>      // 包含std::numeric_limits
+#include <cstring>     // 包含std::strcmp
+#include <array>       // 包含std::array，着色器变体表
+#include <new>         // 包含placement new
+#include <utility>     // 包含std::index_sequence
+#include <type_traits> // 包含std::is_trivially_destructible
+#include <filesystem>  // 包含std::filesystem，创建输出目录
+#include <chrono>      // 包含std::chrono，着色通道计时
+
+#include "renderer.h"  // 包含RenderConfig和RenderContext的声明
+#include "gl.h"
+#include "occlusion.h"
+#include "rendergraph.h"
+#include "tiles.h"
+#include "depthtiles.h"
+#include "fastmath.h"
+#include "shadowpyramid.h"
+#include "cubeshadow.h"
+#include "composite.h"
+#include "simd.h"
+
+// 着色器和各个通道只在本文件内使用，放在匿名命名空间里
+namespace {
+
+/**
+ * DepthShader类：专门用于生成阴影贴图的着色器
+ * 实现了IShader接口，用于深度值计算而非颜色渲染
+ */
+struct DepthShader : public IShader
+{
+	// 统一变量（uniform变量）：在整个着色过程中保持不变的数据
+	Matrix uVpPV;  // 视口变换 * 投影矩阵 * 视图矩阵的组合变换矩阵
+	// 顶点间插值变量（varying变量）：在顶点间插值传递的数据，这里只有屏幕空间深度
+	enum { V_DEPTH = 0, NVARYINGS = 1 };
+
+
+	DepthShader() {}  // 默认构造函数
+
+	unsigned nvaryings() const { return NVARYINGS; }
+
+	/**
+	 * 顶点着色器函数：将顶点从世界坐标转换为屏幕坐标
+	 * @param in 顶点属性（只用到世界坐标）
+	 * @param varying 输出的插值变量
+	 * @return 变换后的屏幕坐标
+	 */
+	Vec4f vertex(const Vertex &in, float *varying) const
+	{
+		// 将世界坐标转换为屏幕坐标
+		Vec4f screenCoord = uVpPV * in.worldCoord;
+		// 进行透视除法，将齐次坐标转换为欧氏坐标
+		screenCoord = screenCoord / screenCoord[3];
+		// 存储屏幕空间深度，用于后续的片段着色
+		varying[V_DEPTH] = screenCoord[2];
+
+		return screenCoord;
+	}
+
+	/**
+	 * 片段着色器函数：计算片段的颜色
+	 * @param varying 插值后的变量
+	 * @param color 输出的颜色
+	 * @return 是否渲染该片段
+	 */
+	bool fragment(const float *varying, Vec3f &color) const
+	{
+		// 根据深度值计算颜色，深度值越大，颜色越暗，形成可视化的深度图
+		// 使用指数函数增强对比度，方便可视化
+		color = Vec3f(255.0f, 255.0f, 255.0f) * mathPow<4>(mathExp(varying[V_DEPTH]-1.0f));
+
+		return true;  // 渲染该片段
+	}
+};
+
+/**
+ * DistanceShader类：渲染点光源立方体阴影贴图的一个面
+ * 颜色的x分量输出片段到光源的距离，深度测试留下最近的表面，颜色缓冲区就是距离图
+ */
+struct DistanceShader : public IShader
+{
+	Matrix uVpPV;     // 这个面的视口 * 投影 * 视图矩阵
+	Vec3f uLightPos;  // 光源位置
+	// 插值变量：相对光源的位置，与世界坐标成线性关系，透视校正插值后是精确的
+	enum { V_TOLIGHT = 0, NVARYINGS = 3 };
+
+	unsigned nvaryings() const { return NVARYINGS; }
+
+	Vec4f vertex(const Vertex &in, float *varying) const
+	{
+		Vec4f screenCoord = uVpPV * in.worldCoord;
+		float w = screenCoord[3];
+		storeVarying(varying + V_TOLIGHT, (proj<3>(in.worldCoord) - uLightPos) / w);  // 透视校正
+		// 与Phong着色器相同的透视除法约定：(x, y, z/w, 1/w)
+		screenCoord = screenCoord / w;
+		screenCoord[2] = screenCoord[2] / w;
+		screenCoord[3] = 1.0f / w;
+		return screenCoord;
+	}
+
+	bool fragment(const float *varying, Vec3f &color) const
+	{
+		Vec3f toLight = loadVarying<3>(varying + V_TOLIGHT);
+		color = Vec3f(std::sqrt(dot(toLight, toLight)), 0.0f, 0.0f);
+		return true;  // 渲染该片段
+	}
+};
+
+/**
+ * MaterialFeature：材质的特性
+ * Phong着色器按特性的组合(以及光源数)编译成不同的变体，材质没有的特性在它的变体里完全不存在：
+ * 不采样对应的贴图，不计算对应的插值变量，也不做多余的分支判断
+ */
+enum MaterialFeature
+{
+	MAT_NORMAL_MAP = 1,     // 有切线空间法线贴图，没有时直接用插值的法线
+	MAT_SPECULAR_MAP = 2,   // 有镜面高光贴图，没有时没有高光项
+	MAT_SHADOW = 4,         // 接收阴影(PCF)
+	MAT_FEATURE_COMBOS = 8  // 特性组合的数量
+};
+const int MAX_LIGHTS = 2;   // 着色器变体支持的最大光源数
+
+/**
+ * Material结构：材质声明自己具有哪些特性，渲染器据此选择着色器的变体
+ */
+struct Material
+{
+	unsigned features;  // MaterialFeature的组合
+
+	/**
+	 * 按模型实际加载到的贴图得出材质特性
+	 * @param model 模型
+	 * @param receiveShadow 是否接收阴影
+	 */
+	static Material fromModel(const Model &model, bool receiveShadow)
+	{
+		Material material;
+		material.features = (model.hasNormalMap() ? MAT_NORMAL_MAP : 0) | (model.hasSpecularMap() ? MAT_SPECULAR_MAP : 0) | (receiveShadow ? MAT_SHADOW : 0);
+		return material;
+	}
+};
+
+/**
+ * PhongUniforms结构：Phong着色器所有变体共用的统一变量（在所有顶点和片段处理中保持一致的数据） uniform所以加u
+ */
+struct PhongUniforms
+{
+	Model *uTexture;  // 模型纹理
+	Matrix uModel, uVpPV, uLightVpPV;  // 模型、视图投影和光源视图投影变换矩阵
+	Vec3f uEyePos;  // 视点位置
+	Vec3f uLightPos[MAX_LIGHTS];  // 方向光为光照方向，点光源为位置；第0个光源投射阴影
+	bool uPointLight[MAX_LIGHTS];  // 是否为点光源
+	LightColor uLightColor[MAX_LIGHTS];  // 光源颜色
+	float *uShadowBuffer;  // 阴影缓冲区（深度图）
+	const ShadowPyramid *uShadowPyramid;  // 阴影贴图的最小/最大深度金字塔，为空时总是做完整的PCF
+	const CubeShadowMap *uCubeShadow;  // 点光源的立方体阴影贴图，不为空时第0个光源的阴影查它而不是uShadowBuffer
+	unsigned uShadowBufferWidth, uShadowBufferHeight;  // 阴影缓冲区尺寸
+};
+
+/**
+ * PhongShader类：实现Phong着色模型的着色器
+ * 实现了IShader接口，用于执行完整的光照计算
+ * FEATURES为MaterialFeature的组合，CNT_LIGHT为光源数，都是编译期常量，每个组合是一个独立的变体
+ */
+template<unsigned FEATURES, int CNT_LIGHT>
+struct PhongShader : public IShader, public PhongUniforms
+{
+	static const bool NORMAL_MAP = (FEATURES & MAT_NORMAL_MAP) != 0;
+	static const bool SPECULAR_MAP = (FEATURES & MAT_SPECULAR_MAP) != 0;
+	static const bool SHADOW = (FEATURES & MAT_SHADOW) != 0;
+
+	// 顶点间插值变量（varying变量）在插值数组中的位置，varying所以加V；变体用不到的插值变量不占位置
+	enum
+	{
+		V_UV = 0,                                     // 纹理坐标 (2)
+		V_N = 2,                                      // 法线向量 (3)
+		V_WORLD = 5,                                  // 世界坐标 (3)
+		V_TANGENT = 8,                                // 切线向量，w分量为副切线手性 (4，只有法线贴图需要)
+		V_LIGHTSPACE = V_TANGENT + (NORMAL_MAP ? 4 : 0), // 光源空间位置，用于阴影计算 (3，只有接收阴影需要)
+		NVARYINGS = V_LIGHTSPACE + (SHADOW ? 3 : 0)
+	};
+
+	explicit PhongShader(const PhongUniforms &uniforms) : PhongUniforms(uniforms) {}
+
+	unsigned nvaryings() const { return NVARYINGS; }
+
+	/**
+	 * 顶点着色器函数：处理单个顶点
+	 * @param in 顶点属性（世界坐标、纹理坐标、法线、切线）
+	 * @param varying 输出的插值变量
+	 * @return 变换后的屏幕坐标
+	 */
+	Vec4f vertex(const Vertex &in, float *varying) const
+	{
+		// 计算屏幕坐标
+		Vec4f screenCoord = uVpPV * in.worldCoord;
+		float w = screenCoord[3];  // 保存透视除法的分母
+
+		// 存储世界坐标，透视校正插值需要除以w
+		storeVarying(varying + V_WORLD, proj<3>(in.worldCoord) / w);
+
+		// 进行透视除法，将齐次坐标转换为标准设备坐标
+		screenCoord = screenCoord / w;
+		// 保存z/w值，用于透视校正插值
+		screenCoord[2] = screenCoord[2] / w;
+		// 保存1/w值，用于后续透视校正插值
+		screenCoord[3] = 1.0f / w;
+
+		// 存储纹理坐标，应用透视校正
+		storeVarying(varying + V_UV, in.uv / w);
+
+		// 存储法线向量，应用透视校正
+		storeVarying(varying + V_N, in.normal / w);
+
+		// 存储切线向量，应用透视校正（手性也一起除以w，插值后再乘回来）
+		if constexpr (NORMAL_MAP)
+			storeVarying(varying + V_TANGENT, in.tangent / w);
+
+		// 计算光源空间位置，用于阴影映射
+		if constexpr (SHADOW)
+		{
+			Vec4f temp = uLightVpPV * in.worldCoord;  // 将顶点变换到光源空间
+			temp = temp / temp.w;  // 透视除法
+			storeVarying(varying + V_LIGHTSPACE, proj<3>(temp) / w);  // 投影到3D并应用透视校正
+		}
+
+		return screenCoord;
+	}
+
+	/**
+	 * 阴影计算：在阴影贴图上做PCF滤波，返回阴影因子（0到1之间）
+	 * @param lightSpacePos 光源空间坐标
+	 */
+	float shadow(Vec3f lightSpacePos) const
+	{
+		// 先查PCF采样范围(与下面的循环相同的取整方式)内的深度范围，完全照亮或完全在阴影中时直接返回，
+		// 结果与逐个采样完全相同；采样范围完全在贴图外时交给下面的循环处理
+		float zMin, zMax;
+		float zTest = lightSpacePos.z + 0.005f;
+		if (uShadowPyramid && uShadowPyramid->range(int(lightSpacePos.x - 2.0f), int(lightSpacePos.y - 2.0f), int(lightSpacePos.x + 1.0f), int(lightSpacePos.y + 1.0f), zMin, zMax))
+		{
+			if (!(zTest < zMax)) return 0.0f;  // 没有采样遮挡
+			if (zTest < zMin) return 1.0f;     // 所有采样都遮挡
+		}
+
+		float shadow = 0.0f;
+		int cntSample = 0;  // 采样计数
+		// 进行阴影采样（PCF滤波，减少阴影锯齿）
+		for (int dx = -2; dx < 2; dx++)  // 在x方向采样4个点
+		{
+			int sampleX = lightSpacePos.x + dx;
+			if (sampleX < 0 || sampleX >= uShadowBufferWidth) continue;  // 边界检查
+			for (int dy = -2; dy < 2; dy++)  // 在y方向采样4个点
+			{
+				int sampleY = lightSpacePos.y + dy;
+				if (sampleY < 0 || sampleY >= uShadowBufferHeight) continue;  // 边界检查
+				cntSample++;  // 有效采样点计数
+				// 比较当前深度与阴影贴图中的深度
+				// 添加偏移量(0.005f)避免自阴影问题
+				if (lightSpacePos.z + 0.005f < uShadowBuffer[sampleY * uShadowBufferWidth + sampleX])
+					shadow += 1.0f;  // 在阴影中
+			}
+		}
+		return shadow / cntSample;
+	}
+
+	/**
+	 * 片段着色器函数：计算片段颜色
+	 * @param varying 透视校正后的插值变量
+	 * @param color 输出的颜色
+	 * @return 是否渲染该片段
+	 */
+	bool fragment(const float *varying, Vec3f &color) const
+	{
+		// 透视校正的纹理坐标
+		Vec2f uv = loadVarying<2>(varying + V_UV);
+
+		Vec3f N = mathNormalize(loadVarying<3>(varying + V_N));  // 插值后的法线向量
+		Vec3f n = N;
+		if constexpr (NORMAL_MAP)
+		{
+			// 重建切线空间：插值后的切线对法线做正交化，副切线由叉积和手性得到
+			Vec4f tangent = loadVarying<4>(varying + V_TANGENT);  // 插值后的切线向量
+			Vec3f T = mathNormalize(proj<3>(tangent) - N * dot(N, proj<3>(tangent)));  // Gram-Schmidt正交化
+			Vec3f B = cross(N, T) * (tangent.w < 0.0f ? -1.0f : 1.0f);  // 副切线
+
+			// 从切线空间计算法线向量（法线贴图）
+			mat<3, 3, float> TBN;  // 切线空间到世界空间的变换矩阵
+			TBN.set_col(0, T);  // 设置切线向量
+			TBN.set_col(1, B);  // 设置副切线向量
+			TBN.set_col(2, N);  // 设置插值后的法线向量
+			// 从法线贴图获取切线空间法线并转换到世界空间
+			n = mathNormalize(TBN * uTexture->normal(uv));
+		}
+
+		Vec3f worldCoord = loadVarying<3>(varying + V_WORLD);  // 插值后的世界坐标
+		Vec3f eyeDir = mathNormalize(uEyePos - worldCoord);  // 视线方向
+
+		// 材质的环境光和漫反射系数都来自漫反射纹理，只采样一次
+		Vec3f material = uTexture->diffuse(uv).rgb();
+		float materialSpecular = 0.0f;  // 材质镜面反射系数
+		if constexpr (SPECULAR_MAP)
+			materialSpecular = uTexture->specular(uv);
+
+		// 计算阴影，只有第0个光源投射阴影
+		float shadowFactor = 0.0f;
+		if constexpr (SHADOW)
+		{
+			if (uCubeShadow)
+			{
+				Vec3f toLight = worldCoord - uLightPos[0];
+				shadowFactor = uCubeShadow->shadow(toLight, std::sqrt(dot(toLight, toLight)));
+			}
+			else shadowFactor = shadow(loadVarying<3>(varying + V_LIGHTSPACE));
+		}
+
+		color = Vec3f(0.0f, 0.0f, 0.0f);
+		for (int i = 0; i < CNT_LIGHT; ++i)
+		{
+			// 计算用于光照的方向向量
+			Vec3f lightDir = mathNormalize(uPointLight[i] ? uLightPos[i] - worldCoord : uLightPos[i]);  // 光照方向
+
+			// 环境光反射计算
+			Vec3f ambient = uLightColor[i].ambient * material;  // 环境光分量
+
+			// 漫反射计算 (Lambert模型)
+			// 漫反射强度 = 光照强度 * 材质漫反射系数 * max(0, 法线·光照方向)
+			Vec3f lit = uLightColor[i].diffuse * (material * std::max(0.0f, dot(n, lightDir)));
+
+			// 镜面反射计算 (Blinn-Phong模型)
+			if constexpr (SPECULAR_MAP)
+			{
+				Vec3f half = (lightDir + eyeDir) / 2.0f;  // 半程向量，用于Blinn-Phong高光计算
+				// 镜面反射强度 = 光照强度 * 材质镜面反射系数 * (法线·半程向量)^32
+				lit = lit + uLightColor[i].specular * (materialSpecular * mathPow<32>(std::max(0.0f, dot(n, half))));
+			}
+
+			// 使用Blinn-Phong光照模型计算最终颜色
+			// 环境光 + (漫反射 + 镜面反射) * (1 - 阴影因子)
+			color = color + ambient + lit * (1.0f - (i == 0 ? shadowFactor : 0.0f));
+		}
+
+		return true;  // 渲染该片段
+	}
+};
+
+// PhongShaderStorage：能放下任何一个Phong变体的内存，变体只有统一变量，布局都相同
+// 着色器对象放在调用者栈上，选择变体不分配堆内存
+struct PhongShaderStorage
+{
+	alignas(PhongShader<0, 1>) unsigned char bytes[sizeof(PhongShader<0, 1>)];
+};
+
+// 在storage中构造一个变体，返回它的IShader接口
+typedef const IShader *(*PhongFactory)(PhongShaderStorage &storage, const PhongUniforms &uniforms);
+
+template<unsigned FEATURES, int CNT_LIGHT>
+const IShader *makePhongShader(PhongShaderStorage &storage, const PhongUniforms &uniforms)
+{
+	typedef PhongShader<FEATURES, CNT_LIGHT> Variant;
+	static_assert(sizeof(Variant) == sizeof(PhongShaderStorage) && alignof(Variant) <= alignof(PhongShaderStorage), "Phong variants must share one layout");
+	static_assert(std::is_trivially_destructible<Variant>::value, "Phong variants are never destroyed");
+	return new (storage.bytes) Variant(uniforms);
+}
+
+// 一个光源数下所有特性组合的变体，下标就是特性组合
+template<int CNT_LIGHT, std::size_t... FEATURES>
+constexpr std::array<PhongFactory, sizeof...(FEATURES)> phongVariants(std::index_sequence<FEATURES...>)
+{
+	return { { &makePhongShader<unsigned(FEATURES), CNT_LIGHT>... } };
+}
+
+// 所有变体：PHONG_VARIANTS[光源数 - 1][特性组合]，全部在编译期实例化
+static const std::array<PhongFactory, MAT_FEATURE_COMBOS> PHONG_VARIANTS[MAX_LIGHTS] = {
+	phongVariants<1>(std::make_index_sequence<MAT_FEATURE_COMBOS>()),
+	phongVariants<2>(std::make_index_sequence<MAT_FEATURE_COMBOS>()),
+};
+
+/**
+ * 按材质特性和光源数选择Phong着色器的变体
+ * @param material 材质
+ * @param cntLight 光源数(1到MAX_LIGHTS)
+ * @param uniforms 统一变量
+ * @param storage 着色器对象的存放位置，返回的着色器在它的生命周期内有效
+ */
+const IShader &createPhongShader(const Material &material, int cntLight, const PhongUniforms &uniforms, PhongShaderStorage &storage)
+{
+	return *PHONG_VARIANTS[cntLight - 1][material.features](storage, uniforms);
+}
+
+/**
+ * PreviewShader类：Gouraud/平面着色的预览着色器
+ * 光照(环境光、漫反射、有高光贴图时的镜面反射)和阴影都在顶点着色器里算，纹理也只在顶点处采样一次，
+ * 片段着色器直接返回插值后的颜色。没有法线贴图，阴影只比较一个深度，细节比Phong模式少
+ * FLAT为true时使用几何法线，面片的棱角清晰可见
+ */
+template<bool FLAT>
+struct PreviewShader : public IShader, public PhongUniforms
+{
+	enum
+	{
+		V_COLOR = 0,  // 顶点颜色 (3)
+		NVARYINGS = 3
+	};
+
+	int cntLight;  // 光源数，第0个光源投射阴影
+
+	PreviewShader(const PhongUniforms &uniforms, int cntLight) : PhongUniforms(uniforms), cntLight(cntLight) {}
+
+	unsigned nvaryings() const { return NVARYINGS; }
+
+	/**
+	 * 顶点着色器函数：完成全部光照计算
+	 * @param in 顶点属性
+	 * @param varying 输出的插值变量(颜色)
+	 * @return 变换后的屏幕坐标
+	 */
+	Vec4f vertex(const Vertex &in, float *varying) const
+	{
+		Vec3f worldCoord = proj<3>(in.worldCoord);
+		Vec3f n = mathNormalize(FLAT ? in.faceNormal : in.normal);  // 平面着色用几何法线，Gouraud用顶点法线
+		Vec3f eyeDir = mathNormalize(uEyePos - worldCoord);  // 视线方向
+		Vec3f material = uTexture->diffuse(in.uv).rgb();  // 顶点处的漫反射纹理
+		float materialSpecular = uTexture->hasSpecularMap() ? uTexture->specular(in.uv) : 0.0f;
+
+		// 单次采样的阴影：只比较顶点在阴影贴图上对应的一个深度
+		float shadow = 0.0f;
+		if (uCubeShadow)
+		{
+			Vec3f toLight = worldCoord - uLightPos[0];
+			shadow = uCubeShadow->shadowTap(toLight, std::sqrt(dot(toLight, toLight)));
+		}
+		else
+		{
+			Vec4f lightSpacePos = uLightVpPV * in.worldCoord;
+			lightSpacePos = lightSpacePos / lightSpacePos.w;
+			int sampleX = lightSpacePos.x, sampleY = lightSpacePos.y;
+			if (sampleX >= 0 && sampleX < int(uShadowBufferWidth) && sampleY >= 0 && sampleY < int(uShadowBufferHeight) &&
+				lightSpacePos.z + 0.005f < uShadowBuffer[sampleY * uShadowBufferWidth + sampleX])
+				shadow = 1.0f;
+		}
+
+		Vec3f color(0.0f, 0.0f, 0.0f);
+		for (int i = 0; i < cntLight; ++i)
+		{
+			Vec3f lightDir = mathNormalize(uPointLight[i] ? uLightPos[i] - worldCoord : uLightPos[i]);  // 光照方向
+			Vec3f half = (lightDir + eyeDir) / 2.0f;  // 半程向量
+			Vec3f lit = uLightColor[i].diffuse * (material * std::max(0.0f, dot(n, lightDir)));
+			lit = lit + uLightColor[i].specular * (materialSpecular * mathPow<32>(std::max(0.0f, dot(n, half))));
+			color = color + uLightColor[i].ambient * material + lit * (1.0f - (i == 0 ? shadow : 0.0f));
+		}
+
+		// 透视除法，与Phong着色器相同
+		Vec4f screenCoord = uVpPV * in.worldCoord;
+		float w = screenCoord[3];
+		storeVarying(varying + V_COLOR, color / w);  // 颜色同样做透视校正插值
+		screenCoord = screenCoord / w;
+		screenCoord[2] = screenCoord[2] / w;
+		screenCoord[3] = 1.0f / w;
+		return screenCoord;
+	}
+
+	/**
+	 * 片段着色器函数：只有一次插值
+	 */
+	bool fragment(const float *varying, Vec3f &color) const
+	{
+		color = loadVarying<3>(varying + V_COLOR);
+		return true;  // 渲染该片段
+	}
+};
+
+// ShaderStorage：能放下任何一个Phong变体或预览着色器的内存
+union ShaderStorage
+{
+	PhongShaderStorage phong;
+	alignas(PreviewShader<false>) unsigned char preview[sizeof(PreviewShader<false>)];
+};
+
+/**
+ * 按着色模式创建着色器，Phong模式再按材质特性选择变体
+ * @param mode 着色模式
+ * @param material 材质
+ * @param cntLight 光源数(1到MAX_LIGHTS)
+ * @param uniforms 统一变量
+ * @param storage 着色器对象的存放位置
+ */
+const IShader &createShader(ShadingMode mode, const Material &material, int cntLight, const PhongUniforms &uniforms, ShaderStorage &storage)
+{
+	static_assert(sizeof(PreviewShader<true>) == sizeof(PreviewShader<false>), "preview shaders must share one layout");
+	static_assert(std::is_trivially_destructible<PreviewShader<false>>::value && std::is_trivially_destructible<PreviewShader<true>>::value, "preview shaders are never destroyed");
+	if (mode == SHADING_GOURAUD) return *new (storage.preview) PreviewShader<false>(uniforms, cntLight);
+	if (mode == SHADING_FLAT) return *new (storage.preview) PreviewShader<true>(uniforms, cntLight);
+	return createPhongShader(material, cntLight, uniforms, storage.phong);
+}
+
+// 材质特性的名字，用于报告选择的变体
+void printMaterialFeatures(std::ostream &out, unsigned features)
+{
+	const char *names[] = { "normal map", "specular map", "shadow" };
+	bool first = true;
+	for (int i = 0; i < 3; ++i)
+	{
+		if (!(features & (1u << i))) continue;
+		out << (first ? "" : " + ") << names[i];
+		first = false;
+	}
+	if (first) out << "none";
+}
+
+
+
+
+// 常量定义
+const float PI = acosf(-1.0f);  // π值，用于角度计算
+
+const unsigned CUBE_SHADOW_SIZE = 512;  // 点光源立方体阴影贴图每个面的边长
+const float CUBE_SHADOW_NEAR = 0.01f, CUBE_SHADOW_FAR = 10.0f;  // 立方体各个面的近、远平面距离
+
+const unsigned CNT_SAMPLE = 4;          // 每个像素的采样数（用于MSAA）
+const float D_MSAA[CNT_SAMPLE][2] = {   // MSAA采样点的偏移量
+	{0.25f, 0.25f}, {0.25f, 0.75f},
+	{0.75f, 0.25f}, {0.75f, 0.75f}
+};
+const float D_NonMSAA[1][2] = {         // 非MSAA采样的偏移量（居中采样）
+	{0.0f, 0.0f}
+};
+
+const int ROWS_PER_JOB = 16;  // 按行并行时每个作业处理的行数
+
+const std::size_t FRAME_ARENA_SIZE = 4 << 20;  // 每帧临时数据的初始容量（字节）
+const std::size_t FRAME_ARENA_SIZE_POINT = 8 << 20;  // 点光源时的初始容量，多出立方体六个面的网格簇列表和图元
+const std::size_t FRAME_ARENA_SIZE_VIEW = 4 << 20;   // 多视图时每多一个视图增加的容量，每个视图有自己的图元
+const bool DEPTH_COMPRESSION = true;  // 是否按块压缩深度缓冲区(快速清除 + 深度平面)
+
+// 分区域渲染：区域边长(像素)，必须是TILE_SIZE的倍数
+const int REGION_SIZE = 512;
+static_assert(REGION_SIZE % TILE_SIZE == 0, "regions must align to raster tiles");
+const std::size_t REGION_ARENA_SIZE = 4 << 20;  // 每个区域裁剪后图元的初始容量，每个区域结束时整体回收
+
+/**
+ * 输出图元设置阶段的剔除统计
+ * @param log 输出流
+ * @param pass 通道名
+ * @param stats 统计数据
+ */
+void printSetupStats(std::ostream &log, const char *pass, const SetupStats &stats)
+{
+	unsigned total = 0;
+	for (const auto &c : stats.count) total += c;
+	log << pass << " setup culled " << total - stats.count[SETUP_ACCEPT] << "/" << total << " triangles (backface "
+		<< stats.count[SETUP_BACKFACE] << ", degenerate " << stats.count[SETUP_DEGENERATE] << ", no sample " << stats.count[SETUP_NO_SAMPLE] << "), "
+		<< stats.cntStamp << " small triangles stamped" << std::endl;
+}
+
+// 输出分块光栅化的统计：子作业数、拆分的分块数、开销的不均衡程度(最大/平均)以及最热的几个分块
+void printTileStats(std::ostream &log, const char *pass, const TileStats &stats)
+{
+	const int CNT_HOT = 3;      // 输出的热点分块数
+	int hot[CNT_HOT] = { -1, -1, -1 };
+	float maxEstimate = 0.0f, sumEstimate = 0.0f;
+	double maxMs = 0.0, sumMs = 0.0;
+	unsigned cntTile = 0;
+	for (int t = 0; t < int(stats.tiles.size()); ++t)
+	{
+		const TileCost &tile = stats.tiles[t];
+		if (tile.cntTriangle == 0) continue;
+		cntTile++;
+		maxEstimate = std::max(maxEstimate, tile.estimate);
+		sumEstimate += tile.estimate;
+		maxMs = std::max(maxMs, tile.ms);
+		sumMs += tile.ms;
+		// 按实际耗时插入前CNT_HOT名
+		for (int k = 0; k < CNT_HOT; ++k)
+		{
+			if (hot[k] >= 0 && stats.tiles[hot[k]].ms >= tile.ms) continue;
+			for (int m = CNT_HOT - 1; m > k; --m) hot[m] = hot[m - 1];
+			hot[k] = t;
+			break;
+		}
+	}
+	if (cntTile == 0) return;
+	log << pass << " tiles: " << cntTile << "/" << stats.tiles.size() << " non-empty, " << stats.cntJob << " jobs ("
+		<< stats.cntSplit << " tiles split), cost max/mean " << maxEstimate * cntTile / sumEstimate << "x estimated, "
+		<< maxMs * cntTile / sumMs << "x measured" << std::endl;
+	for (int k = 0; k < CNT_HOT && hot[k] >= 0; ++k)
+	{
+		const TileCost &tile = stats.tiles[hot[k]];
+		log << "  tile (" << hot[k] % stats.tilesX << ", " << hot[k] / stats.tilesX << "): " << tile.cntTriangle << " triangles, estimate "
+			<< tile.estimate << ", " << tile.cntJob << " jobs, " << tile.ms << " ms" << std::endl;
+	}
+}
+
+// 输出深度压缩的统计：通道结束(解压之前)各状态的分块数，压缩的分块在整个通道中都没有读写原始深度
+void printDepthTiles(std::ostream &log, const char *pass, const DepthTiles &depthTiles)
+{
+	unsigned cnt[4];
+	depthTiles.count(cnt);
+	unsigned total = cnt[0] + cnt[1] + cnt[2] + cnt[3];
+	log << pass << " depth tiles: " << cnt[0] << " clear, " << cnt[1] << " one plane, " << cnt[2] << " two planes, " << cnt[3]
+		<< " raw (" << (total - cnt[3]) * 100 / total << "% compressed)" << std::endl;
+}
+
+/**
+ * 阴影映射函数：从光源视角渲染场景，生成深度图
+ * @param config 渲染设置
+ * @param log 统计信息的输出流
+ * @param jobs 作业调度器，用于并行几何阶段
+ * @param arena 每帧的内存资源，网格簇列表和图元都分配在这里
+ * @param modelData 模型数据数组
+ * @param modelTrans 模型变换矩阵数组
+ * @param cntModel 模型数量
+ * @param zBuffer 深度缓冲区
+ * @param depthTiles 深度缓冲区的压缩分块，为nullptr时不压缩；通道结束时解压回zBuffer
+ * @param colorBuffer 颜色缓冲区
+ * @param depth 深度图像
+ * @return 光源视图-投影-视口变换的组合矩阵
+ */
+Matrix shadowMapping(const RenderConfig &config, std::ostream &log, JobSystem &jobs, std::pmr::memory_resource *arena, Model **modelData, Matrix *modelTrans, unsigned cntModel, float *zBuffer, DepthTiles *depthTiles, Vec3f *colorBuffer, TGAImage &depth)
+{
+	// 设置光照视角的视图矩阵
+	Matrix view = lookat(config.lightPos, config.center, config.up);
+	// 设置正交投影矩阵（正交投影避免透视失真，适合阴影映射）
+	Matrix project = ortho(-2.0f, 2.0f, -2.0f, 2.0f, -0.01f, -10.0f);
+	// 设置视口变换矩阵（将NDC坐标转换为屏幕坐标）
+	Matrix vp = viewport(config.shadowWidth, config.shadowHeight);
+	SetupStats stats;  // 图元设置阶段的剔除统计
+	TileStats tileStats(arena);  // 分块光栅化的开销统计
+
+	// 遍历所有模型
+	for (unsigned m = 0; m < cntModel; ++m)
+	{
+		// 创建深度着色器并设置统一变量
+		DepthShader depthShader;
+		depthShader.uVpPV = vp * project*view;  // 组合变换矩阵
+
+		// 几何阶段：并行处理所有网格簇的顶点，阴影通道不做裁剪；背向光源的面总被朝向光源的面挡住，剔除后深度图不变
+		DrawCall draw = { modelData[m], &depthShader, modelTrans[m], project * view, CULL_BACK, false, config.shadowWidth, config.shadowHeight, D_NonMSAA, 1 };
+		std::pmr::vector<int> meshlets(modelData[m]->nmeshlets(), arena);
+		for (int c = 0; c < modelData[m]->nmeshlets(); ++c) meshlets[c] = c;
+		PrimitiveBins bins(arena);
+		geometryStage(jobs, draw, meshlets, bins, &stats);
+
+		// 光栅化 + 片段处理阶段：分块并行，每个分块内按提交顺序处理图元，使用非MSAA模式渲染到深度缓冲区
+		rasterizeTiles(jobs, bins, depthShader, colorBuffer, zBuffer, config.shadowWidth, config.shadowHeight, D_NonMSAA, 1, depthTiles, &tileStats);
+	}
+	
+	printSetupStats(log, "shadow", stats);
+	printTileStats(log, "shadow", tileStats);
+	if (depthTiles)
+	{
+		printDepthTiles(log, "shadow", *depthTiles);
+		depthTiles->resolve(jobs, zBuffer);  // 着色通道按原始深度读阴影图
+	}
+
+	// 返回光源的视图-投影-视口变换组合矩阵（用于后续阴影计算）
+	return vp * project * view;
+}
+
+/**
+ * 点光源阴影：渲染立方体阴影贴图的六个面
+ * 六个面互不依赖，作为六个作业同时渲染，每个面内部的几何阶段和分块光栅化继续拆成子作业
+ * 每个面只处理包围盒与它的视锥相交的网格簇，一个网格簇通常只落在一两个面里
+ * @param log 统计信息的输出流
+ * @param jobs 作业调度器
+ * @param arena 每帧的内存资源
+ * @param modelData 模型数据数组
+ * @param modelTrans 模型变换矩阵数组
+ * @param cntModel 模型数量
+ * @param cube 立方体阴影贴图，中心为光源位置
+ */
+void cubeShadowMapping(std::ostream &log, JobSystem &jobs, std::pmr::memory_resource *arena, Model **modelData, Matrix *modelTrans, unsigned cntModel, CubeShadowMap &cube)
+{
+	SetupStats stats;  // 六个面合计的图元设置统计
+	std::atomic<unsigned> cntMeshlet(0), cntCulled(0);  // 网格簇-面组合的总数和被视锥剔除的数量
+	unsigned size = cube.size();
+	jobs.parallelFor(0, CUBE_FACES, 1, [&](int begin, int end)
+	{
+		for (int face = begin; face < end; ++face)
+		{
+			cube.clearFace(jobs, face);
+			DistanceShader shader;
+			shader.uVpPV = cube.faceVpPV(face);
+			shader.uLightPos = cube.center();
+			Matrix PV = cube.faceProjView(face);
+			for (unsigned m = 0; m < cntModel; ++m)
+			{
+				// 逐面的视锥剔除
+				std::pmr::vector<int> meshlets(arena);
+				meshlets.reserve(modelData[m]->nmeshlets());
+				for (int c = 0; c < modelData[m]->nmeshlets(); ++c)
+				{
+					const Meshlet &meshlet = modelData[m]->meshlet(c);
+					if (cube.faceVisible(face, meshlet.bboxMin, meshlet.bboxMax, modelTrans[m]))
+						meshlets.push_back(c);
+				}
+				cntMeshlet += modelData[m]->nmeshlets();
+				cntCulled += modelData[m]->nmeshlets() - unsigned(meshlets.size());
+				if (meshlets.empty()) continue;
+
+				// 光源在场景内部，几何体可能在面的相机后方，需要做z平面裁剪
+				DrawCall draw = { modelData[m], &shader, modelTrans[m], PV, CULL_BACK, true, size, size, D_NonMSAA, 1 };
+				PrimitiveBins bins(arena);
+				geometryStage(jobs, draw, meshlets, bins, &stats);
+				rasterizeTiles(jobs, bins, shader, cube.distanceBuffer(face), cube.zBuffer(face), size, size, D_NonMSAA, 1, nullptr);
+			}
+		}
+	});
+	printSetupStats(log, "cube shadow", stats);
+	log << "cube shadow: " << cntCulled << "/" << cntMeshlet << " meshlet-face pairs frustum culled" << std::endl;
+}
+
+/**
+ * 遮挡通道：从相机视角把标记为遮挡体的模型光栅化到低分辨率遮挡缓冲区
+ * @param config 渲染设置
+ * @param modelData 模型数据数组
+ * @param modelTrans 模型变换矩阵数组
+ * @param modelOccluder 每个模型是否作为遮挡体
+ * @param cntModel 模型数量
+ * @param occlusion 遮挡缓冲区
+ */
+void occlusionPass(const RenderConfig &config, Model **modelData, Matrix *modelTrans, bool *modelOccluder, unsigned cntModel, OcclusionBuffer &occlusion)
+{
+	// 视图和投影矩阵必须与着色通道完全一致，遮挡测试才是保守的
+	Matrix view = lookat(config.eye, config.center, config.up);
+	Matrix project = projection(PI / 4.0f, float(config.width) / float(config.height), -0.01f, -10.0f);
+
+	occlusion.clear();
+	for (unsigned m = 0; m < cntModel; ++m)
+	{
+		if (!modelOccluder[m]) continue;  // 只有大的遮挡体才值得光栅化
+		occlusion.renderOccluder(*modelData[m], project * view * modelTrans[m]);
+	}
+}
+
+/**
+ * 第v个视图的相机位置：eye绕过center的竖直轴旋转2 * PI * v / cntView
+ * @param config 渲染设置
+ * @param v 视图编号
+ */
+Vec3f viewEye(const RenderConfig &config, unsigned v)
+{
+	float angle = 2.0f * PI * v / config.cntView;
+	Vec3f offset = config.eye - config.center;
+	float c = std::cos(angle), s = std::sin(angle);
+	return config.center + Vec3f(c * offset.x + s * offset.z, offset.y, c * offset.z - s * offset.x);
+}
+
+/**
+ * 场景着色的统一变量：一个模型从一个相机渲染时用到的所有uniform
+ * @param config 渲染设置
+ * @param model 模型数据(也是纹理)
+ * @param modelTrans 模型变换矩阵
+ * @param eyePos 相机位置
+ * @param vpPV 相机的视口 * 投影 * 视图矩阵
+ * 其余参数与PhongShading相同
+ */
+PhongUniforms sceneUniforms(const RenderConfig &config, Model *model, const Matrix &modelTrans, const Vec3f &eyePos, const Matrix &vpPV, const Matrix &lightVpPV,
+	float *shadowBuffer, const ShadowPyramid *shadowPyramid, const CubeShadowMap *cubeShadow)
+{
+	PhongUniforms uniforms{};
+	uniforms.uTexture = model;  // 设置模型纹理
+	uniforms.uModel = modelTrans;  // 设置模型变换矩阵
+	uniforms.uVpPV = vpPV;  // 设置视图-投影-视口变换组合矩阵
+	uniforms.uLightVpPV = lightVpPV;  // 设置光源视图-投影-视口变换组合矩阵
+	uniforms.uEyePos = eyePos;  // 设置相机位置
+	uniforms.uLightPos[0] = cubeShadow ? cubeShadow->center() : config.lightPos;  // 设置光源位置
+	uniforms.uPointLight[0] = cubeShadow != nullptr;  // 设置光源类型
+	uniforms.uLightColor[0] = config.lightColor;  // 设置光源颜色
+	uniforms.uShadowBuffer = shadowBuffer;  // 设置阴影缓冲区
+	uniforms.uShadowPyramid = shadowPyramid;  // 设置阴影深度金字塔
+	uniforms.uCubeShadow = cubeShadow;  // 设置立方体阴影贴图
+	uniforms.uShadowBufferWidth = config.shadowWidth;  // 设置阴影缓冲区宽度
+	uniforms.uShadowBufferHeight = config.shadowHeight;  // 设置阴影缓冲区高度
+	return uniforms;
+}
+
+// ScreenRect结构：画面中的一个像素矩形(闭区间)，区域渲染时着色和解析只处理它
+struct ScreenRect
+{
+	Vec2i min, max;
+	int width() const { return max.x - min.x + 1; }
+	int height() const { return max.y - min.y + 1; }
+};
+
+/**
+ * 区域的裁剪矩阵：左乘投影 * 视图矩阵后，区域对应的视锥变成标准的裁剪空间，可以直接交给frustumVisible
+ * 区域向外多放一个像素，只会多留下几个网格簇，图元最后还要按像素裁到区域里
+ * @param width, height 整幅画面的宽高
+ * @param rect 区域
+ */
+Matrix regionClip(unsigned width, unsigned height, const ScreenRect &rect)
+{
+	// 屏幕坐标x = ndc * width / 2 + (width - 1) / 2，反过来求区域边界的ndc
+	auto ndc = [](float screen, unsigned size) { return (screen - (size - 1) / 2.0f) * 2.0f / size; };
+	float xLo = ndc(rect.min.x - 1.0f, width), xHi = ndc(rect.max.x + 1.0f, width);
+	float yLo = ndc(rect.min.y - 1.0f, height), yHi = ndc(rect.max.y + 1.0f, height);
+	Matrix ret = Matrix::identity();
+	ret[0][0] = 2.0f / (xHi - xLo);
+	ret[0][3] = -(xHi + xLo) / (xHi - xLo);  // 乘的是裁剪坐标的w，透视除法之后就是ndc的平移
+	ret[1][1] = 2.0f / (yHi - yLo);
+	ret[1][3] = -(yHi + yLo) / (yHi - yLo);
+	return ret;
+}
+
+/**
+ * Phong着色函数：使用Phong着色模型渲染场景
+ * @param config 渲染设置
+ * @param log 统计信息的输出流
+ * @param jobs 作业调度器，用于并行几何阶段
+ * @param arena 每帧的内存资源，网格簇列表和图元都分配在这里
+ * @param modelData 模型数据数组
+ * @param modelTrans 模型变换矩阵数组
+ * @param cntModel 模型数量
+ * @param zBuffer 深度缓冲区
+ * @param depthTiles 深度缓冲区的压缩分块，为nullptr时不压缩；通道结束时解压回zBuffer
+ * @param colorBuffer 颜色缓冲区
+ * @param lightVpPV 光源视图-投影-视口变换组合矩阵
+ * @param shadowBuffer 阴影缓冲区
+ * @param shadowPyramid 阴影贴图的最小/最大深度金字塔，为nullptr时总是做完整的PCF
+ * @param cubeShadow 点光源的立方体阴影贴图，不为nullptr时光源是位于它中心的点光源，阴影查它
+ * @param frame 输出图像
+ * @param occlusion 遮挡缓冲区，为nullptr时不做遮挡剔除
+ * @param region 只渲染的区域，为nullptr时渲染整幅画面；不为空时缓冲区只有区域大，不压缩深度(depthTiles必须为nullptr)
+ */
+void PhongShading(const RenderConfig &config, std::ostream &log, JobSystem &jobs, std::pmr::memory_resource *arena, Model **modelData, Matrix *modelTrans, unsigned cntModel, float *zBuffer, DepthTiles *depthTiles, Vec3f *colorBuffer, Matrix lightVpPV, float *shadowBuffer, const ShadowPyramid *shadowPyramid, const CubeShadowMap *cubeShadow, TGAImage &frame, const OcclusionBuffer *occlusion = nullptr, const ScreenRect *region = nullptr)
+{
+	// 设置相机视角的视图矩阵
+	Matrix view = lookat(config.eye, config.center, config.up);
+	// 设置透视投影矩阵（FOV=45度，宽高比=1.0）
+	Matrix project = projection(PI / 4.0f, float(config.width) / float(config.height), -0.01f, -10.0f);
+	// 设置视口变换矩阵
+	Matrix vp = viewport(config.width, config.height);
+	Matrix PV = project * view;  // 组合投影和视图矩阵，用于裁剪
+	unsigned cntMeshlet = 0, cntCulled = 0;  // 网格簇总数和被遮挡剔除的簇数
+	unsigned cntOutside = 0;  // 区域渲染时不在区域视锥内的簇数
+	Matrix regionPV = region ? regionClip(config.width, config.height, *region) * PV : PV;  // 区域视锥的投影 * 视图矩阵
+	SetupStats stats;  // 图元设置阶段的剔除统计
+	TileStats tileStats(arena);  // 分块光栅化的开销统计
+
+	// 遍历所有模型
+	for (unsigned m = 0; m < cntModel; ++m)
+	{
+		// 设置Phong着色器的统一变量
+		PhongUniforms uniforms = sceneUniforms(config, modelData[m], modelTrans[m], config.eye, vp * project * view, lightVpPV, shadowBuffer, shadowPyramid, cubeShadow);
+
+		// 按着色模式和模型的材质特性选择着色器变体，场景只有一个方向光
+		Material material = Material::fromModel(*modelData[m], true);
+		ShaderStorage storage;
+		const IShader &shader = createShader(config.shading, material, 1, uniforms, storage);
+		log << "model " << m << " shader: " << SHADING_MODE_NAMES[config.shading];  // 输出选择的变体
+		if (config.shading == SHADING_PHONG)
+		{
+			log << " (";
+			printMaterialFeatures(log, material.features);
+			log << ")";
+		}
+		log << ", " << shader.nvaryings() << " varyings" << std::endl;
+
+		// 模型级遮挡剔除：整个模型的包围盒都被遮挡时，连面片都不用看
+		if (occlusion && !occlusion->testAABB(modelData[m]->bboxMin(), modelData[m]->bboxMax(), PV * modelTrans[m]))
+		{
+			cntCulled += modelData[m]->nmeshlets();
+			cntMeshlet += modelData[m]->nmeshlets();
+			continue;
+		}
+
+		// 簇级遮挡剔除：被遮挡的簇直接跳过，省掉它所有面片的顶点处理和裁剪
+		std::pmr::vector<int> meshlets(arena);
+		meshlets.reserve(modelData[m]->nmeshlets());
+		for (int c = 0; c < modelData[m]->nmeshlets(); ++c)  // 遍历模型的每个网格簇
+		{
+			const Meshlet &meshlet = modelData[m]->meshlet(c);
+			cntMeshlet++;
+			// 区域渲染：区域视锥外的簇不会覆盖区域内的任何像素
+			if (region && !frustumVisible(meshlet.bboxMin, meshlet.bboxMax, regionPV * modelTrans[m]))
+			{
+				cntOutside++;
+				continue;
+			}
+			if (occlusion && !occlusion->testAABB(meshlet.bboxMin, meshlet.bboxMax, PV * modelTrans[m]))
+			{
+				cntCulled++;
+				continue;
+			}
+			meshlets.push_back(c);
+		}
+
+		// 几何阶段：并行完成顶点变换、z平面裁剪、顶点着色和图元设置(背面、退化和不覆盖采样点的三角形在这里剔除)
+		DrawCall draw = { modelData[m], &shader, modelTrans[m], PV, CULL_BACK, true, config.width, config.height, D_MSAA, CNT_SAMPLE };
+		PrimitiveBins bins(arena);
+		geometryStage(jobs, draw, meshlets, bins, &stats);
+
+		// 光栅化 + 片段处理：分块并行，热点分块拆开，每个分块内按提交顺序处理图元，使用MSAA渲染三角形
+		if (region)
+		{
+			// 区域渲染：图元设置在整幅画面的坐标系里做，裁到区域并平移后再光栅化，分块的划分与整幅渲染时相同
+			PrimitiveBins cropped(arena);
+			cropBins(bins, region->min, region->max, cropped);
+			rasterizeTiles(jobs, cropped, shader, colorBuffer, zBuffer, region->width(), region->height(), D_MSAA, CNT_SAMPLE, nullptr, &tileStats);
+		}
+		else
+			rasterizeTiles(jobs, bins, shader, colorBuffer, zBuffer, config.width, config.height, D_MSAA, CNT_SAMPLE, depthTiles, &tileStats);
+	}
+	printSetupStats(log, "shading", stats);
+	printTileStats(log, "shading", tileStats);
+	if (depthTiles)
+	{
+		printDepthTiles(log, "shading", *depthTiles);
+		depthTiles->resolve(jobs, zBuffer);  // 解析通道按原始深度判断采样点是否被覆盖
+	}
+	if (region)
+		log << "region (" << region->min.x << ", " << region->min.y << ")-(" << region->max.x << ", " << region->max.y << ") culled "
+			<< cntOutside << "/" << cntMeshlet << " meshlets" << std::endl;  // 输出区域视锥剔除统计
+	if (occlusion)
+		log << "occlusion culled " << cntCulled << "/" << cntMeshlet << " meshlets" << std::endl;  // 输出遮挡剔除统计
+}
+
+// View结构：多视图渲染中的一个相机和它的渲染目标
+struct View
+{
+	Vec3f eye;          // 相机位置，看向center
+	float *zBuffer;     // 深度缓冲区(MSAA)
+	Vec3f *colorBuffer; // 颜色缓冲区(MSAA)
+};
+
+/**
+ * 多视图着色函数：同一个场景从多个相机渲染，与相机无关的工作只做一次
+ * 每个模型先对所有视锥的并集做网格簇剔除，再用worldStage把留下的面变换到世界空间；
+ * 之后各视图作为并发的作业，只做自己的投影、z平面裁剪、顶点着色、图元设置和光栅化。
+ * 阴影贴图在阴影通道里已经算好，所有视图共用。遮挡缓冲区是从eye渲染的，这里不做遮挡剔除
+ * @param views 视图数组，共config.cntView个，缓冲区由调用者分配
+ * 其余参数与PhongShading相同
+ */
+void multiViewShading(const RenderConfig &config, std::ostream &log, JobSystem &jobs, std::pmr::memory_resource *arena, Model **modelData, Matrix *modelTrans, unsigned cntModel, const View *views,
+	Matrix lightVpPV, float *shadowBuffer, const ShadowPyramid *shadowPyramid, const CubeShadowMap *cubeShadow)
+{
+	Matrix project = projection(PI / 4.0f, float(config.width) / float(config.height), -0.01f, -10.0f);
+	Matrix vp = viewport(config.width, config.height);
+	Matrix view[MAX_VIEWS], PV[MAX_VIEWS];  // 每个视图的视图矩阵和投影 * 视图矩阵
+	for (unsigned v = 0; v < config.cntView; ++v)
+	{
+		view[v] = lookat(views[v].eye, config.center, config.up);
+		PV[v] = project * view[v];
+	}
+
+	// 与相机无关的部分：视锥并集剔除和世界空间变换，每个模型只做一次
+	std::pmr::vector<std::pmr::vector<int>> meshlets(arena);  // meshlets[m]是第m个模型在任一视锥内的网格簇
+	std::pmr::vector<WorldGeometry> world(arena);
+	meshlets.resize(cntModel);
+	world.reserve(cntModel);
+	for (unsigned m = 0; m < cntModel; ++m) world.emplace_back(arena);
+	unsigned cntMeshlet = 0, cntCulled = 0;  // 网格簇总数和不在任何视锥内的簇数
+	for (unsigned m = 0; m < cntModel; ++m)
+	{
+		meshlets[m].reserve(modelData[m]->nmeshlets());
+		for (int c = 0; c < modelData[m]->nmeshlets(); ++c)
+		{
+			const Meshlet &meshlet = modelData[m]->meshlet(c);
+			bool visible = false;
+			for (unsigned v = 0; v < config.cntView && !visible; ++v)
+				visible = frustumVisible(meshlet.bboxMin, meshlet.bboxMax, PV[v] * modelTrans[m]);
+			cntMeshlet++;
+			if (visible) meshlets[m].push_back(c);
+			else cntCulled++;
+		}
+		worldStage(jobs, *modelData[m], modelTrans[m], meshlets[m], world[m]);
+	}
+
+	// 与相机有关的部分：视图之间互不依赖，各自作为一个作业，内部的几何阶段和光栅化再并行展开
+	SetupStats stats;  // 所有视图合计的图元设置统计
+	jobs.parallelFor(0, int(config.cntView), 1, [&](int begin, int end)
+	{
+		for (int v = begin; v < end; ++v)
+		{
+			for (unsigned m = 0; m < cntModel; ++m)
+			{
+				if (meshlets[m].empty()) continue;
+				PhongUniforms uniforms = sceneUniforms(config, modelData[m], modelTrans[m], views[v].eye, vp * project * view[v], lightVpPV, shadowBuffer, shadowPyramid, cubeShadow);
+				Material material = Material::fromModel(*modelData[m], true);
+				ShaderStorage storage;
+				const IShader &shader = createShader(config.shading, material, 1, uniforms, storage);
+
+				DrawCall draw = { modelData[m], &shader, modelTrans[m], PV[v], CULL_BACK, true, config.width, config.height, D_MSAA, CNT_SAMPLE, &world[m] };
+				PrimitiveBins bins(arena);
+				geometryStage(jobs, draw, meshlets[m], bins, &stats);
+				rasterizeTiles(jobs, bins, shader, views[v].colorBuffer, views[v].zBuffer, config.width, config.height, D_MSAA, CNT_SAMPLE, nullptr);
+			}
+		}
+	});
+	printSetupStats(log, "multi-view shading", stats);
+	log << "multi-view: " << config.cntView << " views, union frustum culled " << cntCulled << "/" << cntMeshlet << " meshlets" << std::endl;
+}
+
+/**
+ * 将深度颜色写入TGA图像
+ * @param jobs 作业调度器，按行分块并行写入
+ * @param depth 输出的深度图像
+ * @param colorBuffer 颜色缓冲区
+ */
+void writeDepth(JobSystem &jobs, TGAImage &depth, Vec3f *colorBuffer)
+{
+	// 将深度颜色写入TGAImage（用于调试和可视化），不同行之间互不影响，可以并行
+	jobs.parallelFor(0, depth.get_height(), ROWS_PER_JOB, [&](int yBegin, int yEnd)
+	{
+		for (int y = yBegin; y < yEnd; ++y)
+		{
+			for (int x = 0; x < depth.get_width(); ++x)
+			{
+				Vec3f color = colorBuffer[y * depth.get_width() + x];
+				depth.set(x, y, TGAColor(color.x, color.y, color.z, 255));
+			}
+		}
+	});
+}
+
+// 解析核心(resolvekernel.h)在每个指令集的命名空间里各编译一次，运行时按指令集等级选出
+namespace resolve_scalar {
+#include "resolvekernel.h"
+}
+
+#ifdef SIMD_X86
+SIMD_TARGET_PUSH("sse2")
+namespace resolve_sse2 {
+#include "resolvekernel.h"
+}
+SIMD_TARGET_POP
+
+SIMD_TARGET_PUSH("avx")
+namespace resolve_avx {
+#include "resolvekernel.h"
+}
+SIMD_TARGET_POP
+
+SIMD_TARGET_PUSH("avx512f")
+namespace resolve_avx512 {
+#include "resolvekernel.h"
+}
+SIMD_TARGET_POP
+#endif
+
+// ResolveKernel：一种指令集的解析核心
+typedef void (*ResolveKernel)(TGAImage &frame, const float *zBuffer, const Vec3f *colorBuffer, unsigned cntSample, int x0, int y0, int width, int yBegin, int yEnd);
+
+// resolveKernel函数：按指令集等级选出解析核心，没有编译进来的等级退回标量实现
+ResolveKernel resolveKernel(SimdLevel level)
+{
+#ifdef SIMD_X86
+	switch (level)
+	{
+	case SIMD_AVX512: return resolve_avx512::resolveRows;
+	case SIMD_AVX: return resolve_avx::resolveRows;
+	case SIMD_SSE2: return resolve_sse2::resolveRows;
+	default: break;
+	}
+#endif
+	return resolve_scalar::resolveRows;
+}
+
+/**
+ * 将渲染结果写入TGA图像
+ * @param jobs 作业调度器，按行分块并行解析(resolve)
+ * @param frame 输出图像
+ * @param zBuffer 深度缓冲区
+ * @param colorBuffer 颜色缓冲区
+ * @param cntSample 每个像素的采样数
+ * @param region 缓冲区对应的区域，结果写到图像中区域所在的矩形；为nullptr时缓冲区对应整幅图像
+ */
+
+void writeFrame(JobSystem &jobs, TGAImage &frame, float *zBuffer, Vec3f *colorBuffer, unsigned cntSample, const ScreenRect *region = nullptr)
+{
+	int x0 = region ? region->min.x : 0, y0 = region ? region->min.y : 0;  // 缓冲区左下角在图像中的位置
+	int width = region ? region->width() : frame.get_width(), height = region ? region->height() : frame.get_height();  // 缓冲区的宽高
+	ResolveKernel resolve = resolveKernel(activeSimdLevel());  // 按指令集选一次，所有作业共用
+	// 将着色结果写入TGA图像，对每个像素的MSAA采样进行平均，每个作业处理若干行
+	jobs.parallelFor(0, height, ROWS_PER_JOB, [&](int yBegin, int yEnd)
+	{
+		resolve(frame, zBuffer, colorBuffer, cntSample, x0, y0, width, yBegin, yEnd);
+	});
+}
+
+/**
+ * 分区域着色函数：整幅画面做一次几何阶段，再逐个区域光栅化并写入文件
+ * @param regionArena 区域内的临时数据(裁剪后的图元和分块列表)，每个区域结束时回收
+ * @param zBuffer 一个区域的深度缓冲区(REGION_SIZE x REGION_SIZE，MSAA)
+ * @param colorBuffer 一个区域的颜色缓冲区
+ * @param region 一个区域的解析结果，REGION_SIZE x REGION_SIZE
+ * @param writer 输出文件，已经按config.posterWidth x config.posterHeight打开
+ * 其余参数与PhongShading相同
+ */
+void posterShading(const RenderConfig &config, std::ostream &log, JobSystem &jobs, std::pmr::memory_resource *arena, FrameArena &regionArena, Model **modelData, Matrix *modelTrans, unsigned cntModel,
+	Matrix lightVpPV, float *shadowBuffer, const ShadowPyramid *shadowPyramid, const CubeShadowMap *cubeShadow,
+	float *zBuffer, Vec3f *colorBuffer, TGAImage &region, TGAStreamWriter &writer)
+{
+	Matrix view = lookat(config.eye, config.center, config.up);
+	Matrix project = projection(PI / 4.0f, float(config.posterWidth) / float(config.posterHeight), -0.01f, -10.0f);
+	Matrix vp = viewport(config.posterWidth, config.posterHeight);
+	Matrix PV = project * view;
+
+	// 几何阶段：整幅画面只做一次，三角形设置的结果在整幅画面的坐标系里，之后每个区域只平移和裁剪
+	std::pmr::vector<PrimitiveBins> bins(arena);
+	std::pmr::vector<ShaderStorage> storage(cntModel, arena);
+	std::pmr::vector<const IShader *> shaders(cntModel, nullptr, arena);
+	bins.resize(cntModel);
+	SetupStats stats;
+	for (unsigned m = 0; m < cntModel; ++m)
+	{
+		PhongUniforms uniforms = sceneUniforms(config, modelData[m], modelTrans[m], config.eye, vp * project * view, lightVpPV, shadowBuffer, shadowPyramid, cubeShadow);
+		Material material = Material::fromModel(*modelData[m], true);
+		shaders[m] = &createShader(config.shading, material, 1, uniforms, storage[m]);
+
+		std::pmr::vector<int> meshlets(arena);
+		meshlets.reserve(modelData[m]->nmeshlets());
+		for (int c = 0; c < modelData[m]->nmeshlets(); ++c)
+		{
+			const Meshlet &meshlet = modelData[m]->meshlet(c);
+			if (frustumVisible(meshlet.bboxMin, meshlet.bboxMax, PV * modelTrans[m]))
+				meshlets.push_back(c);
+		}
+		DrawCall draw = { modelData[m], shaders[m], modelTrans[m], PV, CULL_BACK, true, config.posterWidth, config.posterHeight, D_MSAA, CNT_SAMPLE };
+		geometryStage(jobs, draw, meshlets, bins[m], &stats);
+	}
+	printSetupStats(log, "poster", stats);
+
+	// 逐个区域：清除 -> 按模型顺序光栅化裁剪后的图元 -> 解析 -> 写入文件对应的矩形
+	unsigned cntRegion = 0;
+	for (int ry = 0; ry < int(config.posterHeight); ry += REGION_SIZE)
+	{
+		for (int rx = 0; rx < int(config.posterWidth); rx += REGION_SIZE)
+		{
+			Vec2i rectMin(rx, ry), rectMax(std::min(rx + REGION_SIZE, int(config.posterWidth)) - 1, std::min(ry + REGION_SIZE, int(config.posterHeight)) - 1);
+			jobs.parallelFor(0, REGION_SIZE * REGION_SIZE * CNT_SAMPLE, REGION_SIZE * CNT_SAMPLE * ROWS_PER_JOB, [&](int begin, int end)
+			{
+				for (int i = begin; i < end; ++i)
+				{
+					zBuffer[i] = -std::numeric_limits<float>::max();  // 初始化深度为负无穷
+					colorBuffer[i] = Vec3f(0.0f, 0.0f, 0.0f);  // 初始化颜色为黑色
+				}
+			});
+			for (unsigned m = 0; m < cntModel; ++m)
+			{
+				PrimitiveBins cropped(&regionArena);
+				cropBins(bins[m], rectMin, rectMax, cropped);
+				rasterizeTiles(jobs, cropped, *shaders[m], colorBuffer, zBuffer, REGION_SIZE, REGION_SIZE, D_MSAA, CNT_SAMPLE, nullptr);
+			}
+			writeFrame(jobs, region, zBuffer, colorBuffer, CNT_SAMPLE);
+			{
+				UncountedHeapScope uncounted;  // 写文件不属于渲染，不计入堆分配
+				writer.write_region(rx, ry, region, rectMax.x - rx + 1, rectMax.y - ry + 1);
+			}
+			regionArena.reset();  // 区域结束，回收裁剪后的图元
+			cntRegion++;
+		}
+	}
+	log << "poster: " << config.posterWidth << "x" << config.posterHeight << " in " << cntRegion << " regions of " << REGION_SIZE << "x" << REGION_SIZE
+		<< ", region arena peak " << regionArena.peak() / 1024 << " KB" << std::endl;
+}
+
+} // namespace
+
+// validate函数：检查尺寸、视图数以及多视图和分区域渲染不能同时使用
+bool RenderConfig::validate(std::string &error) const
+{
+	if (width < 1 || height < 1 || shadowWidth < 1 || shadowHeight < 1) error = "image sizes must be positive";
+	else if (cntView < 1 || cntView > MAX_VIEWS) error = "views must be 1-" + std::to_string(MAX_VIEWS);
+	else if (posterWidth > MAX_POSTER_SIZE || posterHeight > MAX_POSTER_SIZE || (posterWidth == 0) != (posterHeight == 0)) error = "bad poster size";
+	else if (posterWidth && cntView > 1) error = "poster renders a single view, it cannot be combined with multiple views";
+	else if (compositor && (posterWidth || cntView > 1)) error = "depth compositing supports single-view rendering only";
+	else return true;
+	return false;
+}
+
+// 构造函数：创建工作线程和每帧的临时内存，初始容量按光源类型和视图数估计
+RenderContext::RenderContext(const RenderConfig &config)
+	: config_(config), jobs_(config.cntWorker),
+	arena_(jobs_, (config.light == LIGHT_POINT ? FRAME_ARENA_SIZE_POINT : FRAME_ARENA_SIZE) + (config.cntView - 1) * FRAME_ARENA_SIZE_VIEW),
+	log_(config.log ? config.log->rdbuf() : nullptr),
+	frames_(config.cntView, TGAImage(config.width, config.height, TGAImage::RGB)),
+	depth_(config.shadowWidth, config.shadowHeight, TGAImage::RGB)
+{
+}
+
+/**
+ * 渲染场景：搭建渲染图(阴影、着色、解析等通道)并执行cntFrame帧
+ * 着色方式、光源、视图数和分区域渲染都由上下文的设置决定
+ */
+bool RenderContext::render(Model **modelData, Matrix *modelTrans, bool *modelOccluder, unsigned cntModel, const std::string &outputDir, int cntFrame)
+{
+	const RenderConfig &config = config_;
+	JobSystem &jobs = jobs_;
+	FrameArena &arena = arena_;
+	std::ostream &log = log_;
+	bool writeFiles = !outputDir.empty() && (!config.compositor || config.compositor->rank() == 0);  // 分布式渲染时只有0号进程输出
+	bool compositeFailed = false;  // 与其他进程合并是否失败，阴影通道和解析通道有依赖关系，不会同时写
+	ScreenRect regionRect = { regionMin_, regionMax_ };
+	const ScreenRect *shadeRect = hasRegion_ ? &regionRect : nullptr;  // renderRegion时着色和解析只处理的区域
+	if (config.posterWidth && !writeFiles)
+	{
+		log << "poster rendering streams to a file, it needs an output directory" << std::endl;
+		return false;
+	}
+	if (writeFiles && !std::filesystem::exists(outputDir)) {
+		std::filesystem::create_directories(outputDir);
+	}
+
+	// 渲染图：每个通道声明读写的资源，没有依赖关系的通道并发执行
+	// 例如深度图的可视化和写文件与遮挡通道、着色通道同时进行
+	RenderGraph graph;
+	int hShadowZ = graph.createBuffer("shadow zbuffer", config.shadowWidth * config.shadowHeight * sizeof(float));  // 阴影深度缓冲区
+	int hShadowColor = graph.createBuffer("shadow colorbuffer", config.shadowWidth * config.shadowHeight * sizeof(Vec3f));  // 阴影颜色缓冲区
+	int hZ = graph.createBuffer("zbuffer", config.width * config.height * CNT_SAMPLE * sizeof(float));  // 深度缓冲区
+	int hColor = graph.createBuffer("colorbuffer", config.width * config.height * CNT_SAMPLE * sizeof(Vec3f));  // 颜色缓冲区
+	int hLight = graph.importResource("light matrix");      // 光源变换矩阵，由阴影通道产生
+	int hShadowPyramid = graph.importResource("shadow pyramid"); // 阴影深度金字塔，由阴影通道产生
+	int hOcclusion = graph.importResource("occlusion");     // 遮挡缓冲区
+	int hDepthImage = graph.importResource("depth.tga");    // 输出的深度图像
+	int hFrameImage = graph.importResource("frame.tga");    // 输出的渲染图像
+
+	TGAImage &depth = depth_;      // 深度图像
+	TGAImage &frame = frames_[0];  // 输出图像，多视图时是第0个视图
+	OcclusionBuffer occlusion(config.width / 2, config.height / 2);  // 低分辨率遮挡缓冲区
+	Matrix lightVpPV;  // 光源视图-投影-视口变换组合矩阵
+	DepthTiles shadowDepthTiles(config.shadowWidth, config.shadowHeight, D_NonMSAA, 1);  // 阴影深度缓冲区的压缩分块
+	ShadowPyramid shadowPyramid(config.shadowWidth, config.shadowHeight);  // 阴影贴图的最小/最大深度金字塔
+	// 点光源的立方体阴影贴图，方向光模式用不到，只分配1x1的面
+	CubeShadowMap cubeShadow(config.light == LIGHT_POINT ? CUBE_SHADOW_SIZE : 1, CUBE_SHADOW_NEAR, CUBE_SHADOW_FAR);
+	cubeShadow.setCenter(config.pointLightPos);
+	DepthTiles depthTiles(config.width, config.height, D_MSAA, CNT_SAMPLE);   // 深度缓冲区的压缩分块
+	// 区域渲染时缓冲区只用到区域大小的一段，深度压缩的分块是按整幅画面划分的，不压缩(压缩是无损的，结果不变)
+	bool compressShadow = DEPTH_COMPRESSION && shadowDepthTiles.enabled(), compressDepth = DEPTH_COMPRESSION && depthTiles.enabled() && !shadeRect;
+
+	// 阴影通道：从光源角度渲染深度图，并获取光源变换矩阵
+	graph.addPass("shadow", {}, { hShadowZ, hShadowColor, hLight, hShadowPyramid }, [&]()
+	{
+		float *shadowZBuffer = graph.buffer<float>(hShadowZ);
+		Vec3f *shadowColorBuffer = graph.buffer<Vec3f>(hShadowColor);
+		// 瞬态缓冲区的内存可能被复用过，先初始化（按行分块并行）；压缩时深度只需快速清除
+		if (compressShadow) shadowDepthTiles.clear();
+		jobs.parallelFor(0, config.shadowWidth * config.shadowHeight, config.shadowWidth * ROWS_PER_JOB, [&](int begin, int end)
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				if (!compressShadow) shadowZBuffer[i] = -std::numeric_limits<float>::max();  // 初始化阴影深度为负无穷
+				shadowColorBuffer[i] = Vec3f(0.0f, 0.0f, 0.0f);  // 初始化阴影颜色为黑色
+			}
+		});
+		if (config.light == LIGHT_POINT)
+		{
+			cubeShadowMapping(log, jobs, &arena, modelData, modelTrans, cntModel, cubeShadow);  // 点光源只渲染立方体阴影贴图
+			lightVpPV = Matrix::identity();
+			// 分布式渲染：六个面的深度和距离连续存放，一起与其他进程合并
+			std::size_t cntTexel = std::size_t(CUBE_FACES) * cubeShadow.size() * cubeShadow.size();
+			if (config.compositor && !config.compositor->allreduce(jobs, cubeShadow.zBuffer(0), cubeShadow.distanceBuffer(0), cntTexel, 1))
+				compositeFailed = true;
+		}
+		else
+		{
+			lightVpPV = shadowMapping(config, log, jobs, &arena, modelData, modelTrans, cntModel, shadowZBuffer, compressShadow ? &shadowDepthTiles : nullptr, shadowColorBuffer, depth);
+			// 分布式渲染：着色时需要整个场景的阴影，先与其他进程合并阴影贴图(颜色一起合并，深度图的可视化也是完整的)
+			if (config.compositor && !config.compositor->allreduce(jobs, shadowZBuffer, shadowColorBuffer, std::size_t(config.shadowWidth) * config.shadowHeight, 1))
+				compositeFailed = true;
+			shadowPyramid.build(jobs, shadowZBuffer);  // 着色时用它跳过不在半影区的PCF
+		}
+		log << "finish shadow depth buffer calculation" << std::endl;  // 输出进度信息
+	});
+
+	// 深度可视化通道：将深度缓冲区写入图像并保存
+	graph.addPass("depth visualize", { hShadowColor }, { hDepthImage }, [&]()
+	{
+		writeDepth(jobs, depth, graph.buffer<Vec3f>(hShadowColor));
+		if (!writeFiles) return;
+		UncountedHeapScope uncounted;  // 写文件不属于渲染，不计入堆分配
+		depth.write_tga_file(outputDir + "/new_depth.tga");  // 保存深度图像
+		log << "finish writing depth.tga" << std::endl;  // 输出进度信息
+	});
+
+	// 多视图时每个视图的缓冲区和输出图像，第0个视图沿用hZ/hColor
+	int hViewZ[MAX_VIEWS], hViewColor[MAX_VIEWS], hViewImage[MAX_VIEWS];
+	// 分区域渲染时的输出文件和区域内的临时数据
+	TGAStreamWriter posterWriter;
+	TGAImage region(config.posterWidth ? REGION_SIZE : 0, config.posterWidth ? REGION_SIZE : 0, TGAImage::RGB);
+	FrameArena regionArena(jobs, config.posterWidth ? REGION_ARENA_SIZE : 0);
+	if (config.posterWidth)
+	{
+		// 区域的缓冲区在通道之间可以复用，与单视图的hZ/hColor一样由渲染图分配
+		int hRegionZ = graph.createBuffer("region zbuffer", REGION_SIZE * REGION_SIZE * CNT_SAMPLE * sizeof(float));
+		int hRegionColor = graph.createBuffer("region colorbuffer", REGION_SIZE * REGION_SIZE * CNT_SAMPLE * sizeof(Vec3f));
+		graph.addPass("poster", { hShadowZ, hLight, hShadowPyramid }, { hRegionZ, hRegionColor, hFrameImage }, [&, hRegionZ, hRegionColor]()
+		{
+			{
+				UncountedHeapScope uncounted;  // 打开文件不属于渲染
+				posterWriter.open(outputDir + "/new_frame_poster.tga", config.posterWidth, config.posterHeight, TGAImage::RGB);
+			}
+			posterShading(config, log, jobs, &arena, regionArena, modelData, modelTrans, cntModel, lightVpPV, graph.buffer<float>(hShadowZ), &shadowPyramid,
+				config.light == LIGHT_POINT ? &cubeShadow : nullptr, graph.buffer<float>(hRegionZ), graph.buffer<Vec3f>(hRegionColor), region, posterWriter);
+			UncountedHeapScope uncounted;
+			posterWriter.close();
+			log << "finish writing frame_poster.tga" << std::endl;  // 输出进度信息
+		});
+	}
+	else if (config.cntView == 1)
+	{
+		// 遮挡通道：先把遮挡体画进低分辨率遮挡缓冲区，与阴影通道互不依赖
+		graph.addPass("occlusion", {}, { hOcclusion }, [&]()
+		{
+			occlusionPass(config, modelData, modelTrans, modelOccluder, cntModel, occlusion);
+		});
+
+		// 着色通道：从相机角度使用Phong着色模型渲染场景
+		graph.addPass("shading", { hShadowZ, hLight, hShadowPyramid, hOcclusion }, { hZ, hColor }, [&]()
+		{
+			auto start = std::chrono::steady_clock::now();
+			float *zBuffer = graph.buffer<float>(hZ);
+			Vec3f *colorBuffer = graph.buffer<Vec3f>(hColor);
+			if (compressDepth) depthTiles.clear();
+			int width = shadeRect ? shadeRect->width() : int(config.width), height = shadeRect ? shadeRect->height() : int(config.height);  // 用到的缓冲区大小
+			jobs.parallelFor(0, width * height * CNT_SAMPLE, width * CNT_SAMPLE * ROWS_PER_JOB, [&](int begin, int end)
+			{
+				for (int i = begin; i < end; ++i)
+				{
+					if (!compressDepth) zBuffer[i] = -std::numeric_limits<float>::max();  // 初始化深度为负无穷
+					colorBuffer[i] = Vec3f(0.0f, 0.0f, 0.0f);  // 初始化颜色为黑色
+				}
+			});
+			PhongShading(config, log, jobs, &arena, modelData, modelTrans, cntModel, zBuffer, compressDepth ? &depthTiles : nullptr, colorBuffer, lightVpPV, graph.buffer<float>(hShadowZ), &shadowPyramid, config.light == LIGHT_POINT ? &cubeShadow : nullptr, frame, &occlusion, shadeRect);
+			shadingMs_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			log << "finish shading" << std::endl;  // 输出进度信息
+		});
+
+		// 解析通道：对MSAA采样求平均，写入图像并保存
+		graph.addPass("resolve", { hZ, hColor }, { hFrameImage }, [&]()
+		{
+			if (config.compositor)
+			{
+				// 分布式渲染：按采样深度合并到0号进程，只有0号进程解析和输出
+				if (!config.compositor->reduce(jobs, graph.buffer<float>(hZ), graph.buffer<Vec3f>(hColor), std::size_t(config.width) * config.height, CNT_SAMPLE))
+					compositeFailed = true;
+				if (config.compositor->rank() != 0) return;
+			}
+			writeFrame(jobs, frame, graph.buffer<float>(hZ), graph.buffer<Vec3f>(hColor), CNT_SAMPLE, shadeRect);
+			if (!writeFiles) return;
+			UncountedHeapScope uncounted;  // 写文件不属于渲染，不计入堆分配
+			frame.write_tga_file(outputDir + "/new_frame.tga");  // 保存渲染图像
+			log << "finish writing frame.tga" << std::endl;  // 输出进度信息
+		});
+	}
+	else
+	{
+		for (unsigned v = 0; v < config.cntView; ++v)
+		{
+			std::string name = "view " + std::to_string(v);
+			hViewZ[v] = v == 0 ? hZ : graph.createBuffer(name + " zbuffer", config.width * config.height * CNT_SAMPLE * sizeof(float));
+			hViewColor[v] = v == 0 ? hColor : graph.createBuffer(name + " colorbuffer", config.width * config.height * CNT_SAMPLE * sizeof(Vec3f));
+			hViewImage[v] = graph.importResource(name + " frame.tga");
+		}
+
+		// 多视图着色通道：所有视图在一个通道里渲染，共用世界空间变换和视锥剔除
+		std::vector<int> viewWrites(hViewZ, hViewZ + config.cntView);
+		viewWrites.insert(viewWrites.end(), hViewColor, hViewColor + config.cntView);
+		graph.addPass("multi-view shading", { hShadowZ, hLight, hShadowPyramid }, viewWrites, [&]()
+		{
+			View views[MAX_VIEWS];
+			for (unsigned v = 0; v < config.cntView; ++v)
+				views[v] = { viewEye(config, v), graph.buffer<float>(hViewZ[v]), graph.buffer<Vec3f>(hViewColor[v]) };
+			jobs.parallelFor(0, int(config.cntView * config.height), ROWS_PER_JOB, [&](int begin, int end)
+			{
+				for (int row = begin; row < end; ++row)
+				{
+					const View &view = views[row / config.height];
+					size_t first = size_t(row % config.height) * config.width * CNT_SAMPLE;
+					for (size_t i = first; i < first + config.width * CNT_SAMPLE; ++i)
+					{
+						view.zBuffer[i] = -std::numeric_limits<float>::max();  // 初始化深度为负无穷
+						view.colorBuffer[i] = Vec3f(0.0f, 0.0f, 0.0f);  // 初始化颜色为黑色
+					}
+				}
+			});
+			multiViewShading(config, log, jobs, &arena, modelData, modelTrans, cntModel, views, lightVpPV, graph.buffer<float>(hShadowZ), &shadowPyramid, config.light == LIGHT_POINT ? &cubeShadow : nullptr);
+			log << "finish multi-view shading" << std::endl;  // 输出进度信息
+		});
+
+		// 每个视图一个解析通道，彼此没有依赖，并发执行
+		for (unsigned v = 0; v < config.cntView; ++v)
+		{
+			graph.addPass("resolve view " + std::to_string(v), { hViewZ[v], hViewColor[v] }, { hViewImage[v] }, [&, v]()
+			{
+				writeFrame(jobs, frames_[v], graph.buffer<float>(hViewZ[v]), graph.buffer<Vec3f>(hViewColor[v]), CNT_SAMPLE);
+				if (!writeFiles) return;
+				UncountedHeapScope uncounted;  // 写文件不属于渲染，不计入堆分配
+				frames_[v].write_tga_file(outputDir + "/new_frame_view" + std::to_string(v) + ".tga");  // 保存第v个视图的渲染图像
+				log << "finish writing frame_view" << v << ".tga" << std::endl;  // 输出进度信息
+			});
+		}
+	}
+
+	graph.compile();
+	log << "render graph: " << graph.npasses() << " passes, transient memory " << graph.allocatedBytes() / 1024
+		<< " KB (" << graph.transientBytes() / 1024 << " KB without aliasing)" << std::endl;
+	for (int f = 0; f < cntFrame; ++f)
+	{
+		std::size_t cntHeap = heapAllocations();
+		graph.execute(jobs);
+		cntHeap = heapAllocations() - cntHeap;
+		// 输出本帧的临时内存用量，稳态下堆分配次数应当为0(计数是整个进程的，其他上下文同时渲染时也会计入)
+		// 堆分配只有可执行程序安装了计数钩子时才能统计
+		log << "frame " << f << ": arena " << arena.used() / 1024 << " KB (peak " << arena.peak() / 1024 << " KB, capacity "
+			<< arena.capacity() / 1024 << " KB)";
+		if (heapAllocationsCounted()) log << ", heap allocations " << cntHeap;
+		log << std::endl;
+		arena.reset();  // 帧结束，整体回收临时数据
+		log << "Frame Over" << std::endl << std::endl;  // 输出阶段完成信息
+	}
+	if (compositeFailed) log << "compositing with the other processes failed" << std::endl;
+	return !compositeFailed;
+}
+
+// renderRegion函数：检查区域后用render渲染一帧，渲染期间记下区域，着色和解析通道据此只处理区域
+bool RenderContext::renderRegion(Model **modelData, Matrix *modelTrans, bool *modelOccluder, unsigned cntModel, Vec2i rectMin, Vec2i rectMax)
+{
+	if (config_.cntView != 1 || config_.posterWidth || config_.compositor)
+	{
+		log_ << "region rendering supports plain single-view rendering only" << std::endl;
+		return false;
+	}
+	if (rectMin.x < 0 || rectMin.y < 0 || rectMin.x > rectMax.x || rectMin.y > rectMax.y || rectMax.x >= int(config_.width) || rectMax.y >= int(config_.height)
+		|| rectMin.x % TILE_SIZE || rectMin.y % TILE_SIZE)
+	{
+		log_ << "bad region (" << rectMin.x << ", " << rectMin.y << ")-(" << rectMax.x << ", " << rectMax.y << ")" << std::endl;
+		return false;
+	}
+	hasRegion_ = true;
+	regionMin_ = rectMin;
+	regionMax_ = rectMax;
+	bool ok = render(modelData, modelTrans, modelOccluder, cntModel, "", 1);
+	hasRegion_ = false;
+	return ok;
+}
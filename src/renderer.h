@@ -0,0 +1,159 @@
+#pragma once // 防止头文件被重复包含
+
+#include <cstddef>    // 包含std::size_t
+#include <iostream>   // 包含std::ostream, std::cerr
+#include <string>     // 包含std::string
+#include <vector>     // 包含std::vector
+
+#include "geometry.h" // 包含Vec3f和Matrix
+#include "tgaimage.h" // 包含TGAImage，渲染结果
+#include "model.h"    // 包含Model类
+#include "jobs.h"     // 包含JobSystem类
+#include "arena.h"    // 包含FrameArena类
+
+class DepthCompositor;  // 分布式渲染的深度合并，见composite.h
+
+// 渲染器库(librasterizer，CMakeLists.txt中的rasterizer目标)的对外接口：除main.cpp之外的所有源文件组成这个库，
+// main.cpp只是建立在它上面的命令行程序(rasterizer_cli目标)
+// 渲染器的所有状态都在RenderContext里，不同的RenderContext互不共享可变状态，可以在不同线程上同时渲染
+
+/**
+ * ShadingMode：着色模式
+ * 预览模式在顶点阶段算完光照(包括单次采样的阴影)，片段阶段只剩一次颜色插值，用于快速出草图
+ */
+enum ShadingMode
+{
+	SHADING_PHONG,    // 逐像素Blinn-Phong，法线贴图和4x4 PCF阴影(按材质特性选择变体)
+	SHADING_GOURAUD,  // 逐顶点光照，使用插值的顶点法线
+	SHADING_FLAT,     // 逐顶点光照，使用三角形的几何法线，每个面的光照相同
+	SHADING_MODE_COUNT
+};
+const char *const SHADING_MODE_NAMES[SHADING_MODE_COUNT] = { "phong", "gouraud", "flat" };
+
+// 投射阴影的光源类型
+enum LightMode
+{
+	LIGHT_DIRECTIONAL,  // 方向光，正交投影的阴影贴图
+	LIGHT_POINT,        // 点光源，立方体阴影贴图
+	LIGHT_MODE_COUNT
+};
+const char *const LIGHT_MODE_NAMES[LIGHT_MODE_COUNT] = { "directional", "point" };
+
+/**
+ * LightColor结构：表示光源的颜色属性
+ * 包含环境光、漫反射和镜面反射三种颜色分量
+ */
+struct LightColor
+{
+	Vec3f ambient, diffuse, specular;  // 环境光、漫反射和镜面反射颜色
+
+	/**
+	 * 构造函数：初始化光源颜色
+	 * @param ambi 环境光颜色
+	 * @param diff 漫反射颜色
+	 * @param spec 镜面反射颜色
+	 */
+	LightColor(Vec3f ambi = Vec3f(), Vec3f diff = Vec3f(), Vec3f spec = Vec3f())
+	{
+		ambient = ambi;
+		diffuse = diff;
+		specular = spec;
+	}
+};
+
+const unsigned MAX_VIEWS = 8;            // 多视图渲染的最大视图数
+const unsigned MAX_POSTER_SIZE = 65535;  // 分区域渲染的最大宽高，TGA文件头中宽高是16位的
+
+/**
+ * RenderConfig结构：一个渲染上下文的全部设置，默认值就是命令行程序的默认场景
+ */
+struct RenderConfig
+{
+	unsigned width = 800, height = 800;              // 输出图像的宽高
+	unsigned shadowWidth = 800, shadowHeight = 800;  // 方向光阴影贴图的宽高
+
+	Vec3f lightPos = Vec3f(1.0f, 1.0f, 1.0f);  // 方向光的光照方向
+	// 光源颜色：环境光、漫反射和镜面反射分量
+	LightColor lightColor = LightColor(Vec3f(0.3f, 0.3f, 0.3f), Vec3f(1.0f, 1.0f, 1.0f), Vec3f(0.5f, 0.5f, 0.5f));
+	Vec3f eye = Vec3f(1.0f, 1.0f, 3.0f);     // 相机位置
+	Vec3f center = Vec3f(0.0f, 0.0f, 0.0f);  // 相机看向的点
+	Vec3f up = Vec3f(0.0f, 1.0f, 0.0f);      // 相机上方向
+
+	ShadingMode shading = SHADING_PHONG;       // 着色模式
+	LightMode light = LIGHT_DIRECTIONAL;       // 投射阴影的光源类型
+	Vec3f pointLightPos = Vec3f(0.6f, 0.9f, 0.6f);  // 点光源位置
+
+	// 多视图渲染：同一帧从cntView个相机渲染，相机绕center所在的竖直轴均匀分布(转台的关键帧)，第0个就是eye
+	// 1表示普通的单视图渲染，最多MAX_VIEWS个
+	unsigned cntView = 1;
+
+	// 分区域渲染：输出posterWidth x posterHeight的图像(可以远大于width x height)，直接写入文件，不能与多视图同时使用
+	// 几何阶段按整幅画面做一次，之后逐个区域光栅化、解析并写入文件，缓冲区只有一个区域大；0表示不分区域
+	unsigned posterWidth = 0, posterHeight = 0;
+
+	// 排序在后的分布式渲染：不为空时本进程只渲染场景的一部分模型，阴影贴图和最终画面都与其他进程按深度合并，
+	// 只有0号进程解析和输出画面。只支持单视图渲染
+	DepthCompositor *compositor = nullptr;
+
+	unsigned cntWorker = 0;           // 上下文自己的工作线程数，0表示硬件线程数 - 1
+	std::ostream *log = &std::cerr;   // 进度和统计信息的输出，nullptr表示不输出
+
+	// 检查设置是否有效，无效时error为原因
+	bool validate(std::string &error) const;
+};
+
+/**
+ * RenderContext类：一个可重入的渲染器实例
+ * 拥有自己的设置、工作线程、每帧的临时内存和输出图像，模型由调用者持有(只读，可以在多个上下文之间共享)。
+ * 同一个上下文同一时刻只能由一个线程调用render；不同的上下文可以同时渲染，例如服务进程里并发地渲染多张缩略图
+ */
+class RenderContext
+{
+public:
+	// config必须有效(见RenderConfig::validate)
+	explicit RenderContext(const RenderConfig &config);
+	RenderContext(const RenderContext &) = delete;
+	RenderContext &operator=(const RenderContext &) = delete;
+
+	/**
+	 * 渲染cntFrame帧场景，结果保存在frame()/viewFrame()中
+	 * @param modelData 模型数据数组
+	 * @param modelTrans 模型变换矩阵数组
+	 * @param modelOccluder 每个模型是否作为遮挡体
+	 * @param cntModel 模型数量
+	 * @param outputDir 输出目录，不存在时创建；为空时不写文件(分区域渲染必须写文件)
+	 * @param cntFrame 渲染的帧数，第一帧之后各处容量都已就绪，之后的帧没有堆分配
+	 * @return 是否成功
+	 */
+	bool render(Model **modelData, Matrix *modelTrans, bool *modelOccluder, unsigned cntModel, const std::string &outputDir, int cntFrame = 1);
+
+	/**
+	 * 只渲染画面中的一个矩形区域(一帧，不写文件)，用于排序在前的分布式渲染：每个进程渲染画面的一部分
+	 * 网格簇先按区域的视锥剔除，图元再裁到区域里光栅化，区域内的像素与渲染整幅画面的结果完全相同(深度压缩是无损的)；
+	 * 结果写在frame()的对应矩形里，矩形之外的像素不变。只支持单视图渲染，不能与分区域渲染或深度合并同时使用
+	 * @param rectMin, rectMax 区域在画面中的像素矩形(闭区间)，rectMin必须是TILE_SIZE的倍数
+	 * 其余参数与render相同
+	 */
+	bool renderRegion(Model **modelData, Matrix *modelTrans, bool *modelOccluder, unsigned cntModel, Vec2i rectMin, Vec2i rectMax);
+
+	const RenderConfig &config() const { return config_; }
+	JobSystem &jobs() { return jobs_; }
+
+	// 最近一次渲染的结果：单视图的输出图像，多视图时第v个视图的输出图像，方向光的阴影深度图
+	const TGAImage &frame() const { return frames_[0]; }
+	const TGAImage &viewFrame(unsigned v) const { return frames_[v]; }
+	const TGAImage &depth() const { return depth_; }
+	// 最近一帧单视图着色通道的耗时(毫秒)，只包含随画面区域变化的那部分开销(阴影通道不论区域大小都要完整地做)
+	double shadingMs() const { return shadingMs_; }
+
+private:
+	RenderConfig config_;
+	JobSystem jobs_;              // 上下文内所有阶段共用的工作线程
+	FrameArena arena_;            // 每帧的临时数据，帧结束时整体回收
+	std::ostream log_;            // 写到config.log的输出流，config.log为空时丢弃所有输出
+	std::vector<TGAImage> frames_; // 每个视图的输出图像
+	TGAImage depth_;              // 阴影深度图的可视化
+	bool hasRegion_ = false;      // renderRegion正在渲染一个区域，区域是[regionMin_, regionMax_]
+	Vec2i regionMin_, regionMax_;
+	double shadingMs_ = 0.0;
+};
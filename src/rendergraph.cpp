@@ -0,0 +1,167 @@
+#include <algorithm> // 包含std::find
+
+#include "rendergraph.h" // 包含RenderGraph类的声明
+
+// createBuffer函数：登记一个瞬态缓冲区，内存在compile时统一分配
+int RenderGraph::createBuffer(const std::string &name, std::size_t bytes)
+{
+	resources_.push_back(Resource{ name, bytes, true, -1, {}, nullptr });
+	return int(resources_.size()) - 1;
+}
+
+// importResource函数：登记一个外部资源，只参与依赖推导
+int RenderGraph::importResource(const std::string &name)
+{
+	resources_.push_back(Resource{ name, 0, false, -1, {}, nullptr });
+	return int(resources_.size()) - 1;
+}
+
+// addPass函数：登记一个通道，依赖关系在compile时统一推导
+void RenderGraph::addPass(const std::string &name, const std::vector<int> &reads, const std::vector<int> &writes, PassFunc execute)
+{
+	Pass pass;
+	pass.name = name;
+	pass.reads = reads;
+	pass.writes = writes;
+	pass.execute = std::move(execute);
+	pass.cntDependency = 0;
+	passes_.push_back(std::move(pass));
+	compiled_ = false;
+}
+
+// addDependency函数：添加依赖边from -> to，同一对通道之间只保留一条边
+void RenderGraph::addDependency(int from, int to)
+{
+	if (from < 0 || from == to) return;
+	std::vector<int> &successors = passes_[from].successors;
+	if (std::find(successors.begin(), successors.end(), to) != successors.end()) return;
+	successors.push_back(to);
+	passes_[to].cntDependency++;
+}
+
+// compile函数：推导依赖、计算传递闭包，再给瞬态缓冲区分配内存
+void RenderGraph::compile()
+{
+	int cntPass = int(passes_.size());
+	for (Pass &pass : passes_)
+	{
+		pass.successors.clear();
+		pass.cntDependency = 0;
+	}
+	for (Resource &resource : resources_)
+		resource.users.clear();
+
+	// 按添加顺序模拟资源访问：读依赖上一个写者，写依赖上一个写者和之后所有的读者
+	std::vector<int> lastWriter(resources_.size(), -1);
+	std::vector<std::vector<int>> readers(resources_.size());
+	for (int i = 0; i < cntPass; ++i)
+	{
+		for (int r : passes_[i].reads)
+		{
+			addDependency(lastWriter[r], i);
+			readers[r].push_back(i);
+			resources_[r].users.push_back(i);
+		}
+		for (int r : passes_[i].writes)
+		{
+			addDependency(lastWriter[r], i);
+			for (int reader : readers[r]) addDependency(reader, i);
+			readers[r].clear();
+			lastWriter[r] = i;
+			resources_[r].users.push_back(i);
+		}
+	}
+
+	// 依赖边总是从先添加的通道指向后添加的通道，按顺序一遍就能求出传递闭包
+	for (int i = 0; i < cntPass; ++i)
+		passes_[i].ancestors.assign(cntPass, false);
+	for (int i = 0; i < cntPass; ++i)
+	{
+		for (int s : passes_[i].successors)
+		{
+			std::vector<bool> &ancestors = passes_[s].ancestors;
+			ancestors[i] = true;
+			for (int k = 0; k < i; ++k)
+				if (passes_[i].ancestors[k]) ancestors[k] = true;
+		}
+	}
+
+	// 内存别名：缓冲区B可以复用块的条件是块中已有缓冲区的所有通道都是B的每个通道的祖先
+	// 通道可能并发执行，所以只看添加顺序是不够的，必须有依赖关系保证先后
+	blocks_.clear();
+	transientBytes_ = allocatedBytes_ = 0;
+	for (Resource &resource : resources_)
+	{
+		if (!resource.transient) continue;
+		transientBytes_ += resource.bytes;
+		if (resource.users.empty()) continue; // 没有通道使用，不分配
+
+		int best = -1;
+		for (int b = 0; b < int(blocks_.size()); ++b)
+		{
+			bool free = true;
+			for (int u : resource.users)
+				for (int owner : blocks_[b].users)
+					if (!passes_[u].ancestors[owner]) free = false;
+			if (!free) continue;
+			// 优先选能装下的最小块，都装不下时选最大的块扩容
+			if (best < 0) { best = b; continue; }
+			bool fits = blocks_[b].bytes >= resource.bytes, bestFits = blocks_[best].bytes >= resource.bytes;
+			if ((fits && (!bestFits || blocks_[b].bytes < blocks_[best].bytes)) || (!fits && !bestFits && blocks_[b].bytes > blocks_[best].bytes))
+				best = b;
+		}
+		if (best < 0)
+		{
+			blocks_.push_back(Block{ 0, {}, {} });
+			best = int(blocks_.size()) - 1;
+		}
+		Block &block = blocks_[best];
+		block.bytes = std::max(block.bytes, resource.bytes);
+		block.users.insert(block.users.end(), resource.users.begin(), resource.users.end());
+		resource.block = best;
+	}
+	for (Block &block : blocks_)
+	{
+		block.storage.resize((block.bytes + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t));
+		allocatedBytes_ += block.bytes;
+	}
+	for (Resource &resource : resources_)
+		resource.memory = resource.block >= 0 ? blocks_[resource.block].storage.data() : nullptr;
+	remaining_.reset(new std::atomic<int>[cntPass]);
+
+	compiled_ = true;
+}
+
+// runPass函数：执行通道，然后把依赖已全部满足的后续通道提交出去
+// 后续通道在本作业结束前提交，counter不会提前归零
+// 作业只捕获this和通道编号，能放进std::function内部，提交时不分配堆内存
+void RenderGraph::runPass(int i)
+{
+	passes_[i].execute();
+	for (int s : passes_[i].successors)
+	{
+		if (remaining_[s].fetch_sub(1, std::memory_order_acq_rel) == 1)
+			jobs_->submit([this, s]() { runPass(s); }, counter_);
+	}
+}
+
+// execute函数：提交所有没有依赖的通道并等待整张图执行完毕
+void RenderGraph::execute(JobSystem &jobs)
+{
+	if (!compiled_) compile();
+	int cntPass = int(passes_.size());
+	for (int i = 0; i < cntPass; ++i)
+		remaining_[i].store(passes_[i].cntDependency, std::memory_order_relaxed);
+
+	JobCounter counter;
+	jobs_ = &jobs;
+	counter_ = &counter;
+	for (int i = 0; i < cntPass; ++i)
+	{
+		if (passes_[i].cntDependency == 0)
+			jobs.submit([this, i]() { runPass(i); }, &counter);
+	}
+	jobs.wait(counter);
+	jobs_ = nullptr;
+	counter_ = nullptr;
+}
@@ -0,0 +1,83 @@
+#pragma once // 防止头文件被重复包含
+
+#include <atomic>     // 包含std::atomic，记录每个通道还有多少个依赖没有完成
+#include <cstddef>    // 包含std::size_t, std::max_align_t
+#include <functional> // 包含std::function，通道的执行函数
+#include <memory>     // 包含std::unique_ptr
+#include <string>     // 包含std::string，通道和资源的名字
+#include <vector>     // 包含std::vector
+
+#include "jobs.h"     // 包含JobSystem类，通道作为作业提交
+
+// RenderGraph类：一帧的渲染图
+// 每个通道(pass)声明自己读写哪些资源，渲染图据此推导通道之间的依赖：
+//   写后读(RAW)、读后写(WAR)、写后写(WAW)都会产生一条依赖边，其余通道可以并发执行
+// 瞬态(transient)缓冲区由渲染图分配内存，生命周期互不重叠的缓冲区共用同一块内存(别名)
+// 用法：createBuffer/importResource -> addPass -> compile -> execute
+class RenderGraph {
+public:
+	typedef std::function<void()> PassFunc;
+
+	RenderGraph() {}
+	RenderGraph(const RenderGraph &) = delete;
+	RenderGraph &operator=(const RenderGraph &) = delete;
+
+	// 声明一个瞬态缓冲区，返回资源句柄
+	// 内存可能与其他缓冲区共用，第一个写它的通道不能假设里面的内容，必须自己初始化
+	int createBuffer(const std::string &name, std::size_t bytes);
+
+	// 导入一个外部资源(例如输出图像、遮挡缓冲区)，渲染图只跟踪它的依赖，不管理它的内存
+	int importResource(const std::string &name);
+
+	// 添加一个通道，reads/writes为它读写的资源句柄，通道按添加顺序定义资源访问的先后
+	void addPass(const std::string &name, const std::vector<int> &reads, const std::vector<int> &writes, PassFunc execute);
+
+	// 编译：建立依赖关系，计算瞬态缓冲区的生命周期并分配(别名)内存
+	void compile();
+
+	// 执行：没有依赖的通道先提交，每个通道完成后提交依赖已全部满足的后续通道，返回前等待全部完成
+	// 同一张图可以每帧执行一次，compile之后执行本身不分配堆内存
+	void execute(JobSystem &jobs);
+
+	// 获取瞬态缓冲区的内存，compile之后才有效
+	template<class T> T *buffer(int handle) const { return reinterpret_cast<T *>(resources_[handle].memory); }
+
+	std::size_t transientBytes() const { return transientBytes_; } // 所有瞬态缓冲区大小之和
+	std::size_t allocatedBytes() const { return allocatedBytes_; } // 别名之后实际分配的内存
+	int npasses() const { return int(passes_.size()); }           // 通道数量
+
+private:
+	struct Resource {
+		std::string name;
+		std::size_t bytes;      // 瞬态缓冲区的大小，导入资源为0
+		bool transient;         // 是否由渲染图分配内存
+		int block;              // 分配到的内存块，-1表示没有分配
+		std::vector<int> users; // 读写它的所有通道
+		void *memory;           // 内存地址
+	};
+	struct Pass {
+		std::string name;
+		std::vector<int> reads, writes;
+		PassFunc execute;
+		std::vector<int> successors;   // 依赖本通道的通道
+		int cntDependency;             // 本通道依赖的通道数
+		std::vector<bool> ancestors;   // 在本通道之前必然已经完成的通道(依赖关系的传递闭包)
+	};
+	struct Block {
+		std::size_t bytes;                        // 块大小，取共用它的缓冲区中最大的
+		std::vector<int> users;                   // 共用它的缓冲区的所有通道
+		std::vector<std::max_align_t> storage;    // 按最大对齐分配的内存
+	};
+
+	std::vector<Resource> resources_;
+	std::vector<Pass> passes_;
+	std::vector<Block> blocks_;
+	std::unique_ptr<std::atomic<int>[]> remaining_; // 执行时每个通道还没完成的依赖数，compile时分配
+	JobSystem *jobs_ = nullptr;                     // 正在执行本图的调度器
+	JobCounter *counter_ = nullptr;                 // 本次执行的计数器
+	std::size_t transientBytes_ = 0, allocatedBytes_ = 0;
+	bool compiled_ = false;
+
+	void addDependency(int from, int to);                     // 添加依赖边from -> to (去重)
+	void runPass(int i);                                      // 执行通道i并释放它的后续通道
+};
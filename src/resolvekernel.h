@@ -0,0 +1,30 @@
+// 解析(resolve)核心：把MSAA采样点的颜色平均成像素，写入图像
+// 注意：这个文件没有#pragma once，renderer.cpp在每个指令集的命名空间里各包含一次，每次用不同的编译目标编译同一份代码
+// 这里是标量代码，宽向量上的代码由编译器按目标指令集生成；各命名空间中的浮点运算顺序相同，结果完全相同
+
+// resolveRows函数：解析缓冲区中[yBegin, yEnd)行，缓冲区宽width，第y行写到图像的第y0 + y行、从x0开始
+// 没有被渲染的采样点(深度仍是清除值)不计入颜色，平均时仍按cntSample除
+static void resolveRows(TGAImage &frame, const float *zBuffer, const Vec3f *colorBuffer, unsigned cntSample, int x0, int y0, int width, int yBegin, int yEnd)
+{
+	for (int y = yBegin; y < yEnd; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			if (x == 362 && y == 417)
+				x = x;  // 调试断点位置
+			float color[3] = { 0.0f, 0.0f, 0.0f };  // 初始化颜色为黑色
+			for (unsigned i = 0; i < cntSample; ++i)  // 遍历像素的所有采样点
+			{
+				// 如果采样点有深度值（被渲染）则累加颜色
+				unsigned idx = cntSample * (y*width + x) + i;
+				if (zBuffer[idx] > -std::numeric_limits<float>::max())
+				{
+					for (int c = 0; c < 3; ++c) color[c] += colorBuffer[idx][c];
+				}
+			}
+			// 计算平均颜色（MSAA抗锯齿原理），截断到[0, 255]再转换，超过255的浮点数直接转换成uint8_t会回绕(点光源附近的高光区域会变黑)
+			for (int c = 0; c < 3; ++c) color[c] = std::min(color[c] / float(cntSample), 255.0f);
+			frame.set(x0 + x, y0 + y, TGAColor(color[0], color[1], color[2], 255));  // 设置像素颜色
+		}
+	}
+}
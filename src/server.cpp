@@ -0,0 +1,183 @@
+#include <cerrno>       // 包含errno
+#include <cstring>      // 包含std::strerror, std::memset
+#include <iostream>     // 包含std::cerr
+#include <sstream>      // 包含std::istringstream，解析请求行
+
+#include <sys/socket.h> // 包含socket, bind, listen, accept, send, shutdown, setsockopt
+#include <sys/time.h>   // 包含timeval，读超时
+#include <sys/un.h>     // 包含sockaddr_un
+#include <unistd.h>     // 包含read, close, unlink
+
+#include "server.h"     // 包含serveRenderRequests的声明
+
+namespace {
+
+const int CLIENT_TIMEOUT_SECONDS = 5;  // 读取请求的超时时间(秒)
+
+// 请求解析的结果
+enum ParseResult { PARSE_RENDER, PARSE_SHUTDOWN, PARSE_ERROR };
+
+// readLine函数：从连接中读取一行(不含换行)，连接关闭且没有数据时返回false
+// 请求只有几行，逐字节读取足够简单
+bool readLine(int fd, std::string &line)
+{
+	line.clear();
+	char c;
+	for (;;)
+	{
+		ssize_t n = ::read(fd, &c, 1);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return !line.empty();
+		if (c == '\n') return true;
+		if (c != '\r') line.push_back(c);
+	}
+}
+
+// writeAll函数：把整个字符串写入连接，客户端已断开时不产生SIGPIPE
+void writeAll(int fd, const std::string &text)
+{
+	std::size_t done = 0;
+	while (done < text.size())
+	{
+		ssize_t n = ::send(fd, text.data() + done, text.size() - done, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return; // 客户端已经断开，丢弃回复
+		done += std::size_t(n);
+	}
+}
+
+// parseRequest函数：读取一个连接上的请求行，直到end或shutdown
+ParseResult parseRequest(int fd, RenderRequest &request, std::string &error)
+{
+	std::string line;
+	while (readLine(fd, line))
+	{
+		std::istringstream iss(line);
+		std::string command;
+		if (!(iss >> command)) continue; // 跳过空行
+		if (command == "model")
+		{
+			RequestModel model{ {}, Vec3f(0.0f, 0.0f, 0.0f), false };
+			if (!(iss >> model.path))
+			{
+				error = "model needs a path";
+				return PARSE_ERROR;
+			}
+			// 剩余部分：可选的平移量(三个数)和可选的occluder标记
+			std::vector<std::string> words;
+			for (std::string word; iss >> word;) words.push_back(word);
+			if (!words.empty() && words.back() == "occluder")
+			{
+				model.occluder = true;
+				words.pop_back();
+			}
+			if (!words.empty())
+			{
+				std::istringstream numbers(words.size() == 3 ? words[0] + " " + words[1] + " " + words[2] : std::string());
+				if (!(numbers >> model.translate.x >> model.translate.y >> model.translate.z))
+				{
+					error = "bad model line \"" + line + "\"";
+					return PARSE_ERROR;
+				}
+			}
+			request.models.push_back(model);
+		}
+		else if (command == "output")
+		{
+			if (!(iss >> request.outputDir))
+			{
+				error = "output needs a directory";
+				return PARSE_ERROR;
+			}
+		}
+		else if (command == "end")
+		{
+			if (request.models.empty()) error = "no models";
+			else if (request.outputDir.empty()) error = "no output directory";
+			else return PARSE_RENDER;
+			return PARSE_ERROR;
+		}
+		else if (command == "shutdown")
+		{
+			return PARSE_SHUTDOWN;
+		}
+		else
+		{
+			error = "unknown command \"" + command + "\"";
+			return PARSE_ERROR;
+		}
+	}
+	error = "connection closed before end";
+	return PARSE_ERROR;
+}
+
+} // namespace
+
+// serveRenderRequests函数：创建套接字后循环接受连接，每个连接解析一个请求并交给handler处理
+int serveRenderRequests(const std::string &socketPath, const RenderHandler &handler)
+{
+	sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(address.sun_path))
+	{
+		std::cerr << "socket path too long: " << socketPath << std::endl;
+		return 1;
+	}
+	std::strcpy(address.sun_path, socketPath.c_str());
+
+	int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0)
+	{
+		std::cerr << "socket: " << std::strerror(errno) << std::endl;
+		return 1;
+	}
+	::unlink(socketPath.c_str()); // 删除上次运行遗留的套接字文件
+	if (::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || ::listen(listener, 16) < 0)
+	{
+		std::cerr << "bind " << socketPath << ": " << std::strerror(errno) << std::endl;
+		::close(listener);
+		return 1;
+	}
+	std::cerr << "serving render requests on " << socketPath << std::endl;
+
+	bool running = true;
+	while (running)
+	{
+		int client = ::accept(listener, nullptr, nullptr);
+		if (client < 0)
+		{
+			if (errno == EINTR) continue;
+			std::cerr << "accept: " << std::strerror(errno) << std::endl;
+			break;
+		}
+		// 读超时：停住不发数据的客户端不能让服务一直阻塞
+		timeval timeout = { CLIENT_TIMEOUT_SECONDS, 0 };
+		::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		RenderRequest request;
+		std::string reply;
+		switch (parseRequest(client, request, reply))
+		{
+		case PARSE_RENDER:
+			reply = handler(request, reply) ? "ok " + reply : "error " + reply;
+			break;
+		case PARSE_SHUTDOWN:
+			reply = "ok shutdown";
+			running = false;
+			break;
+		case PARSE_ERROR:
+			reply = "error " + reply;
+			break;
+		}
+		writeAll(client, reply + "\n");
+		// 出错时请求可能还有没读的行，直接关闭会发出复位，客户端可能收不到回复：先关闭写方向，读完剩余数据再关闭
+		::shutdown(client, SHUT_WR);
+		char drain[256];
+		while (::read(client, drain, sizeof(drain)) > 0) {}
+		::close(client);
+	}
+
+	::close(listener);
+	::unlink(socketPath.c_str());
+	return 0;
+}
@@ -0,0 +1,33 @@
+#pragma once // 防止头文件被重复包含
+
+#include <functional> // 包含std::function，请求处理函数的类型
+#include <string>     // 包含std::string
+#include <vector>     // 包含std::vector
+
+#include "geometry.h" // 包含Vec3f
+
+// 渲染请求中的一个模型：.obj路径、平移量和是否作为遮挡体
+struct RequestModel {
+	std::string path;
+	Vec3f translate;
+	bool occluder;
+};
+
+// 渲染请求：场景描述(模型列表)和输出目录
+struct RenderRequest {
+	std::vector<RequestModel> models;
+	std::string outputDir;
+};
+
+// 请求处理函数：渲染请求描述的场景，返回true表示成功，reply为回复给客户端的一行文本(不含换行)
+typedef std::function<bool(const RenderRequest &request, std::string &reply)> RenderHandler;
+
+// 在本地Unix域套接字socketPath上监听渲染请求，逐个连接串行处理(每个请求本身已经用满所有工作线程)
+// 协议是按行的文本，每个连接一个请求：
+//   model <path.obj> [tx ty tz] [occluder]   添加一个模型，可重复多行
+//   output <dir>                             输出目录
+//   end                                      提交请求
+//   shutdown                                 停止服务
+// 服务端回复一行 "ok <reply>" 或 "error <reason>" 后关闭连接
+// 返回0表示收到shutdown正常退出，非0表示套接字创建失败
+int serveRenderRequests(const std::string &socketPath, const RenderHandler &handler);
@@ -0,0 +1,48 @@
+// 三角形设置的SIMD核心：有向面积、包围盒以及重心坐标、深度、1/w和所有插值变量的平面方程
+// 注意：这个文件没有#pragma once，gl.cpp在每个指令集的命名空间里各包含一次，每次用不同的编译目标编译同一份代码
+// 包含之前当前命名空间中要能看到simd.h中一个指令集的向量包装(LANES必须整除SETUP_BATCH)
+// 只用加减乘除和min/max，没有乘加融合，因此不同指令集算出的结果完全相同
+//
+// 三个顶点的值为q0, q1, q2时，平面方程的梯度为
+//   dq/dx = ((q1-q0)(Cy-Ay) - (q2-q0)(By-Ay)) / area2,  dq/dy = ((q2-q0)(Bx-Ax) - (q1-q0)(Cx-Ax)) / area2
+// 其中area2 = (B-A)x(C-A)是有向面积的两倍，与barycentric中的u.z相同
+static void computeSetup(const PrimitiveBatch &batch, unsigned nvaryings, SetupLanes &out)
+{
+	for (int base = 0; base < batch.count; base += LANES)
+	{
+		SimdVec ax = vLoad(batch.x[0] + base), ay = vLoad(batch.y[0] + base);
+		SimdVec bx = vLoad(batch.x[1] + base), by = vLoad(batch.y[1] + base);
+		SimdVec cx = vLoad(batch.x[2] + base), cy = vLoad(batch.y[2] + base);
+		SimdVec abx = vSub(bx, ax), aby = vSub(by, ay);  // 边AB
+		SimdVec acx = vSub(cx, ax), acy = vSub(cy, ay);  // 边AC
+		SimdVec area2 = vSub(vMul(abx, acy), vMul(acx, aby));
+		SimdVec invArea2 = vDiv(vSet1(1.0f), area2);
+
+		vStore(out.area2 + base, area2);
+		vStore(out.xmin + base, vMin(ax, vMin(bx, cx)));
+		vStore(out.xmax + base, vMax(ax, vMax(bx, cx)));
+		vStore(out.ymin + base, vMin(ay, vMin(by, cy)));
+		vStore(out.ymax + base, vMax(ay, vMax(by, cy)));
+
+		// 经过三个顶点值的平面方程，一个向量一起算，结果写到每个三角形的Plane里
+		auto plane = [&](SimdVec q0, SimdVec q1, SimdVec q2, auto target)
+		{
+			SimdVec d1 = vSub(q1, q0), d2 = vSub(q2, q0);
+			float a[LANES], dx[LANES], dy[LANES];
+			vStore(a, q0);
+			vStore(dx, vMul(vSub(vMul(d1, acy), vMul(d2, aby)), invArea2));
+			vStore(dy, vMul(vSub(vMul(d2, abx), vMul(d1, acx)), invArea2));
+			for (int l = 0; l < LANES; ++l)
+				target(out.setups[base + l]) = Plane{ a[l], dx[l], dy[l] };
+		};
+		SimdVec zero = vSet1(0.0f), one = vSet1(1.0f);
+		plane(one, zero, zero, [](TriangleSetup &t) -> Plane & { return t.bar[0]; });
+		plane(zero, one, zero, [](TriangleSetup &t) -> Plane & { return t.bar[1]; });
+		plane(zero, zero, one, [](TriangleSetup &t) -> Plane & { return t.bar[2]; });
+		plane(vLoad(batch.z[0] + base), vLoad(batch.z[1] + base), vLoad(batch.z[2] + base), [](TriangleSetup &t) -> Plane & { return t.z; });
+		plane(vLoad(batch.w[0] + base), vLoad(batch.w[1] + base), vLoad(batch.w[2] + base), [](TriangleSetup &t) -> Plane & { return t.w; });
+		for (unsigned k = 0; k < nvaryings; ++k)
+			plane(vLoad(batch.varying[k][0] + base), vLoad(batch.varying[k][1] + base), vLoad(batch.varying[k][2] + base),
+				[k](TriangleSetup &t) -> Plane & { return t.varying[k]; });
+	}
+}
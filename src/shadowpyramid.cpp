@@ -0,0 +1,60 @@
+#include <algorithm>        // 包含std::min和std::max
+#include <limits>           // 包含float的最大值，空单元的初始范围
+
+#include "shadowpyramid.h"  // 包含ShadowPyramid类的声明
+
+// 构造函数：单元边长每层翻倍，直到一个单元覆盖整个阴影贴图
+ShadowPyramid::ShadowPyramid(unsigned width, unsigned height) : width_(width), height_(height)
+{
+	size_t offset = 0;
+	for (unsigned size = 2; ; size *= 2)
+	{
+		Level level = { (width + size - 1) / size, (height + size - 1) / size, offset };
+		levels_.push_back(level);
+		offset += size_t(level.width) * level.height;
+		if (level.width == 1 && level.height == 1) break;
+	}
+	cells_.resize(offset);
+}
+
+// build函数：第0层直接从阴影贴图的2x2深度得到，之后每层合并上一层的2x2个单元
+void ShadowPyramid::build(JobSystem &jobs, const float *shadowBuffer)
+{
+	for (size_t l = 0; l < levels_.size(); ++l)
+	{
+		const Level &level = levels_[l];
+		MinMax *dst = &cells_[level.offset];
+		// 源数据：第0层的源是阴影贴图本身
+		unsigned srcWidth = l == 0 ? width_ : levels_[l - 1].width;
+		unsigned srcHeight = l == 0 ? height_ : levels_[l - 1].height;
+		const MinMax *src = l == 0 ? nullptr : &cells_[levels_[l - 1].offset];
+		jobs.parallelFor(0, int(level.height), 16, [&](int begin, int end)
+		{
+			for (int row = begin; row < end; ++row)
+			{
+				unsigned y = unsigned(row);  // 与源数据的尺寸一样用无符号数比较
+				for (unsigned x = 0; x < level.width; ++x)
+				{
+					MinMax cell = { std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+					for (unsigned sy = 2 * y; sy < 2 * y + 2 && sy < srcHeight; ++sy)
+					{
+						for (unsigned sx = 2 * x; sx < 2 * x + 2 && sx < srcWidth; ++sx)
+						{
+							if (src)
+							{
+								cell.zMin = std::min(cell.zMin, src[sy * srcWidth + sx].zMin);
+								cell.zMax = std::max(cell.zMax, src[sy * srcWidth + sx].zMax);
+							}
+							else
+							{
+								cell.zMin = std::min(cell.zMin, shadowBuffer[sy * srcWidth + sx]);
+								cell.zMax = std::max(cell.zMax, shadowBuffer[sy * srcWidth + sx]);
+							}
+						}
+					}
+					dst[y * level.width + x] = cell;
+				}
+			}
+		});
+	}
+}
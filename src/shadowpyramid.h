@@ -0,0 +1,60 @@
+#pragma once // 防止头文件被重复包含
+
+#include <vector>      // 包含std::vector
+
+#include "jobs.h"      // 包含JobSystem类，并行构建
+
+// ShadowPyramid类：阴影贴图的最小/最大深度金字塔
+// 第l层的每个单元保存阴影贴图中(2^(l+1)) x (2^(l+1))个深度的最小值和最大值，边缘的单元只统计存在的深度
+// 着色时先查PCF采样范围内的深度范围：被测深度不小于最大值说明所有采样都不遮挡(完全照亮)，
+// 小于最小值说明所有采样都遮挡(完全在阴影中)，两种情况都不用逐个采样；只有半影区才做完整的PCF
+// 深度约定与zBuffer相同：z越大越靠近光源
+class ShadowPyramid {
+public:
+	// width, height为阴影贴图的尺寸，内存在这里一次分配好，每帧构建时不再分配
+	ShadowPyramid(unsigned width, unsigned height);
+
+	// 从阴影贴图构建所有层，每层按行并行；阴影通道写完(并解压)深度之后调用
+	void build(JobSystem &jobs, const float *shadowBuffer);
+
+	// 查询阴影贴图中[x0, x1] x [y0, y1](闭区间，会裁剪到贴图范围内)的深度范围，结果是保守的(可能包含范围外的深度)
+	// 选择单元边长大于矩形边长的最低一层，矩形在每个方向上最多跨两个单元，固定读2x2个单元(可能重复)，没有循环
+	// 裁剪后矩形为空时返回false。每个片段都要调用，所以放在头文件里内联
+	bool range(int x0, int y0, int x1, int y1, float &zMin, float &zMax) const
+	{
+		x0 = x0 < 0 ? 0 : x0;
+		y0 = y0 < 0 ? 0 : y0;
+		x1 = x1 < int(width_) ? x1 : int(width_) - 1;
+		y1 = y1 < int(height_) ? y1 : int(height_) - 1;
+		if (x0 > x1 || y0 > y1) return false;
+
+		int span = (x1 - x0) > (y1 - y0) ? (x1 - x0) : (y1 - y0);
+		int l = 0;  // 第l层单元边长为2^(l+1)
+		while ((2 << l) <= span && l + 1 < int(levels_.size())) ++l;
+		const Level &level = levels_[l];
+		const MinMax *cells = &cells_[level.offset];
+		int cx0 = x0 >> (l + 1), cx1 = x1 >> (l + 1), cy0 = y0 >> (l + 1), cy1 = y1 >> (l + 1);
+		const MinMax &a = cells[cy0 * level.width + cx0], &b = cells[cy0 * level.width + cx1];
+		const MinMax &c = cells[cy1 * level.width + cx0], &d = cells[cy1 * level.width + cx1];
+		float min0 = a.zMin < b.zMin ? a.zMin : b.zMin, min1 = c.zMin < d.zMin ? c.zMin : d.zMin;
+		float max0 = a.zMax > b.zMax ? a.zMax : b.zMax, max1 = c.zMax > d.zMax ? c.zMax : d.zMax;
+		zMin = min0 < min1 ? min0 : min1;
+		zMax = max0 > max1 ? max0 : max1;
+		return true;
+	}
+
+	unsigned cntLevel() const { return unsigned(levels_.size()); }
+
+private:
+	struct MinMax {
+		float zMin, zMax;
+	};
+	struct Level {
+		unsigned width, height;  // 单元的列数和行数
+		size_t offset;           // 第一个单元在cells_中的位置
+	};
+
+	unsigned width_, height_;
+	std::vector<Level> levels_;
+	std::vector<MinMax> cells_;   // 所有层的单元，逐层按行优先存储
+};
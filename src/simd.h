@@ -0,0 +1,105 @@
+#pragma once // 防止头文件被重复包含
+
+// 多指令集的SIMD核心：同一份核心代码在每个指令集的命名空间里各编译一次，运行时按cpu.h选出的等级调用其中一份
+// 所有实现都编译进同一个程序，不需要按最低的机器编译。用法(见gl.cpp)：
+//   SIMD_TARGET_PUSH("avx")
+//   namespace xxx_avx { using namespace simd_avx; #include "xxxkernel.h" }
+//   SIMD_TARGET_POP
+// 核心只能用这里的逐分量运算，或者不依赖指令集的标量代码(由编译器按目标指令集生成)
+
+#include <algorithm>  // 包含std::min, std::max，标量实现
+
+#include "cpu.h"      // 包含SimdLevel
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#define SIMD_X86 1
+#endif
+
+// SIMD_TARGET_PUSH/POP：之间定义的函数按指定的指令集编译，不需要给整个文件加编译选项
+// GCC打开AVX-512时也允许了FMA，会把乘法和减法合并成乘加，这里关掉浮点收缩，保证各指令集的结果相同
+// MSVC不需要：任何指令集的内建函数都可以直接使用，也不会自动生成FMA
+#define SIMD_PRAGMA(x) _Pragma(#x)
+#if defined(__clang__)
+#define SIMD_TARGET_PUSH(isa) SIMD_PRAGMA(clang attribute push(__attribute__((target(isa))), apply_to = function))
+#define SIMD_TARGET_POP SIMD_PRAGMA(clang attribute pop)
+#elif defined(__GNUC__)
+#define SIMD_TARGET_PUSH(isa) SIMD_PRAGMA(GCC push_options) SIMD_PRAGMA(GCC target(isa)) SIMD_PRAGMA(GCC optimize("fp-contract=off"))
+#define SIMD_TARGET_POP SIMD_PRAGMA(GCC pop_options)
+#else
+#define SIMD_TARGET_PUSH(isa)
+#define SIMD_TARGET_POP
+#endif
+
+// 每个指令集的向量包装：LANES为每个向量的float个数，SimdVec为向量类型
+// vLoad/vStore/vAdd/vSub/vMul/vDiv/vMin/vMax/vSet1为逐分量运算，只有加减乘除和min/max，没有乘加融合，
+// 因此不同指令集算出的结果完全相同
+
+// 标量实现：4个一组，任何平台都可用
+namespace simd_scalar {
+const int LANES = 4;
+struct SimdVec { float v[LANES]; };
+#define SIMD_LANES(expr) SimdVec r; for (int l = 0; l < LANES; ++l) r.v[l] = (expr); return r
+static inline SimdVec vLoad(const float *p) { SIMD_LANES(p[l]); }
+static inline void vStore(float *p, SimdVec a) { for (int l = 0; l < LANES; ++l) p[l] = a.v[l]; }
+static inline SimdVec vAdd(SimdVec a, SimdVec b) { SIMD_LANES(a.v[l] + b.v[l]); }
+static inline SimdVec vSub(SimdVec a, SimdVec b) { SIMD_LANES(a.v[l] - b.v[l]); }
+static inline SimdVec vMul(SimdVec a, SimdVec b) { SIMD_LANES(a.v[l] * b.v[l]); }
+static inline SimdVec vDiv(SimdVec a, SimdVec b) { SIMD_LANES(a.v[l] / b.v[l]); }
+static inline SimdVec vMin(SimdVec a, SimdVec b) { SIMD_LANES(std::min(a.v[l], b.v[l])); }
+static inline SimdVec vMax(SimdVec a, SimdVec b) { SIMD_LANES(std::max(a.v[l], b.v[l])); }
+static inline SimdVec vSet1(float v) { SIMD_LANES(v); }
+#undef SIMD_LANES
+}
+
+#ifdef SIMD_X86
+SIMD_TARGET_PUSH("sse2")
+namespace simd_sse2 {
+const int LANES = 4;
+typedef __m128 SimdVec;
+static inline SimdVec vLoad(const float *p) { return _mm_loadu_ps(p); }
+static inline void vStore(float *p, SimdVec a) { _mm_storeu_ps(p, a); }
+static inline SimdVec vAdd(SimdVec a, SimdVec b) { return _mm_add_ps(a, b); }
+static inline SimdVec vSub(SimdVec a, SimdVec b) { return _mm_sub_ps(a, b); }
+static inline SimdVec vMul(SimdVec a, SimdVec b) { return _mm_mul_ps(a, b); }
+static inline SimdVec vDiv(SimdVec a, SimdVec b) { return _mm_div_ps(a, b); }
+static inline SimdVec vMin(SimdVec a, SimdVec b) { return _mm_min_ps(a, b); }
+static inline SimdVec vMax(SimdVec a, SimdVec b) { return _mm_max_ps(a, b); }
+static inline SimdVec vSet1(float v) { return _mm_set1_ps(v); }
+}
+SIMD_TARGET_POP
+
+SIMD_TARGET_PUSH("avx")
+namespace simd_avx {
+const int LANES = 8;
+typedef __m256 SimdVec;
+static inline SimdVec vLoad(const float *p) { return _mm256_loadu_ps(p); }
+static inline void vStore(float *p, SimdVec a) { _mm256_storeu_ps(p, a); }
+static inline SimdVec vAdd(SimdVec a, SimdVec b) { return _mm256_add_ps(a, b); }
+static inline SimdVec vSub(SimdVec a, SimdVec b) { return _mm256_sub_ps(a, b); }
+static inline SimdVec vMul(SimdVec a, SimdVec b) { return _mm256_mul_ps(a, b); }
+static inline SimdVec vDiv(SimdVec a, SimdVec b) { return _mm256_div_ps(a, b); }
+static inline SimdVec vMin(SimdVec a, SimdVec b) { return _mm256_min_ps(a, b); }
+static inline SimdVec vMax(SimdVec a, SimdVec b) { return _mm256_max_ps(a, b); }
+static inline SimdVec vSet1(float v) { return _mm256_set1_ps(v); }
+}
+SIMD_TARGET_POP
+
+SIMD_TARGET_PUSH("avx512f")
+namespace simd_avx512 {
+const int LANES = 16;
+typedef __m512 SimdVec;
+static inline SimdVec vLoad(const float *p) { return _mm512_loadu_ps(p); }
+static inline void vStore(float *p, SimdVec a) { _mm512_storeu_ps(p, a); }
+static inline SimdVec vAdd(SimdVec a, SimdVec b) { return _mm512_add_ps(a, b); }
+static inline SimdVec vSub(SimdVec a, SimdVec b) { return _mm512_sub_ps(a, b); }
+static inline SimdVec vMul(SimdVec a, SimdVec b) { return _mm512_mul_ps(a, b); }
+static inline SimdVec vDiv(SimdVec a, SimdVec b) { return _mm512_div_ps(a, b); }
+// GCC的_mm512_min_ps/_mm512_max_ps以未定义的向量作为直通值，会引出-Wmaybe-uninitialized；
+// 改用全掩码的形式，直通值给a，生成的指令相同
+static inline SimdVec vMin(SimdVec a, SimdVec b) { return _mm512_mask_min_ps(a, __mmask16(0xFFFF), a, b); }
+static inline SimdVec vMax(SimdVec a, SimdVec b) { return _mm512_mask_max_ps(a, __mmask16(0xFFFF), a, b); }
+static inline SimdVec vSet1(float v) { return _mm512_set1_ps(v); }
+}
+SIMD_TARGET_POP
+#endif
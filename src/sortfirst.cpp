@@ -0,0 +1,181 @@
+#include <algorithm>    // 包含std::min, std::max
+#include <chrono>       // 包含std::chrono，计时
+#include <cstdint>      // 包含std::int32_t
+#include <filesystem>   // 包含std::filesystem，创建输出目录
+#include <iostream>     // 包含std::cerr
+
+#include "sortfirst.h"  // 包含RegionBalancer和SortFirstRenderer类的声明
+#include "tiles.h"      // 包含TILE_SIZE，横条的分界对齐到分块行
+
+namespace {
+
+const double MIN_REGION_MS = 0.01;  // 重新划分时每个横条的最小开销，避免空横条的开销为0
+
+// 协调者发给工作进程的任务：横条的像素矩形，x0 < 0表示结束
+struct RegionTask
+{
+	std::int32_t x0, y0, x1, y1;
+};
+
+// 工作进程的回复：渲染是否成功、整帧和着色通道的耗时，成功时后面跟着横条的像素(按行连续，与TGAImage的存储顺序相同)
+struct RegionResult
+{
+	std::int32_t ok;
+	double ms, shadingMs;
+};
+
+// 横条在图像缓冲区中的字节范围：横条占满整行，像素是连续的一段
+std::size_t stripOffset(const TGAImage &image, Vec2i rectMin)
+{
+	return std::size_t(rectMin.y) * image.get_width() * TGAImage::RGB;
+}
+
+std::size_t stripBytes(const TGAImage &image, Vec2i rectMin, Vec2i rectMax)
+{
+	return std::size_t(rectMax.y - rectMin.y + 1) * image.get_width() * TGAImage::RGB;
+}
+
+} // namespace
+
+RegionBalancer::RegionBalancer(unsigned width, unsigned height, int cntRegion) : width_(width), height_(height)
+{
+	int cntRow = (int(height) + TILE_SIZE - 1) / TILE_SIZE;  // 分块的行数
+	cntRegion = std::max(1, std::min(cntRegion, cntRow));
+	bounds_.resize(cntRegion + 1);
+	next_.resize(cntRegion + 1);
+	for (int r = 0; r <= cntRegion; ++r) bounds_[r] = r * cntRow / cntRegion;
+}
+
+Vec2i RegionBalancer::rectMin(int r) const
+{
+	return Vec2i(0, bounds_[r] * TILE_SIZE);
+}
+
+Vec2i RegionBalancer::rectMax(int r) const
+{
+	return Vec2i(int(width_) - 1, std::min(bounds_[r + 1] * TILE_SIZE, int(height_)) - 1);
+}
+
+// rebalance函数：沿着画面从下往上累计开销，第r条新分界放在累计开销达到总量的r/size()处(在所在横条内按行线性插值)，
+// 四舍五入到分块行，再保证每个横条至少一个分块行
+void RegionBalancer::rebalance(const double *ms)
+{
+	int n = size(), cntRow = bounds_[n];
+	double total = 0.0;
+	for (int r = 0; r < n; ++r) total += std::max(ms[r], MIN_REGION_MS);
+	next_[0] = 0;
+	next_[n] = cntRow;
+	int strip = 0;         // 新分界所在的旧横条
+	double before = 0.0;   // strip之前各横条的累计开销
+	for (int r = 1; r < n; ++r)
+	{
+		double target = total * r / n;
+		while (strip < n - 1 && before + std::max(ms[strip], MIN_REGION_MS) < target)
+		{
+			before += std::max(ms[strip], MIN_REGION_MS);
+			strip++;
+		}
+		double fraction = std::min(1.0, (target - before) / std::max(ms[strip], MIN_REGION_MS));
+		int bound = int(bounds_[strip] + fraction * (bounds_[strip + 1] - bounds_[strip]) + 0.5);
+		next_[r] = std::max(next_[r - 1] + 1, std::min(bound, cntRow - (n - r)));
+	}
+	bounds_.swap(next_);
+}
+
+SortFirstRenderer::SortFirstRenderer(RenderContext &context, ProcessGroup &group)
+	: context_(context), group_(group), balancer_(context.config().width, context.config().height, group.size()),
+	frame_(context.config().width, context.config().height, TGAImage::RGB), ms_(group.size(), 0.0), shadingMs_(group.size(), 0.0)
+{
+}
+
+// coordinate函数：每帧先把任务发给所有工作进程，再渲染自己的横条，最后按进程顺序收回结果
+// 横条占满整行，工作进程发回的像素直接收到拼接画面的对应位置
+bool SortFirstRenderer::coordinate(Model **modelData, Matrix *modelTrans, bool *modelOccluder, unsigned cntModel, const std::string &outputDir, int cntFrame)
+{
+	std::ostream *log = context_.config().log;
+	int n = balancer_.size();
+	bool ok = true;
+	for (int f = 0; f < cntFrame && ok; ++f)
+	{
+		auto frameStart = std::chrono::steady_clock::now();
+		for (int r = 1; r < n && ok; ++r)
+		{
+			Vec2i lo = balancer_.rectMin(r), hi = balancer_.rectMax(r);
+			RegionTask task = { lo.x, lo.y, hi.x, hi.y };
+			ok = group_.send(r, &task, sizeof(task));
+		}
+		if (!ok) break;
+
+		// 协调者自己渲染第0条
+		auto start = std::chrono::steady_clock::now();
+		Vec2i lo = balancer_.rectMin(0), hi = balancer_.rectMax(0);
+		ok = context_.renderRegion(modelData, modelTrans, modelOccluder, cntModel, lo, hi);
+		ms_[0] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		shadingMs_[0] = context_.shadingMs();
+		std::copy_n(context_.frame().buffer() + stripOffset(frame_, lo), stripBytes(frame_, lo, hi), frame_.buffer() + stripOffset(frame_, lo));
+
+		for (int r = 1; r < n; ++r)
+		{
+			RegionResult result;
+			Vec2i rlo = balancer_.rectMin(r), rhi = balancer_.rectMax(r);
+			if (!group_.recv(r, &result, sizeof(result)) || !result.ok || !group_.recv(r, frame_.buffer() + stripOffset(frame_, rlo), stripBytes(frame_, rlo, rhi)))
+			{
+				std::cerr << "sort-first: process " << r << " failed to render its region" << std::endl;
+				ok = false;
+				break;
+			}
+			ms_[r] = result.ms;
+			shadingMs_[r] = result.shadingMs;
+		}
+		if (!ok) break;
+
+		// 输出本帧的划分和各横条的渲染时间(整帧/着色通道)，着色时间最长的横条决定了划分的不均衡程度
+		double maxMs = 0.0, sumMs = 0.0;
+		for (int r = 0; r < n; ++r)
+		{
+			maxMs = std::max(maxMs, shadingMs_[r]);
+			sumMs += shadingMs_[r];
+		}
+		double frameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+		if (log)
+		{
+			*log << "sort-first frame " << f << ": " << frameMs << " ms, regions";
+			for (int r = 0; r < n; ++r)
+				*log << " [" << balancer_.rectMin(r).y << ", " << balancer_.rectMax(r).y << "] " << ms_[r] << "/" << shadingMs_[r] << " ms";
+			*log << ", shading max/mean " << (sumMs > 0.0 ? maxMs * n / sumMs : 1.0) << "x" << std::endl;
+		}
+		// 阴影通道每个进程都要完整地做，与横条大小无关，只按着色通道的耗时重新划分
+		balancer_.rebalance(shadingMs_.data());
+	}
+
+	// 通知工作进程结束，出错时也要通知，否则它们会一直等下去(进程数多于分块行数时，多出的进程没有横条，也在这里结束)
+	RegionTask stop = { -1, -1, -1, -1 };
+	for (int r = 1; r < group_.size(); ++r) group_.send(r, &stop, sizeof(stop));
+	if (!ok || outputDir.empty()) return ok;
+
+	if (!std::filesystem::exists(outputDir)) std::filesystem::create_directories(outputDir);
+	context_.depth().write_tga_file(outputDir + "/new_depth.tga");  // 阴影通道每个进程都完整地做了，协调者的深度图就是整幅的
+	frame_.write_tga_file(outputDir + "/new_frame.tga");
+	if (log) *log << "finish writing frame.tga" << std::endl;
+	return true;
+}
+
+// work函数：渲染失败时也回复(ok为0)，协调者据此结束，而不是等到连接断开
+bool SortFirstRenderer::work(Model **modelData, Matrix *modelTrans, bool *modelOccluder, unsigned cntModel)
+{
+	while (true)
+	{
+		RegionTask task;
+		if (!group_.recv(0, &task, sizeof(task))) return false;
+		if (task.x0 < 0) return true;
+		Vec2i lo(task.x0, task.y0), hi(task.x1, task.y1);
+		auto start = std::chrono::steady_clock::now();
+		RegionResult result;
+		const TGAImage &frame = context_.frame();
+		result.ok = hi.x == frame.get_width() - 1 && context_.renderRegion(modelData, modelTrans, modelOccluder, cntModel, lo, hi);  // 横条必须占满整行
+		result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		result.shadingMs = context_.shadingMs();
+		if (!group_.send(0, &result, sizeof(result))) return false;
+		if (result.ok && !group_.send(0, frame.buffer() + stripOffset(frame, lo), stripBytes(frame, lo, hi))) return false;
+	}
+}
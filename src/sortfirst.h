@@ -0,0 +1,55 @@
+#pragma once // 防止头文件被重复包含
+
+#include <string>     // 包含std::string
+#include <vector>     // 包含std::vector
+
+#include "geometry.h" // 包含Vec2i和Matrix
+#include "tgaimage.h" // 包含TGAImage类，拼接的画面
+#include "renderer.h" // 包含RenderContext类
+#include "composite.h" // 包含ProcessGroup类，进程之间的连接
+
+// RegionBalancer类：排序在前(sort-first)的分布式渲染中画面的划分
+// 画面按行切成若干个横条，每个横条交给一个进程；分界对齐到分块行(TILE_SIZE)，与整幅渲染时的分块划分相同。
+// 每帧结束后按各横条的实际渲染时间重新划分：假设开销在一个横条内均匀分布，把累计开销等分的位置作为新的分界
+class RegionBalancer {
+public:
+	// width x height的画面分成cntRegion个横条(不超过分块的行数)，开始时按行数平分
+	RegionBalancer(unsigned width, unsigned height, int cntRegion);
+
+	int size() const { return int(bounds_.size()) - 1; }
+	// 第r个横条的像素矩形(闭区间)，可以直接交给RenderContext::renderRegion
+	Vec2i rectMin(int r) const;
+	Vec2i rectMax(int r) const;
+
+	// 按上一帧每个横条的渲染时间(毫秒，共size()个)重新划分，每个横条至少保留一个分块行
+	void rebalance(const double *ms);
+
+private:
+	unsigned width_, height_;
+	std::vector<int> bounds_;  // 横条的分界(分块行)，第r个横条是[bounds_[r], bounds_[r + 1])
+	std::vector<int> next_;    // 重新划分时的新分界，容量在构造时就准备好
+};
+
+// SortFirstRenderer类：排序在前的分布式渲染，0号进程是协调者，其他进程是工作进程，所有进程都加载整个场景
+// 每帧协调者把各横条发给工作进程(自己也渲染第0条)，每个进程只渲染自己的横条：网格簇按横条的视锥剔除，
+// 图元裁到横条里光栅化；工作进程把横条的像素和渲染时间发回，协调者拼成整幅画面，再按着色通道的耗时重新划分下一帧的横条
+class SortFirstRenderer {
+public:
+	// context必须是普通的单视图渲染(不分区域、不做深度合并)，横条数就是进程数
+	SortFirstRenderer(RenderContext &context, ProcessGroup &group);
+
+	// 协调者：渲染cntFrame帧，最后一帧拼好的画面和阴影深度图写入outputDir，结束时通知工作进程退出
+	bool coordinate(Model **modelData, Matrix *modelTrans, bool *modelOccluder, unsigned cntModel, const std::string &outputDir, int cntFrame);
+	// 工作进程：反复接收横条、渲染并发回，直到协调者通知结束
+	bool work(Model **modelData, Matrix *modelTrans, bool *modelOccluder, unsigned cntModel);
+
+	const TGAImage &frame() const { return frame_; } // 协调者拼好的画面
+
+private:
+	RenderContext &context_;
+	ProcessGroup &group_;
+	RegionBalancer balancer_;
+	TGAImage frame_;
+	std::vector<double> ms_;         // 每个横条上一帧的渲染时间(毫秒)
+	std::vector<double> shadingMs_;  // 其中着色通道的耗时，按它重新划分
+};
@@ -0,0 +1,36 @@
+// 纹理采样核心：最近邻采样漫反射、法线和镜面高光贴图
+// 注意：这个文件没有#pragma once，model.cpp在每个指令集的命名空间里各包含一次，每次用不同的编译目标编译同一份代码
+// 这里是标量代码，由编译器按目标指令集生成；各命名空间中的运算顺序相同，结果完全相同
+
+// texel函数：归一化的uv乘以贴图尺寸后截断成纹素坐标，坐标无效或贴图为空时返回默认颜色，与TGAImage::get相同
+// 纹素的地址直接在这里算，不经过TGAImage::get的函数调用
+static TGAColor texel(const TGAImage &image, const Vec2f &uv)
+{
+	int width = image.get_width(), height = image.get_height();
+	int x = int(uv[0] * width), y = int(uv[1] * height);
+	if (!image.buffer() || x < 0 || y < 0 || x >= width || y >= height)
+		return {};
+	int bytespp = image.get_bytespp();
+	return TGAColor(image.buffer() + (x + y * width) * bytespp, std::uint8_t(bytespp));
+}
+
+static TGAColor sampleDiffuse(const TGAImage &image, const Vec2f &uv)
+{
+	return texel(image, uv);
+}
+
+// sampleNormal函数：颜色值(0-255)映射到法线分量(-1到1)，TGA的通道顺序是BGR，所以第i个通道对应第2-i个分量
+static Vec3f sampleNormal(const TGAImage &image, const Vec2f &uv)
+{
+	TGAColor c = texel(image, uv);
+	Vec3f res;
+	for (int i = 0; i < 3; i++)
+		res[2 - i] = c[i] / 255. * 2 - 1;
+	return res;
+}
+
+// sampleSpecular函数：镜面高光贴图是灰度图，只取第一个通道
+static double sampleSpecular(const TGAImage &image, const Vec2f &uv)
+{
+	return texel(image, uv)[0];
+}
@@ -291,7 +291,7 @@ void TGAImage::set(int x, int y, const TGAColor &c) {
 }
 
 // 获取每个像素的字节数 (bytes per pixel)
-int TGAImage::get_bytespp() {
+int TGAImage::get_bytespp() const {
 	return bytespp;
 }
 
@@ -342,6 +342,10 @@ std::uint8_t *TGAImage::buffer() {
 	return data.data(); // vector::data() 返回指向内部数组的指针
 }
 
+const std::uint8_t *TGAImage::buffer() const {
+	return data.data();
+}
+
 // 清空图像数据，即将所有像素数据重置为0
 void TGAImage::clear() {
 	// 创建一个新的用0填充的向量，并赋值给 data，旧数据会被释放
@@ -386,3 +390,54 @@ void TGAImage::scale(int w, int h) {
 	width = w;    // 更新图像宽度
 	height = h;   // 更新图像高度
 }
+
+// 创建流式写入的TGA文件：文件头 + width*height*bytespp字节的像素数据 + 文件尾
+bool TGAStreamWriter::open(const std::string &filename, const int w, const int h, const int bpp) {
+	width = w;
+	height = h;
+	bytespp = bpp;
+	out.open(filename, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+	if (!out.is_open()) {
+		std::cerr << "can't open file " << filename << "\n";
+		return false;
+	}
+	TGA_Header header;
+	header.bitsperpixel = bytespp << 3;
+	header.width = width;
+	header.height = height;
+	header.datatypecode = (bytespp == TGAImage::GRAYSCALE ? 3 : 2);  // 未压缩：每个像素的位置是固定的
+	header.imagedescriptor = 0x00;  // 左下角原点，与TGAImage::write_tga_file的默认值相同
+	out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	// 直接定位到像素数据之后写文件尾，中间的像素数据由文件系统补0
+	std::uint8_t developer_area_ref[4] = { 0, 0, 0, 0 };
+	std::uint8_t extension_area_ref[4] = { 0, 0, 0, 0 };
+	std::uint8_t footer[18] = { 'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0' };
+	out.seekp(std::streamoff(sizeof(header)) + std::streamoff(width) * height * bytespp);
+	out.write(reinterpret_cast<const char *>(developer_area_ref), sizeof(developer_area_ref));
+	out.write(reinterpret_cast<const char *>(extension_area_ref), sizeof(extension_area_ref));
+	out.write(reinterpret_cast<const char *>(footer), sizeof(footer));
+	if (!out.good()) {
+		std::cerr << "can't dump the tga file\n";
+		return false;
+	}
+	return true;
+}
+
+// 写入一个区域：每一行在文件中是连续的，逐行定位写入
+bool TGAStreamWriter::write_region(const int x, const int y, TGAImage &region, const int rw, const int rh) {
+	const std::uint8_t *data = region.buffer();
+	int stride = region.get_width() * bytespp;
+	for (int j = 0; j < rh; ++j) {
+		out.seekp(std::streamoff(sizeof(TGA_Header)) + (std::streamoff(y + j) * width + x) * bytespp);
+		out.write(reinterpret_cast<const char *>(data + j * stride), rw * bytespp);
+	}
+	if (!out.good()) {
+		std::cerr << "can't write the tga region\n";
+		return false;
+	}
+	return true;
+}
+
+void TGAStreamWriter::close() {
+	out.close();
+}
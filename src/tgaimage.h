@@ -109,10 +109,26 @@ public:
 
 	int get_width() const;  // 获取图像宽度
 	int get_height() const; // 获取图像高度
-	int get_bytespp();    // 获取每个像素的字节数
+	int get_bytespp() const; // 获取每个像素的字节数
 
 	// 返回指向图像原始像素数据缓冲区的指针
 	std::uint8_t *buffer();
+	const std::uint8_t *buffer() const;
 
 	void clear(); // 清空图像数据 (所有像素置为0)
+
+	std::size_t memory_bytes() const { return data.capacity(); } // 像素数据占用的内存(字节)
+};
+
+// TGAStreamWriter类：把图像按矩形区域逐块写入未压缩的TGA文件，内存中只需要保存当前区域
+// 文件打开时就写好文件头和文件尾，像素数据的位置固定(左下角原点，逐行存储)，每个区域的每一行直接定位写入
+class TGAStreamWriter {
+	std::fstream out;
+	int width = 0, height = 0, bytespp = 0;
+public:
+	// 创建文件：width x height的图像，bpp为每像素字节数(TGAImage::Format)，像素数据先全部为0
+	bool open(const std::string &filename, const int w, const int h, const int bpp);
+	// 把region左下角rw x rh的像素写到图像中以(x, y)为左下角的位置，region与图像的行方向相同(y向上)
+	bool write_region(const int x, const int y, TGAImage &region, const int rw, const int rh);
+	void close();
 };
@@ -0,0 +1,174 @@
+#include <algorithm>  // 包含std::min, std::max, std::sort
+#include <chrono>     // 包含std::chrono::steady_clock，统计每个分块的实际耗时
+
+#include "tiles.h"    // 包含rasterizeTiles函数的声明
+
+// 一个子作业：分块(或拆分出的子分块)的像素矩形
+struct TileJob
+{
+	Vec2i rectMin, rectMax;  // 像素矩形(闭区间)
+	int tile;                // 所属的分块
+	float estimate;          // 估计开销
+	double ms;               // 实际耗时
+};
+
+// overlapCost函数：一个三角形在矩形内的估计开销，包围盒与矩形不相交时为0
+static float overlapCost(const TriangleSetup &setup, Vec2i rectMin, Vec2i rectMax, unsigned cntSample)
+{
+	int w = std::min(setup.bboxmax.x, rectMax.x) - std::max(setup.bboxmin.x, rectMin.x) + 1;
+	int h = std::min(setup.bboxmax.y, rectMax.y) - std::max(setup.bboxmin.y, rectMin.y) + 1;
+	if (w <= 0 || h <= 0) return 0.0f;
+	return TILE_TRIANGLE_COST + float(w * h * cntSample);
+}
+
+// splitTile函数：开销超过阈值的矩形按四叉树拆成4个子矩形，递归直到开销不超过阈值或者到达MIN_TILE_SIZE
+// 子矩形的开销用分块的三角形列表重新估计，列表本身不拆，光栅化时跳过包围盒不相交的三角形
+static void splitTile(const std::pmr::vector<const TriangleSetup *> &triangles, Vec2i rectMin, Vec2i rectMax, int tile,
+	float estimate, float threshold, unsigned cntSample, std::pmr::vector<TileJob> &out)
+{
+	int w = rectMax.x - rectMin.x + 1, h = rectMax.y - rectMin.y + 1;
+	if (estimate <= threshold || (w <= MIN_TILE_SIZE && h <= MIN_TILE_SIZE))
+	{
+		out.push_back(TileJob{ rectMin, rectMax, tile, estimate, 0.0 });
+		return;
+	}
+	// 从中间对半切，切分位置保持MIN_TILE_SIZE对齐；小于两倍MIN_TILE_SIZE的方向不切
+	int halfW = w >= 2 * MIN_TILE_SIZE ? (w / 2 + MIN_TILE_SIZE - 1) / MIN_TILE_SIZE * MIN_TILE_SIZE : w;
+	int halfH = h >= 2 * MIN_TILE_SIZE ? (h / 2 + MIN_TILE_SIZE - 1) / MIN_TILE_SIZE * MIN_TILE_SIZE : h;
+	for (int y = rectMin.y; y <= rectMax.y; y += halfH)
+	{
+		for (int x = rectMin.x; x <= rectMax.x; x += halfW)
+		{
+			Vec2i subMin(x, y), subMax(std::min(x + halfW - 1, rectMax.x), std::min(y + halfH - 1, rectMax.y));
+			float cost = 0.0f;
+			for (const TriangleSetup *setup : triangles)
+				cost += overlapCost(*setup, subMin, subMax, cntSample);
+			if (cost > 0.0f)
+				splitTile(triangles, subMin, subMax, tile, cost, threshold, cntSample, out);
+		}
+	}
+}
+
+// rasterizeTiles函数：分块 -> 估计开销 -> 拆分热点分块 -> 按开销从大到小并行光栅化
+void rasterizeTiles(JobSystem &jobs, const PrimitiveBins &bins, const IShader &shader, Vec3f *colorBuffer, float *zBuffer,
+	unsigned width, unsigned height, const float d[][2], unsigned cntSample, DepthTiles *depthTiles, TileStats *stats)
+{
+	std::pmr::memory_resource *arena = bins.get_allocator().resource();
+	int tilesX = (int(width) + TILE_SIZE - 1) / TILE_SIZE, tilesY = (int(height) + TILE_SIZE - 1) / TILE_SIZE;
+	std::pmr::vector<std::pmr::vector<const TriangleSetup *>> tiles(tilesX * tilesY, arena); // 每个分块的三角形，按提交顺序
+	std::pmr::vector<float> costs(tilesX * tilesY, 0.0f, arena);                              // 每个分块的估计开销
+
+	// 分块：每一行分块一个作业，各自扫描全部三角形，先数出每个分块的三角形数再填，列表只分配一次
+	jobs.parallelFor(0, tilesY, 1, [&](int begin, int end)
+	{
+		std::pmr::vector<unsigned> counts(tilesX, arena);
+		for (int ty = begin; ty < end; ++ty)
+		{
+			int y0 = ty * TILE_SIZE, y1 = std::min(y0 + TILE_SIZE, int(height)) - 1;
+			std::pmr::vector<const TriangleSetup *> *row = &tiles[ty * tilesX];
+			float *rowCosts = &costs[ty * tilesX];
+			std::fill(counts.begin(), counts.end(), 0u);
+			for (const auto &bin : bins)
+				for (const TriangleSetup &setup : bin)
+					if (setup.bboxmax.y >= y0 && setup.bboxmin.y <= y1)
+						for (int tx = setup.bboxmin.x / TILE_SIZE; tx <= setup.bboxmax.x / TILE_SIZE; ++tx) counts[tx]++;
+			for (int tx = 0; tx < tilesX; ++tx)
+				row[tx].reserve(counts[tx]);
+			for (const auto &bin : bins)
+			{
+				for (const TriangleSetup &setup : bin)
+				{
+					if (setup.bboxmax.y < y0 || setup.bboxmin.y > y1) continue;
+					for (int tx = setup.bboxmin.x / TILE_SIZE; tx <= setup.bboxmax.x / TILE_SIZE; ++tx)
+					{
+						Vec2i rectMin(tx * TILE_SIZE, y0), rectMax(std::min((tx + 1) * TILE_SIZE, int(width)) - 1, y1);
+						row[tx].push_back(&setup);
+						rowCosts[tx] += overlapCost(setup, rectMin, rectMax, cntSample);
+					}
+				}
+			}
+		}
+	});
+
+	// 拆分：阈值是平均每个子作业的开销，超过阈值的分块拆开，让各线程分到的工作尽量均衡
+	float total = 0.0f;
+	for (float cost : costs) total += cost;
+	float threshold = total / float(jobs.cntThread() * TILE_JOBS_PER_THREAD);
+	std::pmr::vector<TileJob> work(arena);
+	work.reserve(tiles.size());
+	unsigned cntSplit = 0;
+	for (int t = 0; t < tilesX * tilesY; ++t)
+	{
+		if (tiles[t].empty()) continue;
+		Vec2i rectMin((t % tilesX) * TILE_SIZE, (t / tilesX) * TILE_SIZE);
+		Vec2i rectMax(std::min(rectMin.x + TILE_SIZE, int(width)) - 1, std::min(rectMin.y + TILE_SIZE, int(height)) - 1);
+		std::size_t before = work.size();
+		splitTile(tiles[t], rectMin, rectMax, t, costs[t], threshold, cntSample, work);
+		if (work.size() - before > 1) cntSplit++;
+	}
+	// 最重的子作业排在最前面：parallelFor按顺序把它们压进当前线程的队列，其他线程从队头窃取
+	std::sort(work.begin(), work.end(), [](const TileJob &a, const TileJob &b) { return a.estimate > b.estimate; });
+
+	// 光栅化：每个子作业只写自己矩形内的像素，矩形之间互不重叠
+	TriangleKernel triangle = triangleKernel(activeSimdLevel());  // 按指令集选一次，所有子作业共用
+	jobs.parallelFor(0, int(work.size()), 1, [&](int begin, int end)
+	{
+		for (int k = begin; k < end; ++k)
+		{
+			TileJob &job = work[k];
+			auto start = std::chrono::steady_clock::now();
+			for (const TriangleSetup *setup : tiles[job.tile])
+			{
+				if (setup->bboxmax.x < job.rectMin.x || setup->bboxmin.x > job.rectMax.x ||
+					setup->bboxmax.y < job.rectMin.y || setup->bboxmin.y > job.rectMax.y) continue;
+				triangle(*setup, shader, colorBuffer, zBuffer, width, d, cntSample, job.rectMin, job.rectMax, depthTiles);
+			}
+			job.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+	});
+
+	if (!stats) return;
+	if (stats->tiles.empty())
+	{
+		stats->tilesX = tilesX;
+		stats->tilesY = tilesY;
+		stats->tiles.assign(tilesX * tilesY, TileCost{ 0, 0.0f, 0, 0.0 });
+	}
+	for (int t = 0; t < tilesX * tilesY; ++t)
+	{
+		stats->tiles[t].cntTriangle += unsigned(tiles[t].size());
+		stats->tiles[t].estimate += costs[t];
+	}
+	for (const TileJob &job : work)
+	{
+		TileCost &tile = stats->tiles[job.tile];
+		tile.cntJob++;
+		tile.ms += job.ms;
+	}
+	stats->cntJob += unsigned(work.size());
+	stats->cntSplit += cntSplit;
+}
+
+// cropBins函数：逐个三角形平移并裁剪包围盒
+void cropBins(const PrimitiveBins &bins, Vec2i rectMin, Vec2i rectMax, PrimitiveBins &out)
+{
+	out.clear();
+	out.resize(bins.size());
+	Vec2i size = rectMax - rectMin;  // 区域内的最大坐标
+	for (size_t c = 0; c < bins.size(); ++c)
+	{
+		for (const TriangleSetup &setup : bins[c])
+		{
+			if (setup.bboxmax.x < rectMin.x || setup.bboxmin.x > rectMax.x ||
+				setup.bboxmax.y < rectMin.y || setup.bboxmin.y > rectMax.y) continue;
+			out[c].push_back(setup);
+			TriangleSetup &cropped = out[c].back();
+			cropped.x0 -= float(rectMin.x);
+			cropped.y0 -= float(rectMin.y);
+			cropped.bboxmin = Vec2i(std::max(setup.bboxmin.x - rectMin.x, 0), std::max(setup.bboxmin.y - rectMin.y, 0));
+			cropped.bboxmax = Vec2i(std::min(setup.bboxmax.x - rectMin.x, size.x), std::min(setup.bboxmax.y - rectMin.y, size.y));
+			if (cropped.stamp && (cropped.bboxmin.x != setup.bboxmin.x - rectMin.x || cropped.bboxmin.y != setup.bboxmin.y - rectMin.y))
+				cropped.stamp = 0;
+		}
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once // 防止头文件被重复包含
+
+#include <memory_resource> // 包含std::pmr::vector，分块的三角形列表分配在每帧的内存资源里
+
+#include "gl.h"            // 包含TriangleSetup、IShader和triangleKernel函数
+#include "jobs.h"          // 包含JobSystem类，子作业在各线程间窃取执行
+
+const int TILE_SIZE = 64;          // 分块大小(像素)
+const int MIN_TILE_SIZE = 16;      // 热点分块最多拆到这么小，必须是RASTER_BLOCK的倍数，保证块的划分与不拆时相同
+const int TILE_JOBS_PER_THREAD = 4; // 每个线程平均分到的子作业数，决定拆分的阈值
+const float TILE_TRIANGLE_COST = 64.0f; // 估计开销时每个三角形的固定部分，相当于这么多个采样点
+static_assert(TILE_SIZE % MIN_TILE_SIZE == 0 && MIN_TILE_SIZE % RASTER_BLOCK == 0, "tiles must align to raster blocks");
+
+// 一个分块的开销统计
+struct TileCost
+{
+	unsigned cntTriangle;  // 包围盒与分块相交的三角形数
+	float estimate;        // 估计开销：每个三角形的固定开销加上包围盒在分块内覆盖的采样点数
+	unsigned cntJob;       // 拆成的子作业数，1表示没有拆分
+	double ms;             // 实际光栅化耗时(毫秒，各子作业之和)
+};
+
+// 分块光栅化的统计，同一个通道多次绘制时累加
+struct TileStats
+{
+	unsigned tilesX = 0, tilesY = 0;   // 分块的列数和行数
+	std::pmr::vector<TileCost> tiles;  // 每个分块的开销，行主序
+	unsigned cntJob = 0;               // 子作业总数
+	unsigned cntSplit = 0;             // 被拆分的分块数
+
+	explicit TileStats(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) : tiles(resource) {}
+};
+
+// rasterizeTiles函数：分块并行光栅化
+// 参数：jobs - 作业调度器，bins - 几何阶段的输出，按bin的顺序就是三角形的提交顺序，临时数据分配在bins的内存资源里，
+//      shader - 着色器，fragment必须能被多个线程同时调用，其余参数与triangle相同(depthTiles可以为空)，stats - 不为空时累加分块统计
+// 屏幕按TILE_SIZE分块，每一行分块由一个作业并行地按提交顺序收集包围盒与之相交的三角形，同时估计每个分块的开销。
+// 开销远高于平均的热点分块(人物的脸)按四叉树拆成子分块，直到开销低于阈值或者到达MIN_TILE_SIZE。
+// 所有子分块按估计开销从大到小提交，空闲线程从队头窃取，先拿走最重的，只覆盖地板的分块留到最后填补空隙。
+// 子分块之间像素互不重叠，每个子分块内部按提交顺序处理三角形，因此结果与串行光栅化完全相同
+void rasterizeTiles(JobSystem &jobs, const PrimitiveBins &bins, const IShader &shader, Vec3f *colorBuffer, float *zBuffer,
+	unsigned width, unsigned height, const float d[][2], unsigned cntSample, DepthTiles *depthTiles, TileStats *stats = nullptr);
+
+// cropBins函数：把整幅画面的图元裁到一个屏幕区域里，平移到以区域左下角为原点的坐标，结果写入out(沿用out的内存资源)
+// 参数：rectMin, rectMax - 区域在整幅画面中的像素矩形(闭区间)，rectMin必须是TILE_SIZE的倍数，
+//      这样区域内分块和光栅块的划分与整幅渲染时相同
+// 平面方程以(x0, y0)为原点，平移只改原点和包围盒；包围盒与区域不相交的三角形丢掉，bin的结构保持不变(提交顺序不变)。
+// 被区域边缘截断的小三角形改走通用路径，因为印章的覆盖掩码以整个包围盒的左下角为原点
+void cropBins(const PrimitiveBins &bins, Vec2i rectMin, Vec2i rectMax, PrimitiveBins &out);
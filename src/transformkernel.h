@@ -0,0 +1,36 @@
+// 矩阵变换的SIMD核心：n个齐次坐标乘以同一个4x4矩阵，out[i] = m * in[i]，in和out可以是同一个数组
+// 注意：这个文件没有#pragma once，gl.cpp在每个指令集的命名空间里各包含一次，每次用不同的编译目标编译同一份代码
+// 包含之前当前命名空间中要能看到simd.h中一个指令集的向量包装(LANES必须是4的倍数)
+//
+// 一个向量放LANES/4个点，每4路是一个点的(x, y, z, w)：按列展开为 0 + m[:,3]*w + m[:,2]*z + m[:,1]*y + m[:,0]*x，
+// 与geometry.h中dot(行, v)的求和顺序(从0开始，下标从大到小累加)逐位相同，所以结果与operator*完全一致
+static void transformPoints(const Matrix &m, const Vec4f *in, Vec4f *out, int n)
+{
+	const int POINTS = LANES / 4;  // 一个向量中的点数
+	float col[4][LANES];           // 矩阵的第j列，每4路重复一次
+	for (int j = 0; j < 4; ++j)
+		for (int l = 0; l < LANES; ++l)
+			col[j][l] = m[l % 4][j];
+	SimdVec c0 = vLoad(col[0]), c1 = vLoad(col[1]), c2 = vLoad(col[2]), c3 = vLoad(col[3]), zero = vSet1(0.0f);
+
+	for (int i = 0; i < n; i += POINTS)
+	{
+		// 每个点的分量广播到它的4路上，最后一组不满时重复最后一个点，结果不写回
+		float x[LANES], y[LANES], z[LANES], w[LANES], r[LANES];
+		for (int l = 0; l < LANES; ++l)
+		{
+			const Vec4f &p = in[std::min(i + l / 4, n - 1)];
+			x[l] = p.x;
+			y[l] = p.y;
+			z[l] = p.z;
+			w[l] = p.w;
+		}
+		SimdVec sum = vAdd(zero, vMul(c3, vLoad(w)));
+		sum = vAdd(sum, vMul(c2, vLoad(z)));
+		sum = vAdd(sum, vMul(c1, vLoad(y)));
+		sum = vAdd(sum, vMul(c0, vLoad(x)));
+		vStore(r, sum);
+		for (int p = 0; p < POINTS && i + p < n; ++p)
+			out[i + p] = Vec4f(r[4 * p], r[4 * p + 1], r[4 * p + 2], r[4 * p + 3]);
+	}
+}
@@ -0,0 +1,92 @@
+#include <cmath>       // 包含std::sqrt, std::exp2, std::exp, std::pow，双精度的参考值
+#include <cfloat>      // 包含FLT_MIN
+#include <cstdio>      // 包含printf，输出每项的实测误差
+
+#include "fastmath.h"  // 包含被测的近似函数
+
+// fastmath.h中近似函数的黄金测试：在着色用到的输入范围内逐点与双精度的标准库比较，
+// 最大相对误差必须在头文件注释写明的误差界之内；失败时返回非0，由ctest报告
+
+// Sweep结构：记录一项扫描中的最大相对误差和出现的位置
+struct Sweep
+{
+	const char *name;
+	double bound;      // 头文件中写明的误差界
+	double maxError;
+	float worstX;
+};
+
+// record函数：把一个点的近似值和参考值计入扫描结果，参考值为双精度
+static void record(Sweep &sweep, float x, float approx, double exact)
+{
+	double error = std::fabs(double(approx) - exact) / exact;
+	if (error > sweep.maxError)
+	{
+		sweep.maxError = error;
+		sweep.worstX = x;
+	}
+}
+
+// report函数：输出扫描结果，超过误差界时返回false
+static bool report(const Sweep &sweep)
+{
+	bool ok = sweep.maxError <= sweep.bound;
+	std::printf("%-32s max relative error %.3g at x = %.9g, bound %.3g  %s\n",
+		sweep.name, sweep.maxError, sweep.worstX, sweep.bound, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+int main()
+{
+	bool ok = true;
+
+	// rsqrtApprox：归一化时x是向量长度的平方，法线接近1，光源和视线方向的长度跨好几个数量级，
+	// 在[1e-6, 1e6]内按位模式每隔一段取一个点，覆盖每个指数区间的整个尾数
+	Sweep rsqrt = { "rsqrtApprox [1e-6, 1e6]", 1.8e-3, 0.0, 0.0f };
+	for (uint32_t bits = floatBits(1e-6f); bits <= floatBits(1e6f); bits += 61)
+	{
+		float x = bitsFloat(bits);
+		record(rsqrt, x, rsqrtApprox(x), 1.0 / std::sqrt(double(x)));
+	}
+	ok = report(rsqrt) && ok;
+
+	// exp2Approx：截断之前的整个有效范围[-126, 127]
+	Sweep exp2 = { "exp2Approx [-126, 127]", 3.4e-6, 0.0, 0.0f };
+	for (float x = -126.0f; x <= 127.0f; x += 1.0f / 4096.0f)
+		record(exp2, x, exp2Approx(x), std::exp2(double(x)));
+	ok = report(exp2) && ok;
+
+	// expApprox：深度着色器的mathExp(z - 1)用到[-2, 0]，误差界为3.4e-6；
+	// 更大的|x|上再加上x乘log2(e)带来的|x| * 6e-8，在[-20, 20]内检查
+	Sweep expShading = { "expApprox [-2, 0]", 3.4e-6, 0.0, 0.0f };
+	for (float x = -2.0f; x <= 0.0f; x += 1.0f / 65536.0f)
+		record(expShading, x, expApprox(x), std::exp(double(x)));
+	ok = report(expShading) && ok;
+
+	Sweep expWide = { "expApprox [-20, 20] - |x|*6e-8", 3.4e-6, 0.0, 0.0f };
+	for (float x = -20.0f; x <= 20.0f; x += 1.0f / 4096.0f)
+	{
+		double exact = std::exp(double(x));
+		// 把|x|带来的部分从误差中扣掉，剩下的与exp2Approx使用同一个误差界
+		double error = std::fabs(double(expApprox(x)) - exact) / exact - std::fabs(x) * 6e-8;
+		if (error > expWide.maxError)
+		{
+			expWide.maxError = error;
+			expWide.worstX = x;
+		}
+	}
+	ok = report(expWide) && ok;
+
+	// powInt<32>：镜面高光的max(0, dot(n, h))^32，x在[0, 1]内；
+	// 结果小于FLT_MIN时是非规格化数，精度本来就不够，不计入
+	Sweep pow32 = { "powInt<32> [0, 1]", 3.7e-6, 0.0, 0.0f };
+	for (float x = 0.0f; x <= 1.0f; x += 1.0f / 1048576.0f)
+	{
+		double exact = std::pow(double(x), 32.0);
+		if (exact < FLT_MIN) continue;
+		record(pow32, x, powInt<32>(x), exact);
+	}
+	ok = report(pow32) && ok;
+
+	return ok ? 0 : 1;
+}